@@ -0,0 +1,185 @@
+/*
+ * R503 Fingerprint Module - Access Event Journal
+ *
+ * Logs every identification to an R503_Journal. The identify path only
+ * copies a 14-byte record into a RAM ring; loop() flushes the ring in
+ * batches to the sink. At the end the journal is read back, checked and
+ * exported as CSV.
+ *
+ * The sink here is a RAM buffer so the sketch runs anywhere. On an ESP32
+ * use R503_FsJournalSink with LittleFS or SD instead, and open the file
+ * for R503_JournalReader to export it.
+ *
+ * With USE_EMULATOR uncommented the sketch runs against R503_Emulator and
+ * alternates an enrolled finger with an unknown one.
+ */
+
+#include "R503_Fingerprint.h"
+#include "R503_Journal.h"
+#include "R503_Emulator.h"
+
+// #define USE_EMULATOR
+
+#define RX_PIN 4
+#define TX_PIN 5
+#define R503_BAUD 57600
+
+#define ATTEMPTS 40
+#define LOG_BENCH_CALLS 10000
+#define STORE_SIZE 4096
+
+#ifdef USE_EMULATOR
+R503_Emulator emulator;
+R503_Fingerprint finger(&emulator);
+int8_t module;
+#else
+HardwareSerial r503Serial(1);
+R503_Fingerprint finger(&r503Serial);
+#endif
+
+// RAM stand-in for a journal file: written by the sink, read back as a Stream
+class MemoryStore : public Stream {
+public:
+  uint8_t data[STORE_SIZE];
+  uint32_t length = 0;
+  uint32_t position = 0;
+  
+  size_t write(uint8_t byte) {
+    if (length >= STORE_SIZE) return 0;
+    data[length++] = byte;
+    return 1;
+  }
+  int available() { return length - position; }
+  int read() { return position < length ? data[position++] : -1; }
+  int peek() { return position < length ? data[position] : -1; }
+  void rewind() { position = 0; }
+};
+
+MemoryStore store;
+R503_PrintJournalSink sink(&store);
+R503_Journal journal(&sink);
+
+void setupEmulator() {
+#ifdef USE_EMULATOR
+  module = emulator.addModule();
+  
+  emulator.setServiceTime(R503_GENIMG, 60);
+  emulator.setNoFingerTime(10);
+  emulator.setServiceTime(R503_IMG2TZ, 90);
+  emulator.setServiceTime(R503_SEARCH, 20);
+  emulator.setSearchCostPerPage(500);
+  
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  for (uint16_t id = 0; id < 10; id++) {
+    for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+      features[i] = (uint8_t)(i * 31 + id * 97 + (i * id) % 13);
+    }
+    emulator.enrollDirect(module, id, features);
+  }
+#endif
+}
+
+void presentFinger(uint16_t attempt) {
+#ifdef USE_EMULATOR
+  // Every third attempt is a finger that is not enrolled
+  uint16_t id = (attempt % 3 == 2) ? 40 : attempt % 10;
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+    features[i] = (uint8_t)(i * 31 + id * 97 + (i * id) % 13);
+  }
+  emulator.placeFinger(module, features);
+#endif
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+  
+  setupEmulator();
+
+#ifdef USE_EMULATOR
+  finger.begin(R503_BAUD);
+#else
+  r503Serial.begin(R503_BAUD, SERIAL_8N1, RX_PIN, TX_PIN);
+  if (!finger.begin(R503_BAUD)) {
+    Serial.println("R503 not found");
+    while (1) delay(1000);
+  }
+#endif
+  
+  // Cost of one log() call, the only journal work on the identify path.
+  // A separate journal keeps these records out of the access log
+  R503_Journal bench(&sink);
+  uint32_t logTime = 0;
+  for (uint16_t round = 0; round < LOG_BENCH_CALLS / R503_JOURNAL_CAPACITY; round++) {
+    uint32_t start = micros();
+    for (uint16_t i = 0; i < R503_JOURNAL_CAPACITY; i++) {
+      bench.log(R503_EVENT_USER, 0, i, 0, 0);
+    }
+    logTime += micros() - start;
+    
+    store.length = 0;
+    bench.flush();
+  }
+  Serial.print("log(): ");
+  Serial.print((logTime * 1000.0f) / bench.getLogged());
+  Serial.println(" ns/event");
+  store.length = 0;
+  
+  // Identify with the journal attached; flushing happens between attempts
+  finger.setJournal(&journal);
+  uint16_t matches = 0;
+  for (uint16_t attempt = 0; attempt < ATTEMPTS; attempt++) {
+    presentFinger(attempt);
+    
+    uint16_t fingerID;
+    uint16_t confidence;
+    if (finger.verifyFingerprint(fingerID, confidence)) {
+      matches++;
+    }
+    journal.update();
+  }
+  journal.flush();
+  
+  Serial.print("Attempts: ");
+  Serial.print(ATTEMPTS);
+  Serial.print(", matches: ");
+  Serial.println(matches);
+  Serial.print("Journal: ");
+  Serial.print(journal.getLogged());
+  Serial.print(" logged, ");
+  Serial.print(journal.getDropped());
+  Serial.print(" dropped, ");
+  Serial.print(journal.getBatchesWritten());
+  Serial.print(" batches, ");
+  Serial.print(store.length);
+  Serial.println(" bytes");
+  Serial.println();
+  
+  // Export what was written
+  store.rewind();
+  R503_JournalReader reader(&store);
+  uint32_t exported = reader.exportCsv(Serial);
+  Serial.print(exported);
+  Serial.println(" events exported");
+  
+  // A damaged batch is skipped and its events reported as missing
+  store.data[250] ^= 0x55;
+  store.rewind();
+  R503_JournalReader checker(&store);
+  R503_JournalEvent event;
+  uint32_t intact = 0;
+  while (checker.next(event)) {
+    intact++;
+  }
+  Serial.print("After corrupting one byte: ");
+  Serial.print(intact);
+  Serial.print(" events read, ");
+  Serial.print(checker.getCorruptBatches());
+  Serial.print(" corrupt batch, ");
+  Serial.print(checker.getMissingEvents());
+  Serial.println(" events missing");
+}
+
+void loop() {
+}
@@ -0,0 +1,194 @@
+/*
+ * R503 Fingerprint Module - Image Replay Benchmark
+ * 
+ * Replays a corpus of fingerprint images through downloadImage, image2Tz
+ * and searchLibrary at every security level, and prints latency,
+ * throughput, FAR and FRR for each. The same corpus gives the same
+ * numbers on every run, so security level and packet size can be tuned
+ * without live fingers.
+ * 
+ * With USE_EMULATOR uncommented a synthetic corpus is generated: enrolled
+ * users with genuine images of varying quality, and impostor images of
+ * similar but different fingers. On an ESP32 without the emulator, put
+ * images saved from uploadImage() on LittleFS as /r503img/<id>_<n>.img
+ * (x_<n>.img for fingers that are not enrolled).
+ */
+
+#include "R503_Fingerprint.h"
+#include "R503_ImageReplay.h"
+#include "R503_Emulator.h"
+
+// #define USE_EMULATOR
+
+#define RX_PIN 4
+#define TX_PIN 5
+#define R503_BAUD 57600
+
+#define USERS 10
+#define SAMPLES_PER_USER 5
+#define IMPOSTORS 20
+
+#ifdef USE_EMULATOR
+#define IMAGE_BUFFER_SIZE R503_EMU_IMAGE_SIZE
+R503_Emulator emulator;
+R503_Fingerprint finger(&emulator);
+#else
+#include <LittleFS.h>
+#define IMAGE_BUFFER_SIZE 36864
+HardwareSerial r503Serial(1);
+R503_Fingerprint finger(&r503Serial);
+#endif
+
+uint8_t imageBuffer[IMAGE_BUFFER_SIZE];
+
+#ifdef USE_EMULATOR
+void userFeatures(uint16_t user, uint8_t *features) {
+  for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+    features[i] = (uint8_t)(i * 31 + user * 97 + (i * user) % 13);
+  }
+}
+
+// Deterministic synthetic corpus: genuine samples lose 35-75% of their
+// features to noise, impostors are enrolled fingers with 75-90% changed
+class SyntheticCorpus : public R503_ImageCorpus {
+public:
+  uint16_t size() { return USERS * SAMPLES_PER_USER + IMPOSTORS; }
+  
+  bool load(uint16_t index, uint8_t *buffer, uint32_t maxLength,
+            uint32_t &length, int32_t &expectedID) {
+    if (maxLength < R503_EMU_IMAGE_SIZE) return false;
+    
+    uint8_t features[R503_EMU_TEMPLATE_SIZE];
+    uint16_t noisePercent;
+    seed = 0x9E3779B9 ^ (index * 2654435761UL);
+    
+    if (index < USERS * SAMPLES_PER_USER) {
+      expectedID = index / SAMPLES_PER_USER;
+      noisePercent = 35 + (index % SAMPLES_PER_USER) * 10;
+    } else {
+      expectedID = R503_REPLAY_IMPOSTOR;
+      noisePercent = 75 + random(16);
+    }
+    userFeatures(expectedID >= 0 ? expectedID : random(USERS), features);
+    
+    for (uint16_t i = 0; i < R503_EMU_IMAGE_SIZE; i++) {
+      buffer[i] = features[i / 4];
+    }
+    for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+      if (random(100) < noisePercent) {
+        buffer[i * 4] += 4 + random(200);
+      }
+    }
+    
+    length = R503_EMU_IMAGE_SIZE;
+    return true;
+  }
+  
+private:
+  uint32_t seed;
+  
+  uint32_t random(uint32_t limit) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed % limit;
+  }
+};
+
+SyntheticCorpus corpus;
+
+void setupEmulator() {
+  int8_t module = emulator.addModule();
+  emulator.setServiceTime(R503_IMG2TZ, 90);
+  emulator.setServiceTime(R503_SEARCH, 20);
+  emulator.setSearchCostPerPage(500);
+  
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  for (uint16_t user = 0; user < USERS; user++) {
+    userFeatures(user, features);
+    emulator.enrollDirect(module, user, features);
+  }
+}
+#else
+R503_FsImageCorpus corpus(LittleFS);
+#endif
+
+R503_ImageReplay replay(&finger, &corpus, imageBuffer, sizeof(imageBuffer));
+
+void printPercent(uint16_t count, uint16_t total) {
+  Serial.print(total > 0 ? 100.0 * count / total : 0.0, 1);
+  Serial.print("%");
+}
+
+void printReport(const R503_ReplayReport &report) {
+  uint16_t samples = report.genuine + report.impostor;
+  
+  Serial.print("level ");
+  Serial.print(report.securityLevel);
+  Serial.print("  FAR ");
+  printPercent(report.falseAccepts, samples);
+  Serial.print("  FRR ");
+  printPercent(report.falseRejects, report.genuine);
+  Serial.print("  avg ");
+  Serial.print(samples > 0 ? report.totalMs / samples : 0);
+  Serial.print(" ms  max ");
+  Serial.print(report.maxMs);
+  Serial.print(" ms  ");
+  Serial.print(report.totalMs > 0 ? 1000.0 * samples / report.totalMs : 0.0, 1);
+  Serial.print(" img/s  ");
+  Serial.print(report.totalMs > 0 ? report.imageBytes / report.totalMs : 0);
+  Serial.print(" KB/s");
+  if (report.errors > 0) {
+    Serial.print("  errors ");
+    Serial.print(report.errors);
+  }
+  Serial.println();
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+  
+  Serial.println("\n=== R503 Image Replay Benchmark ===");
+  
+#ifdef USE_EMULATOR
+  setupEmulator();
+#else
+  LittleFS.begin();
+  r503Serial.begin(R503_BAUD, SERIAL_8N1, RX_PIN, TX_PIN);
+#endif
+  
+  if (!finger.begin(R503_BAUD)) {
+    Serial.println("Failed to initialize R503!");
+    while (1) delay(1000);
+  }
+  
+  Serial.print("Corpus: ");
+  Serial.print(corpus.size());
+  Serial.println(" images");
+  
+  // Packet size changes the number of frames per image
+  static const uint8_t packetSizes[] = { R503_PACKAGE_SIZE_64, R503_PACKAGE_SIZE_256 };
+  for (uint8_t p = 0; p < 2; p++) {
+    if (!finger.setSystemParameter(R503_PARAM_PACKAGE_SIZE, packetSizes[p])) {
+      Serial.println("Failed to set packet size");
+      continue;
+    }
+    Serial.print("\nPacket size ");
+    Serial.print(finger.getDataPacketSize());
+    Serial.println(" bytes");
+    
+    R503_ReplayReport reports[R503_REPLAY_LEVELS];
+    if (!replay.sweep(reports)) {
+      Serial.println("Replay failed");
+      continue;
+    }
+    for (uint8_t i = 0; i < R503_REPLAY_LEVELS; i++) {
+      printReport(reports[i]);
+    }
+  }
+}
+
+void loop() {
+  delay(1000);
+}
@@ -0,0 +1,295 @@
+/*
+ * R503 Fingerprint Module - Packet Layer Benchmark
+ * 
+ * Times the host side of the protocol: frame assembly, parsing, checksums,
+ * reply decoding and the multi-packet transfer paths. Replies come from an
+ * in-memory replay stream, so no module (and no UART wait) is involved and
+ * the numbers are pure driver cost.
+ * 
+ * Each benchmark runs until BENCH_MIN_TIME_US has passed and prints ns/op
+ * and throughput. Compare runs before and after a driver change to catch
+ * regressions before they reach hardware.
+ * 
+ * The sketch also builds on a Linux host against extras/linux, where it
+ * runs setup() once and exits. From the library root:
+ *   g++ -std=c++11 -O2 -Iextras/linux -Isrc -x c++ \
+ *       examples/PacketBenchmark/PacketBenchmark.ino -x none \
+ *       extras/linux/Arduino.cpp src/R503_*.cpp -o packetbench
+ */
+
+#include "R503_Fingerprint.h"
+#include "R503_Frame.h"
+
+#define BENCH_MIN_TIME_US 200000UL
+#define BENCH_MAX_BATCH 1024
+#define TEMPLATE_BYTES 512
+#define SCRIPT_SIZE 1024
+
+// Stream that swallows everything written and replays a canned reply
+class ReplayStream : public Stream {
+public:
+  ReplayStream() : script(NULL), length(0), pos(0), written(0) {}
+  
+  void load(const uint8_t *script, uint16_t length) {
+    this->script = script;
+    this->length = length;
+    this->pos = 0;
+  }
+  void rewind() { pos = 0; }
+  uint32_t getWritten() { return written; }
+  
+  int available() { return length - pos; }
+  int read() { return pos < length ? script[pos++] : -1; }
+  int peek() { return pos < length ? script[pos] : -1; }
+  size_t write(uint8_t byte) { (void)byte; written++; return 1; }
+  using Print::write;
+  
+private:
+  const uint8_t *script;
+  uint16_t length;
+  uint16_t pos;
+  uint32_t written;
+};
+
+ReplayStream replay;
+R503_Fingerprint finger(&replay);
+
+uint8_t frameOut[R503_MAX_PACKET_DATA + R503_FRAME_OVERHEAD];
+uint8_t payload[R503_MAX_PACKET_DATA];
+uint8_t parseBuffer[R503_MAX_PACKET_DATA];
+uint8_t templateBuffer[TEMPLATE_BYTES];
+
+uint8_t ackScript[32];
+uint16_t ackScriptLen;
+uint8_t sysParaScript[64];
+uint16_t sysParaScriptLen;
+uint8_t prodInfoScript[64];
+uint16_t prodInfoScriptLen;
+uint8_t uploadScript[SCRIPT_SIZE];
+uint16_t uploadScriptLen;
+
+uint16_t benchLength;
+volatile uint16_t sink;
+uint32_t failures;
+
+// Reply frames -------------------------------------------------------------
+
+uint16_t buildAck(uint8_t *out, const uint8_t *fields, uint16_t fieldLen) {
+  uint8_t data[64];
+  data[0] = R503_OK;
+  memcpy(data + 1, fields, fieldLen);
+  return R503_Frame::build(out, R503_DEFAULT_ADDRESS, R503_ACK_PACKET, data, fieldLen + 1);
+}
+
+void buildScripts() {
+  for (uint16_t i = 0; i < R503_MAX_PACKET_DATA; i++) {
+    payload[i] = (uint8_t)(i * 37 + 11);
+  }
+  for (uint16_t i = 0; i < TEMPLATE_BYTES; i++) {
+    templateBuffer[i] = (uint8_t)(i * 13 + 5);
+  }
+  
+  ackScriptLen = buildAck(ackScript, NULL, 0);
+  
+  const uint8_t sysPara[16] = {
+    0x00, 0x00, 0x00, 0x09, 0x00, 0xC8, 0x00, 0x03,
+    0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x02, 0x00, 0x06
+  };
+  sysParaScriptLen = buildAck(sysParaScript, sysPara, sizeof(sysPara));
+  
+  uint8_t prodInfo[46];
+  memset(prodInfo, ' ', sizeof(prodInfo));
+  memcpy(prodInfo, "R503", 4);
+  prodInfo[28] = 0x01;
+  prodInfo[29] = 0x00;
+  prodInfo[38] = 0x00;
+  prodInfo[39] = 0xC0;
+  prodInfo[40] = 0x00;
+  prodInfo[41] = 0xC0;
+  prodInfo[42] = 0x02;
+  prodInfo[43] = 0x00;
+  prodInfo[44] = 0x00;
+  prodInfo[45] = 0xC8;
+  prodInfoScriptLen = buildAck(prodInfoScript, prodInfo, sizeof(prodInfo));
+  
+  // UPCHAR reply: ACK followed by the template in 128-byte packets
+  uploadScriptLen = buildAck(uploadScript, NULL, 0);
+  for (uint16_t offset = 0; offset < TEMPLATE_BYTES; offset += 128) {
+    uint8_t pid = (offset + 128 >= TEMPLATE_BYTES) ? R503_END_DATA_PACKET : R503_DATA_PACKET;
+    uploadScriptLen += R503_Frame::build(uploadScript + uploadScriptLen, R503_DEFAULT_ADDRESS,
+                                         pid, templateBuffer + offset, 128);
+  }
+}
+
+// Benchmarked operations ---------------------------------------------------
+
+void opChecksum() {
+  sink = R503_Frame::checksum(payload, benchLength);
+}
+
+// Plain byte loop the checksum kernel replaced, kept as a baseline
+void opChecksumBytewise() {
+  uint16_t sum = 0;
+  for (uint16_t i = 0; i < benchLength; i++) {
+    sum += payload[i];
+  }
+  sink = sum;
+}
+
+void opFrameBuild() {
+  sink = R503_Frame::build(frameOut, R503_DEFAULT_ADDRESS, R503_DATA_PACKET, payload, benchLength);
+}
+
+void opFrameParse() {
+  R503_FrameParser parser(parseBuffer, sizeof(parseBuffer));
+  uint16_t frameLen = benchLength + R503_FRAME_OVERHEAD;
+  for (uint16_t i = 0; i < frameLen; i++) {
+    if (parser.feed(frameOut[i]) == R503_FrameParser::FRAME_READY) {
+      sink = parser.getDataLength();
+      return;
+    }
+  }
+  failures++;
+}
+
+void opHandshake() {
+  replay.rewind();
+  if (!finger.handshake()) failures++;
+}
+
+void opReadSystemParameters() {
+  R503_SystemParams params;
+  replay.rewind();
+  if (!finger.readSystemParameters(params)) failures++;
+  sink = params.librarySize;
+}
+
+void opReadProductInfo() {
+  R503_ProductInfo info;
+  replay.rewind();
+  if (!finger.readProductInfo(info)) failures++;
+  sink = info.templateSize;
+}
+
+void opUploadTemplate() {
+  uint8_t buffer[TEMPLATE_BYTES];
+  uint16_t length;
+  replay.rewind();
+  if (!finger.uploadCharacteristics(R503_CHARBUFFER1, buffer, length) || length != TEMPLATE_BYTES) {
+    failures++;
+  }
+}
+
+void opDownloadTemplate() {
+  replay.rewind();
+  if (!finger.downloadCharacteristics(R503_CHARBUFFER1, templateBuffer, TEMPLATE_BYTES)) {
+    failures++;
+  }
+}
+
+// Harness ------------------------------------------------------------------
+
+void printPadded(const char *text, uint8_t width) {
+  Serial.print(text);
+  for (uint8_t i = strlen(text); i < width; i++) {
+    Serial.print(' ');
+  }
+}
+
+void runBenchmark(const char *name, void (*op)(), uint32_t bytesPerOp) {
+  failures = 0;
+  op();
+  
+  // Double the batch so micros() overhead stays small for fast ops
+  uint32_t iterations = 0;
+  uint32_t batch = 1;
+  uint32_t start = micros();
+  uint32_t elapsed = 0;
+  while (elapsed < BENCH_MIN_TIME_US) {
+    for (uint32_t i = 0; i < batch; i++) {
+      op();
+    }
+    iterations += batch;
+    elapsed = micros() - start;
+    if (batch < BENCH_MAX_BATCH) batch *= 2;
+  }
+  
+  double nsPerOp = (double)elapsed * 1000.0 / iterations;
+  
+  printPadded(name, 28);
+  Serial.print(nsPerOp, 1);
+  Serial.print(" ns/op");
+  if (bytesPerOp > 0) {
+    Serial.print("  ");
+    Serial.print(bytesPerOp * 1000.0 / nsPerOp, 2);
+    Serial.print(" MB/s  ");
+    Serial.print(nsPerOp / bytesPerOp, 3);
+    Serial.print(" ns/B");
+  }
+  if (failures > 0) {
+    Serial.print("  FAILED x");
+    Serial.print(failures);
+  }
+  Serial.println();
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+  
+  Serial.println("\n=== R503 Packet Layer Benchmark ===");
+  buildScripts();
+  
+  static const uint16_t sizes[] = { 32, 64, 128, 256 };
+  char name[32];
+  
+  for (uint8_t i = 0; i < 4; i++) {
+    benchLength = sizes[i];
+    snprintf(name, sizeof(name), "checksum_bytewise/%u", benchLength);
+    runBenchmark(name, opChecksumBytewise, benchLength);
+    snprintf(name, sizeof(name), "checksum/%u", benchLength);
+    runBenchmark(name, opChecksum, benchLength);
+  }
+  
+  for (uint8_t i = 0; i < 4; i++) {
+    benchLength = sizes[i];
+    snprintf(name, sizeof(name), "frame_build/%u", benchLength);
+    runBenchmark(name, opFrameBuild, benchLength + R503_FRAME_OVERHEAD);
+  }
+  
+  for (uint8_t i = 0; i < 4; i++) {
+    benchLength = sizes[i];
+    opFrameBuild();
+    snprintf(name, sizeof(name), "frame_parse/%u", benchLength);
+    runBenchmark(name, opFrameParse, benchLength + R503_FRAME_OVERHEAD);
+  }
+  
+  // Full command round trips through the driver
+  replay.load(ackScript, ackScriptLen);
+  runBenchmark("cmd_handshake", opHandshake, 0);
+  
+  replay.load(sysParaScript, sysParaScriptLen);
+  runBenchmark("decode_system_params", opReadSystemParameters, sysParaScriptLen);
+  
+  replay.load(prodInfoScript, prodInfoScriptLen);
+  runBenchmark("decode_product_info", opReadProductInfo, prodInfoScriptLen);
+  
+  replay.load(uploadScript, uploadScriptLen);
+  runBenchmark("upload_template/512", opUploadTemplate, TEMPLATE_BYTES);
+  
+  replay.load(ackScript, ackScriptLen);
+  runBenchmark("download_template/512", opDownloadTemplate, TEMPLATE_BYTES);
+  
+  Serial.println("Done.");
+}
+
+void loop() {
+  delay(1000);
+}
+
+#if defined(__linux__) && !defined(ARDUINO)
+int main() {
+  setup();
+  return 0;
+}
+#endif
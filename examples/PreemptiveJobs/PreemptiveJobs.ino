@@ -0,0 +1,262 @@
+/*
+ * R503 Fingerprint Module - Preemptible Background Work
+ *
+ * Runs maintenance jobs (a duplicate scan over the library and an image
+ * backup) at low priority and identifies at high priority whenever a
+ * finger touches the sensor. A touch preempts the background job: the
+ * driver sends CANCEL, drains the rest of the interrupted exchange and the
+ * identify runs next. The background job then resumes from its progress.
+ *
+ * The scan searches the library in ranges of SCAN_CHUNK pages, so the wait
+ * for the command in hand stays short however large the library is.
+ *
+ * The image backup cannot be preempted: the module streams the image
+ * without flow control and reads CANCEL only afterwards, so the driver lets
+ * uploads finish. A real 36864-byte image takes about 7 s at 57600 baud,
+ * and a touch during it waits that long. The backup therefore only starts
+ * after BACKUP_QUIET_TIME ms without a touch.
+ *
+ * The emulator paces its replies at R503_BAUD. On an x86-64 host, touch to
+ * result was at worst 600-720 ms over several runs with the emulator's 2 KB
+ * image (about 300 ms without a backup in the way). Built with
+ * -DR503_EMU_IMAGE_SIZE=36864 it was 7275 ms, from a touch during a backup.
+ *
+ * With USE_EMULATOR uncommented a touch is simulated every TOUCH_PERIOD ms
+ * against R503_Emulator. Otherwise wire the R503 as in the main example and
+ * connect its touch output (WAKEUP) to TOUCH_PIN.
+ */
+
+#include "R503_Fingerprint.h"
+#include "R503_JobQueue.h"
+#include "R503_Emulator.h"
+
+// #define USE_EMULATOR
+
+#define RX_PIN 4
+#define TX_PIN 5
+#define TOUCH_PIN 6
+#define R503_BAUD 57600
+
+#define PRIORITY_BACKGROUND 1
+#define PRIORITY_IDENTIFY 10
+
+#define SCAN_CHUNK 16
+#define TOUCH_PERIOD 1500
+#define BACKUP_QUIET_TIME 600
+#define RUN_TIME 30000
+
+#ifdef USE_EMULATOR
+#define IMAGE_BUFFER_SIZE R503_EMU_IMAGE_SIZE
+R503_Emulator emulator;
+R503_Fingerprint finger(&emulator);
+#else
+#define IMAGE_BUFFER_SIZE 36864
+HardwareSerial r503Serial(1);
+R503_Fingerprint finger(&r503Serial);
+#endif
+
+R503_JobQueue jobs(&finger);
+
+uint8_t imageBuffer[IMAGE_BUFFER_SIZE];
+uint16_t librarySize = 0;
+uint32_t lastTouch = 0;
+bool touchQueued = false;
+uint32_t identifyCount = 0;
+uint32_t identifyWorst = 0;
+uint32_t identifyTotal = 0;
+uint32_t scanPasses = 0;
+uint32_t backups = 0;
+
+void setupEmulator() {
+#ifdef USE_EMULATOR
+  int8_t module = emulator.addModule();
+  
+  emulator.setServiceTime(R503_GENIMG, 60);
+  emulator.setNoFingerTime(10);
+  emulator.setServiceTime(R503_IMG2TZ, 90);
+  emulator.setServiceTime(R503_LOADCHAR, 10);
+  emulator.setServiceTime(R503_SEARCH, 5);
+  emulator.setServiceTime(R503_UPIMAGE, 40);
+  emulator.setLineRate(R503_BAUD);
+  
+  // 2 ms per page stands in for a large library
+  emulator.setSearchCostPerPage(2000);
+  
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  for (uint16_t id = 0; id < R503_EMU_LIBRARY_SIZE; id++) {
+    for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+      features[i] = (uint8_t)(i * 31 + id * 97 + (i * id) % 13);
+    }
+    emulator.enrollDirect(module, id, features);
+    if (id == 17) {
+      emulator.placeFinger(module, features);
+    }
+  }
+#endif
+}
+
+bool touched() {
+#ifdef USE_EMULATOR
+  return millis() - lastTouch >= TOUCH_PERIOD;
+#else
+  return digitalRead(TOUCH_PIN) == LOW;
+#endif
+}
+
+// Identify: not preempted by anything, so it searches the whole library
+bool identifyJob(R503_Fingerprint *finger, R503_Job &job) {
+  (void)job;
+  uint16_t fingerID;
+  uint16_t score;
+  bool found = finger->verifyFingerprint(fingerID, score);
+  
+  uint32_t latency = millis() - lastTouch;
+  identifyCount++;
+  identifyTotal += latency;
+  if (latency > identifyWorst) identifyWorst = latency;
+  
+  Serial.print("identify: ");
+  if (found) {
+    Serial.print("ID ");
+    Serial.print(fingerID);
+  } else {
+    Serial.print("no match");
+  }
+  Serial.print(", ");
+  Serial.print(latency);
+  Serial.println(" ms after the touch");
+  
+  touchQueued = false;
+  return found;
+}
+
+// Duplicate scan: for every slot, search the slots above it in short
+// ranges. progress packs the slot (high half) and the next range start
+bool scanJob(R503_Fingerprint *finger, R503_Job &job) {
+  while (true) {
+    uint16_t slot = job.progress >> 16;
+    uint16_t from = job.progress & 0xFFFF;
+    if (slot + 1 >= librarySize) break;
+    if (from <= slot) from = slot + 1;
+    
+    // The template is reloaded on every run, since an identify may have
+    // used the buffer in between
+    if (!finger->loadModel(R503_CHARBUFFER1, slot)) return false;
+    
+    while (from < librarySize) {
+      uint16_t count = min((uint16_t)SCAN_CHUNK, (uint16_t)(librarySize - from));
+      uint16_t fingerID;
+      uint16_t score;
+      if (finger->searchLibrary(R503_CHARBUFFER1, from, count, fingerID, score)) {
+        Serial.print("scan: slot ");
+        Serial.print(slot);
+        Serial.print(" duplicates ");
+        Serial.println(fingerID);
+      } else if (finger->getLastConfirmationCode() != R503_NOTFOUND) {
+        return false;
+      }
+      from += count;
+      job.progress = ((uint32_t)slot << 16) | from;
+    }
+    job.progress = (uint32_t)(slot + 1) << 16;
+  }
+  
+  scanPasses++;
+  return true;
+}
+
+// Image backup: a long data phase that runs to the end once started, so it
+// waits for a quiet moment at the sensor
+bool backupJob(R503_Fingerprint *finger, R503_Job &job) {
+  (void)job;
+  if (millis() - lastTouch < BACKUP_QUIET_TIME) return true;
+  
+  uint32_t length;
+  if (!finger->uploadImage(imageBuffer, length)) return false;
+  backups++;
+  return true;
+}
+
+void onJobDone(const R503_Job &job, bool success) {
+  // Keep the maintenance work going in the background
+  if (job.priority == PRIORITY_BACKGROUND) {
+    if (!success) {
+      Serial.print("background job failed, error ");
+      Serial.println(finger.getLastError());
+    }
+    jobs.submit(PRIORITY_BACKGROUND, job.run);
+  }
+}
+
+void pollRequests(R503_JobQueue *queue) {
+  if (!touchQueued && touched()) {
+#ifdef USE_EMULATOR
+    // Simulated touches keep their schedule, so one that happened while
+    // the module was busy is timed from when it happened
+    lastTouch += TOUCH_PERIOD;
+#else
+    lastTouch = millis();
+#endif
+    touchQueued = queue->submit(PRIORITY_IDENTIFY, identifyJob) != 0;
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+  
+  setupEmulator();
+
+#ifdef USE_EMULATOR
+  finger.begin(R503_BAUD);
+#else
+  pinMode(TOUCH_PIN, INPUT_PULLUP);
+  r503Serial.begin(R503_BAUD, SERIAL_8N1, RX_PIN, TX_PIN);
+  if (!finger.begin(R503_BAUD)) {
+    Serial.println("R503 not found");
+    while (1) delay(1000);
+  }
+#endif
+  
+  R503_SystemParams params;
+  if (finger.getSystemParams(params)) {
+    librarySize = params.librarySize;
+  }
+  
+  jobs.setRequestSource(pollRequests);
+  jobs.setCompletionHandler(onJobDone);
+  jobs.submit(PRIORITY_BACKGROUND, scanJob);
+  jobs.submit(PRIORITY_BACKGROUND, backupJob);
+  lastTouch = millis();
+  
+  uint32_t start = millis();
+  while (millis() - start < RUN_TIME) {
+    pollRequests(&jobs);
+    jobs.poll();
+  }
+  
+  Serial.println();
+  Serial.print("Identifications: ");
+  Serial.println(identifyCount);
+  if (identifyCount > 0) {
+    Serial.print("Touch to result: avg ");
+    Serial.print(identifyTotal / identifyCount);
+    Serial.print(" ms, worst ");
+    Serial.print(identifyWorst);
+    Serial.println(" ms");
+  }
+  Serial.print("Preemptions: ");
+  Serial.print(jobs.getPreemptionCount());
+  Serial.print(", longest wait for the module: ");
+  Serial.print(jobs.getMaxPreemptWait());
+  Serial.println(" ms");
+  Serial.print("Scan passes: ");
+  Serial.print(scanPasses);
+  Serial.print(", image backups: ");
+  Serial.println(backups);
+}
+
+void loop() {
+  pollRequests(&jobs);
+  jobs.poll();
+}
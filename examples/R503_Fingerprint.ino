@@ -13,6 +13,7 @@
  * - System initialization and configuration
  * - Fingerprint enrollment (2-6 samples)
  * - Fingerprint verification (1:N search)
+ * - Claimed-ID verification (1:1 match)
  * - Template management (store, load, delete)
  * - LED control with various effects
  * - Notepad read/write operations
@@ -22,6 +23,7 @@
  */
 
 #include "R503_Fingerprint.h"
+#include "R503_LedScheduler.h"
 
 // Pin definitions for R503
 #define RX_PIN 4       // ESP32 RX -> R503 TXD (Pin 3)
@@ -31,6 +33,7 @@
 // Hardware Serial for R503 (UART2 on ESP32)
 HardwareSerial r503Serial(1);
 R503_Fingerprint finger(&r503Serial);
+R503_LedScheduler leds(&finger);
 
 // Configuration
 #define R503_BAUD 57600
@@ -84,7 +87,7 @@ void setup() {
   Serial.println("R503 initialized successfully!\n");
   
   // Set LED to blue to indicate ready
-  finger.ledOn(R503_LED_BLUE);
+  leds.on(R503_LED_BLUE);
   
   // Display system information
   displaySystemInfo();
@@ -98,11 +101,15 @@ void loop() {
   if (fingerDetected) {
     fingerDetected = false;
     Serial.println("\n[FINGER DETECTED via WAKEUP pin]");
-    finger.ledOn(R503_LED_PURPLE);
+    leds.on(R503_LED_PURPLE);
+    leds.flush();
     delay(100);
-    finger.ledOn(R503_LED_BLUE);
+    leds.on(R503_LED_BLUE);
   }
   
+  // Push any LED change queued by the handlers without waiting for the ACK
+  leds.flush();
+  
   if (Serial.available()) {
     char cmd = Serial.read();
     
@@ -158,6 +165,10 @@ void loop() {
       case 'F':
         getRandomNumber();
         break;
+      case 'v':
+      case 'V':
+        verifyClaimedID();
+        break;
       case 'w':
       case 'W':
         testWakeupDetection();
@@ -197,6 +208,7 @@ void displayMenu() {
   Serial.println("D. Change Security Level");
   Serial.println("E. Check Sensor Status");
   Serial.println("F. Get Random Number");
+  Serial.println("V. Verify Claimed ID (1:1)");
   Serial.println("W. Test Wakeup Detection");
   Serial.println("M. Show Menu");
   Serial.println("======================================\n");
@@ -205,9 +217,9 @@ void displayMenu() {
 void displaySystemInfo() {
   Serial.println("\n----- System Information -----");
   
-  // Read system parameters
+  // Descriptor fields come from the driver cache after the first call
   R503_SystemParams params;
-  if (finger.readSystemParameters(params)) {
+  if (finger.getSystemParams(params)) {
     Serial.print("Status Register: 0x");
     Serial.println(params.statusRegister, HEX);
     Serial.print("System ID: 0x");
@@ -219,11 +231,12 @@ void displaySystemInfo() {
     Serial.print("Device Address: 0x");
     Serial.println(params.deviceAddress, HEX);
     Serial.print("Data Packet Size: ");
-    Serial.println(params.dataPacketSize);
+    Serial.print(finger.getDataPacketSize());
+    Serial.println(" bytes");
     Serial.print("Baud Rate Multiplier: ");
     Serial.println(params.baudRate);
     Serial.print("Actual Baud Rate: ");
-    Serial.println(9600 * params.baudRate);
+    Serial.println(finger.getBaudRate());
   } else {
     Serial.println("Failed to read system parameters");
   }
@@ -237,21 +250,21 @@ void displaySystemInfo() {
   
   // Get firmware version
   char fwVer[33];
-  if (finger.getFirmwareVersion(fwVer)) {
+  if (finger.getFirmwareVersionCached(fwVer)) {
     Serial.print("Firmware Version: ");
     Serial.println(fwVer);
   }
   
   // Get algorithm version
   char algVer[33];
-  if (finger.getAlgorithmVersion(algVer)) {
+  if (finger.getAlgorithmVersionCached(algVer)) {
     Serial.print("Algorithm Version: ");
     Serial.println(algVer);
   }
   
   // Get product information
   R503_ProductInfo info;
-  if (finger.readProductInfo(info)) {
+  if (finger.getProductInfo(info)) {
     Serial.print("Module Type: ");
     Serial.println(info.moduleType);
     Serial.print("Batch Number: ");
@@ -304,26 +317,29 @@ void enrollNewFingerprint() {
   Serial.print(samples);
   Serial.println(" samples...");
   
-  finger.ledBreathe(R503_LED_BLUE, 0x80, 0);
+  leds.breathe(R503_LED_BLUE, 0x80, 0);
+  leds.flush();
   
   if (finger.enrollFingerprint(id, samples)) {
-    finger.ledFlash(R503_LED_BLUE, 0xFF, 3);
+    leds.flash(R503_LED_BLUE, 0xFF, 3);
     Serial.println("\nEnrollment successful!");
   } else {
-    finger.ledFlash(R503_LED_RED, 0xFF, 3);
+    leds.flash(R503_LED_RED, 0xFF, 3);
     Serial.print("Enrollment failed! Error code: 0x");
     Serial.println(finger.getLastConfirmationCode(), HEX);
   }
+  leds.flush();
   
   delay(1000);
-  finger.ledOn(R503_LED_BLUE);
+  leds.on(R503_LED_BLUE);
 }
 
 void verifyFingerprint() {
   Serial.println("\n----- Verify Fingerprint -----");
   Serial.println("Place finger on sensor...");
   
-  finger.ledOn(R503_LED_PURPLE);
+  leds.on(R503_LED_PURPLE);
+  leds.flush();
   
   uint16_t fingerID;
   uint16_t confidence;
@@ -335,7 +351,7 @@ void verifyFingerprint() {
     Serial.print(" with confidence ");
     Serial.println(confidence);
     
-    finger.ledFlash(R503_LED_BLUE, 0xFF, 3);
+    leds.flash(R503_LED_BLUE, 0xFF, 3);
   } else {
     uint8_t errorCode = finger.getLastConfirmationCode();
     
@@ -348,11 +364,51 @@ void verifyFingerprint() {
       Serial.println(errorCode, HEX);
     }
     
-    finger.ledFlash(R503_LED_RED, 0xFF, 3);
+    leds.flash(R503_LED_RED, 0xFF, 3);
+  }
+  leds.flush();
+  
+  delay(1000);
+  leds.on(R503_LED_BLUE);
+}
+
+void verifyClaimedID() {
+  Serial.println("\n----- Verify Claimed ID (1:1) -----");
+  
+  Serial.print("Enter claimed ID# (0-199): ");
+  while (!Serial.available()) delay(10);
+  int id = Serial.parseInt();
+  while (Serial.available()) Serial.read();
+  
+  if (id < 0 || id > 199) {
+    Serial.println("Invalid ID!");
+    return;
+  }
+  
+  Serial.println("Place finger on sensor...");
+  leds.on(R503_LED_PURPLE);
+  leds.flush();
+  
+  uint16_t score;
+  uint32_t start = millis();
+  
+  if (finger.verifyClaimed(id, score)) {
+    Serial.print("\nIdentity confirmed! Score ");
+    Serial.print(score);
+    leds.flash(R503_LED_BLUE, 0xFF, 3);
+  } else {
+    Serial.print("\nVerification failed! Error code: 0x");
+    Serial.print(finger.getLastConfirmationCode(), HEX);
+    leds.flash(R503_LED_RED, 0xFF, 3);
   }
+  leds.flush();
+  
+  Serial.print(" (");
+  Serial.print(millis() - start);
+  Serial.println(" ms)");
   
   delay(1000);
-  finger.ledOn(R503_LED_BLUE);
+  leds.on(R503_LED_BLUE);
 }
 
 void deleteFingerprint() {
@@ -374,11 +430,11 @@ void deleteFingerprint() {
   
   if (finger.deleteModel(id, 1)) {
     Serial.println("Delete successful!");
-    finger.ledFlash(R503_LED_BLUE, 0xFF, 2);
+    leds.flash(R503_LED_BLUE, 0xFF, 2);
   } else {
     Serial.print("Delete failed! Error code: 0x");
     Serial.println(finger.getLastConfirmationCode(), HEX);
-    finger.ledFlash(R503_LED_RED, 0xFF, 2);
+    leds.flash(R503_LED_RED, 0xFF, 2);
   }
 }
 
@@ -404,11 +460,11 @@ void emptyDatabase() {
     
     if (finger.emptyDatabase()) {
       Serial.println("Database cleared successfully!");
-      finger.ledFlash(R503_LED_BLUE, 0xFF, 3);
+      leds.flash(R503_LED_BLUE, 0xFF, 3);
     } else {
       Serial.print("Failed to clear database! Error code: 0x");
       Serial.println(finger.getLastConfirmationCode(), HEX);
-      finger.ledFlash(R503_LED_RED, 0xFF, 3);
+      leds.flash(R503_LED_RED, 0xFF, 3);
     }
   } else {
     Serial.println("Operation cancelled.");
@@ -449,7 +505,8 @@ void matchTwoFingers() {
   
   // First finger
   Serial.println("Place first finger...");
-  finger.ledOn(R503_LED_PURPLE);
+  leds.on(R503_LED_PURPLE);
+  leds.flush();
   
   while (!finger.getImage()) {
     delay(50);
@@ -461,12 +518,14 @@ void matchTwoFingers() {
   }
   
   Serial.println("Remove finger");
-  finger.ledOff();
+  leds.off();
+  leds.flush();
   delay(2000);
   
   // Second finger
   Serial.println("Place second finger...");
-  finger.ledOn(R503_LED_PURPLE);
+  leds.on(R503_LED_PURPLE);
+  leds.flush();
   
   while (!finger.getImage()) {
     delay(50);
@@ -482,41 +541,47 @@ void matchTwoFingers() {
   if (finger.matchTemplates(score)) {
     Serial.print("Fingers match! Score: ");
     Serial.println(score);
-    finger.ledFlash(R503_LED_BLUE, 0xFF, 3);
+    leds.flash(R503_LED_BLUE, 0xFF, 3);
   } else {
     Serial.println("Fingers do not match!");
-    finger.ledFlash(R503_LED_RED, 0xFF, 3);
+    leds.flash(R503_LED_RED, 0xFF, 3);
   }
+  leds.flush();
   
   delay(1000);
-  finger.ledOn(R503_LED_BLUE);
+  leds.on(R503_LED_BLUE);
 }
 
 void testLEDEffects() {
   Serial.println("\n----- Testing LED Effects -----");
   
   Serial.println("Red breathing...");
-  finger.ledBreathe(R503_LED_RED, 0x80, 3);
+  leds.breathe(R503_LED_RED, 0x80, 3);
+  leds.flush();
   delay(3000);
   
   Serial.println("Blue flashing...");
-  finger.ledFlash(R503_LED_BLUE, 0xFF, 5);
+  leds.flash(R503_LED_BLUE, 0xFF, 5);
+  leds.flush();
   delay(3000);
   
   Serial.println("Purple on...");
-  finger.ledOn(R503_LED_PURPLE);
+  leds.on(R503_LED_PURPLE);
+  leds.flush();
   delay(2000);
   
   Serial.println("Gradual on...");
-  finger.setLED(R503_LED_GRADUAL_ON, 0x80, R503_LED_BLUE, 0);
+  leds.set(R503_LED_GRADUAL_ON, 0x80, R503_LED_BLUE, 0);
+  leds.flush();
   delay(3000);
   
   Serial.println("Gradual off...");
-  finger.setLED(R503_LED_GRADUAL_OFF, 0x80, R503_LED_BLUE, 0);
+  leds.set(R503_LED_GRADUAL_OFF, 0x80, R503_LED_BLUE, 0);
+  leds.flush();
   delay(3000);
   
   Serial.println("LED test complete!");
-  finger.ledOn(R503_LED_BLUE);
+  leds.on(R503_LED_BLUE);
 }
 
 void testNotepad() {
@@ -668,10 +733,10 @@ void checkSensorStatus() {
   
   if (finger.checkSensor()) {
     Serial.println("Sensor is OK!");
-    finger.ledFlash(R503_LED_BLUE, 0xFF, 2);
+    leds.flash(R503_LED_BLUE, 0xFF, 2);
   } else {
     Serial.println("Sensor is ABNORMAL!");
-    finger.ledFlash(R503_LED_RED, 0xFF, 2);
+    leds.flash(R503_LED_RED, 0xFF, 2);
   }
 }
 
@@ -709,7 +774,8 @@ void testWakeupDetection() {
       Serial.print(detectionCount);
       Serial.println(" - Finger detected!");
       
-      finger.ledFlash(R503_LED_PURPLE, 0xFF, 2);
+      leds.flash(R503_LED_PURPLE, 0xFF, 2);
+      leds.flush();
       
       // Verify with actual sensor
       if (finger.getImage()) {
@@ -725,5 +791,5 @@ void testWakeupDetection() {
   Serial.println(detectionCount);
   Serial.println("WAKEUP pin is working correctly!");
   
-  finger.ledOn(R503_LED_BLUE);
+  leds.on(R503_LED_BLUE);
 }
\ No newline at end of file
@@ -0,0 +1,221 @@
+/*
+ * R503 Fingerprint Module - RAM Budget
+ *
+ * Reports what the driver costs in RAM with the build profile it was
+ * compiled with: the static size of an R503_Fingerprint object and the
+ * peak stack of each operation, measured by painting the stack before the
+ * call and looking for the deepest overwritten byte afterwards.
+ *
+ * The profile is chosen with build flags so that the library sees it too,
+ * e.g. build_flags = -DR503_MINIMAL in platformio.ini, or
+ * arduino-cli compile --build-property "build.extra_flags=-DR503_MINIMAL".
+ * Single groups are dropped with -DR503_ENABLE_IMAGE=0, _NOTEPAD, _LED and
+ * _INFO, the enrollment prompts with -DR503_ENROLL_PROMPTS=0.
+ *
+ * Stack figures depend on the compiler, the target and the Serial core;
+ * run the sketch on the board the driver will ship on. An x86-64 host
+ * build (g++ -O2, linked with -Wl,-z,now so lazy symbol binding does not
+ * show up as stack) reports:
+ *
+ *   profile   object   peak stack
+ *   default   760 B    912 B (2320 B in enroll, printing the prompts)
+ *   minimal   640 B    672 B
+ *
+ * With USE_EMULATOR uncommented the sketch runs against R503_Emulator. The
+ * emulator answers each command inside write(), so its stack is part of
+ * the figures; against a real module they are lower. A figure printed as
+ * ">= STACK_PROBE_SIZE" overran the painted area; raise the probe size.
+ */
+
+#include "R503_Fingerprint.h"
+#include "R503_Emulator.h"
+
+// #define USE_EMULATOR
+
+#define RX_PIN 4
+#define TX_PIN 5
+#define R503_BAUD 57600
+
+#define CLAIMED_ID 3
+#define ENROLL_ID 20
+
+#define STACK_PROBE_SIZE 3072
+#define STACK_PATTERN 0xA5
+
+#ifdef USE_EMULATOR
+R503_Emulator emulator;
+R503_Fingerprint finger(&emulator);
+#else
+HardwareSerial r503Serial(1);
+R503_Fingerprint finger(&r503Serial);
+#endif
+
+// Caller-supplied transfer buffer, sized for the template transfer commands
+uint8_t templateBuffer[R503_TEMPLATE_BUFFER_SIZE];
+
+uintptr_t probeBottom;
+uint16_t peakStack = 0;
+
+// Fills the stack below the caller's frame with a pattern
+void __attribute__((noinline)) paintStack() {
+  volatile uint8_t area[STACK_PROBE_SIZE];
+  for (uint16_t i = 0; i < STACK_PROBE_SIZE; i++) {
+    area[i] = STACK_PATTERN;
+  }
+  probeBottom = (uintptr_t)area;
+}
+
+// Bytes of the painted area written since paintStack()
+uint16_t __attribute__((noinline)) stackUsed() {
+  volatile uint8_t *area = (volatile uint8_t *)probeBottom;
+  uint16_t untouched = 0;
+  while (untouched < STACK_PROBE_SIZE && area[untouched] == STACK_PATTERN) {
+    untouched++;
+  }
+  return STACK_PROBE_SIZE - untouched;
+}
+
+void measure(const char *name, bool (*operation)()) {
+  paintStack();
+  bool ok = operation();
+  uint16_t used = stackUsed();
+  peakStack = max(peakStack, used);
+  
+  Serial.print(name);
+  Serial.print(ok ? "  ok    " : "  FAIL  ");
+  // The whole painted area was overwritten, so the real figure is larger
+  if (used >= STACK_PROBE_SIZE) Serial.print(">= ");
+  Serial.print(used);
+  Serial.println(" B stack");
+}
+
+bool opBegin() {
+  return finger.begin(R503_BAUD);
+}
+
+bool opIdentify() {
+  uint16_t fingerID;
+  uint16_t score;
+  return finger.verifyFingerprint(fingerID, score);
+}
+
+bool opVerify() {
+  uint16_t score;
+  return finger.verifyClaimed(CLAIMED_ID, score);
+}
+
+bool opEnroll() {
+  return finger.enrollFingerprint(ENROLL_ID, 2);
+}
+
+bool opUpload() {
+  uint16_t length;
+  return finger.loadModel(R503_CHARBUFFER1, CLAIMED_ID) &&
+         finger.uploadCharacteristics(R503_CHARBUFFER1, templateBuffer, length);
+}
+
+bool opDownload() {
+  return finger.downloadCharacteristics(R503_CHARBUFFER2, templateBuffer, R503_EMU_TEMPLATE_SIZE);
+}
+
+#if R503_ENABLE_LED
+bool opLed() {
+  return finger.ledBreathe(R503_LED_BLUE);
+}
+#endif
+
+#if R503_ENABLE_INFO
+bool opInfo() {
+  R503_ProductInfo info;
+  char version[33];
+  return finger.getProductInfo(info) && finger.getFirmwareVersionCached(version);
+}
+#endif
+
+#if R503_ENABLE_NOTEPAD
+bool opNotepad() {
+  uint8_t page[R503_NOTEPAD_PAGE_SIZE];
+  memset(page, 0x5A, sizeof(page));
+  return finger.writeNotepad(0, page) && finger.readNotepad(0, page);
+}
+#endif
+
+void setupEmulator() {
+#ifdef USE_EMULATOR
+  int8_t module = emulator.addModule();
+  
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  for (uint16_t id = 0; id < 10; id++) {
+    for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+      features[i] = (uint8_t)(i * 31 + id * 97 + (i * id) % 13);
+    }
+    emulator.enrollDirect(module, id, features);
+    if (id == CLAIMED_ID) {
+      emulator.placeFinger(module, features);
+    }
+  }
+#endif
+}
+
+void printFlag(const char *name, bool enabled) {
+  Serial.print(name);
+  Serial.println(enabled ? "on" : "off");
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+  
+  Serial.println("\n=== R503 RAM Budget ===");
+  printFlag("image commands:    ", R503_ENABLE_IMAGE);
+  printFlag("notepad commands:  ", R503_ENABLE_NOTEPAD);
+  printFlag("LED commands:      ", R503_ENABLE_LED);
+  printFlag("info commands:     ", R503_ENABLE_INFO);
+  printFlag("enroll prompts:    ", R503_ENROLL_PROMPTS);
+  Serial.print("transmit buffer:   ");
+  Serial.print(R503_TX_BUFFER);
+  Serial.println(" B");
+  Serial.println();
+  
+  Serial.print("R503_Fingerprint object: ");
+  Serial.print(sizeof(R503_Fingerprint));
+  Serial.print(" B (device info cache ");
+  Serial.print(sizeof(R503_DeviceInfo));
+  Serial.print(" B, timeout model ");
+  Serial.print(sizeof(R503_TimeoutModel));
+  Serial.println(" B)");
+  Serial.print("Template buffer (caller): ");
+  Serial.print(sizeof(templateBuffer));
+  Serial.println(" B");
+  Serial.println();
+  
+  setupEmulator();
+#ifndef USE_EMULATOR
+  r503Serial.begin(R503_BAUD, SERIAL_8N1, RX_PIN, TX_PIN);
+#endif
+  
+  measure("begin          ", opBegin);
+  measure("identify (1:N) ", opIdentify);
+  measure("verify (1:1)   ", opVerify);
+  measure("enroll         ", opEnroll);
+  measure("upload template", opUpload);
+  measure("download tmpl  ", opDownload);
+#if R503_ENABLE_LED
+  measure("LED            ", opLed);
+#endif
+#if R503_ENABLE_INFO
+  measure("product info   ", opInfo);
+#endif
+#if R503_ENABLE_NOTEPAD
+  measure("notepad        ", opNotepad);
+#endif
+  
+  Serial.println();
+  Serial.print("Peak stack: ");
+  if (peakStack >= STACK_PROBE_SIZE) Serial.print(">= ");
+  Serial.print(peakStack);
+  Serial.println(" B");
+}
+
+void loop() {
+}
@@ -0,0 +1,118 @@
+/*
+ * R503 Fingerprint Module - 1:1 vs. 1:N Verification Benchmark
+ * 
+ * Compares verifyClaimed() (load the claimed template, capture, match)
+ * against verifyFingerprint() (capture, search the whole library) and
+ * prints the average latency of each path.
+ * 
+ * With USE_EMULATOR uncommented the sketch runs against R503_Emulator with
+ * service times roughly like a real module, so no sensor is needed.
+ * Otherwise wire the R503 as in the main example, enroll the finger at
+ * CLAIMED_ID and keep it on the sensor while the benchmark runs.
+ */
+
+#include "R503_Fingerprint.h"
+#include "R503_Emulator.h"
+
+// #define USE_EMULATOR
+
+#define RX_PIN 4
+#define TX_PIN 5
+#define R503_BAUD 57600
+
+#define CLAIMED_ID 5
+#define ITERATIONS 20
+
+#ifdef USE_EMULATOR
+R503_Emulator emulator;
+R503_Fingerprint finger(&emulator);
+#else
+HardwareSerial r503Serial(1);
+R503_Fingerprint finger(&r503Serial);
+#endif
+
+void setupEmulator() {
+#ifdef USE_EMULATOR
+  int8_t module = emulator.addModule();
+  
+  emulator.setServiceTime(R503_GENIMG, 60);
+  emulator.setNoFingerTime(10);
+  emulator.setServiceTime(R503_IMG2TZ, 90);
+  emulator.setServiceTime(R503_LOADCHAR, 10);
+  emulator.setServiceTime(R503_MATCH, 15);
+  emulator.setServiceTime(R503_SEARCH, 20);
+  emulator.setSearchCostPerPage(2000);
+  
+  // Fill the library so the search has to walk every page
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  for (uint16_t id = 0; id < R503_EMU_LIBRARY_SIZE; id++) {
+    for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+      features[i] = (uint8_t)(i * 31 + id * 97 + (i * id) % 13);
+    }
+    emulator.enrollDirect(module, id, features);
+    if (id == CLAIMED_ID) {
+      emulator.placeFinger(module, features);
+    }
+  }
+#endif
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+  
+  Serial.println("\n=== R503 Verification Benchmark ===");
+  
+  setupEmulator();
+#ifndef USE_EMULATOR
+  r503Serial.begin(R503_BAUD, SERIAL_8N1, RX_PIN, TX_PIN);
+#endif
+  
+  if (!finger.begin(R503_BAUD)) {
+    Serial.println("Failed to initialize R503!");
+    while (1) delay(1000);
+  }
+  
+  R503_SystemParams params;
+  if (finger.readSystemParameters(params)) {
+    Serial.print("Library size: ");
+    Serial.println(params.librarySize);
+  }
+  
+  uint32_t claimedTotal = 0;
+  uint32_t searchTotal = 0;
+  uint16_t claimedOk = 0;
+  uint16_t searchOk = 0;
+  
+  for (uint16_t i = 0; i < ITERATIONS; i++) {
+    uint16_t score;
+    uint32_t start = millis();
+    if (finger.verifyClaimed(CLAIMED_ID, score)) claimedOk++;
+    claimedTotal += millis() - start;
+    
+    uint16_t fingerID;
+    start = millis();
+    if (finger.verifyFingerprint(fingerID, score) && fingerID == CLAIMED_ID) searchOk++;
+    searchTotal += millis() - start;
+  }
+  
+  Serial.print("1:1 verifyClaimed     avg ");
+  Serial.print(claimedTotal / ITERATIONS);
+  Serial.print(" ms, ");
+  Serial.print(claimedOk);
+  Serial.print("/");
+  Serial.print(ITERATIONS);
+  Serial.println(" matched");
+  
+  Serial.print("1:N verifyFingerprint avg ");
+  Serial.print(searchTotal / ITERATIONS);
+  Serial.print(" ms, ");
+  Serial.print(searchOk);
+  Serial.print("/");
+  Serial.print(ITERATIONS);
+  Serial.println(" matched");
+}
+
+void loop() {
+  delay(1000);
+}
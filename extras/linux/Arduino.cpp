@@ -0,0 +1,119 @@
+// Arduino.cpp - Linux implementation of the minimal Arduino core
+#include "Arduino.h"
+#include <time.h>
+#include <sched.h>
+
+ConsoleSerial Serial;
+
+static uint64_t monotonicMicros() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+static const uint64_t startMicros = monotonicMicros();
+
+unsigned long millis() {
+  return (monotonicMicros() - startMicros) / 1000;
+}
+
+unsigned long micros() {
+  return monotonicMicros() - startMicros;
+}
+
+void delay(unsigned long ms) {
+  struct timespec wait;
+  wait.tv_sec = ms / 1000;
+  wait.tv_nsec = (ms % 1000) * 1000000L;
+  while (nanosleep(&wait, &wait) != 0) {
+  }
+}
+
+void yield() {
+  sched_yield();
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t count = 0;
+  while (size--) {
+    count += write(*buffer++);
+  }
+  return count;
+}
+
+size_t Print::printNumber(unsigned long value, int base, bool negative) {
+  char text[24];
+  snprintf(text, sizeof(text), base == HEX ? "%lX" : "%lu", value);
+  
+  size_t count = negative ? write('-') : 0;
+  return count + write((const uint8_t *)text, strlen(text));
+}
+
+size_t Print::print(const char *text) {
+  return write((const uint8_t *)text, strlen(text));
+}
+
+size_t Print::print(char c) {
+  return write((uint8_t)c);
+}
+
+size_t Print::print(int value, int base) {
+  return print((long)value, base);
+}
+
+size_t Print::print(unsigned int value, int base) {
+  return printNumber(value, base, false);
+}
+
+size_t Print::print(long value, int base) {
+  if (value < 0 && base == DEC) {
+    return printNumber(-(unsigned long)value, base, true);
+  }
+  return printNumber((unsigned long)value, base, false);
+}
+
+size_t Print::print(unsigned long value, int base) {
+  return printNumber(value, base, false);
+}
+
+size_t Print::print(double value, int digits) {
+  char text[48];
+  snprintf(text, sizeof(text), "%.*f", digits, value);
+  return print(text);
+}
+
+size_t Print::println() {
+  return write('\n');
+}
+
+size_t Print::println(const char *text) {
+  return print(text) + println();
+}
+
+size_t Print::println(char c) {
+  return print(c) + println();
+}
+
+size_t Print::println(int value, int base) {
+  return print(value, base) + println();
+}
+
+size_t Print::println(unsigned int value, int base) {
+  return print(value, base) + println();
+}
+
+size_t Print::println(long value, int base) {
+  return print(value, base) + println();
+}
+
+size_t Print::println(unsigned long value, int base) {
+  return print(value, base) + println();
+}
+
+size_t Print::println(double value, int digits) {
+  return print(value, digits) + println();
+}
+
+size_t ConsoleSerial::write(uint8_t byte) {
+  return fputc(byte, stdout) == EOF ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+// Arduino.h - minimal Arduino core for building the library on Linux hosts.
+// Provides only what the library uses: timing, Print/Stream and a console
+// Serial. Put this directory first on the include path.
+#ifndef R503_LINUX_ARDUINO_H
+#define R503_LINUX_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define DEC 10
+#define HEX 16
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+class Print {
+public:
+  virtual ~Print() {}
+  
+  virtual size_t write(uint8_t byte) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  virtual void flush() {}
+  
+  size_t print(const char *text);
+  size_t print(char c);
+  size_t print(int value, int base = DEC);
+  size_t print(unsigned int value, int base = DEC);
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(double value, int digits = 2);
+  
+  size_t println();
+  size_t println(const char *text);
+  size_t println(char c);
+  size_t println(int value, int base = DEC);
+  size_t println(unsigned int value, int base = DEC);
+  size_t println(long value, int base = DEC);
+  size_t println(unsigned long value, int base = DEC);
+  size_t println(double value, int digits = 2);
+  
+private:
+  size_t printNumber(unsigned long value, int base, bool negative);
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+// Serial port with a configurable baud rate (see R503_LinuxSerial)
+class HardwareSerial : public Stream {
+public:
+  virtual void begin(unsigned long baud) = 0;
+};
+
+// Serial console mapped to stdin/stdout
+class ConsoleSerial : public Stream {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  int available() { return 0; }
+  int read() { return -1; }
+  int peek() { return -1; }
+  size_t write(uint8_t byte);
+  using Print::write;
+};
+
+extern ConsoleSerial Serial;
+
+#endif // R503_LINUX_ARDUINO_H
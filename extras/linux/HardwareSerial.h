@@ -0,0 +1,2 @@
+// HardwareSerial.h - HardwareSerial is declared in Arduino.h on Linux hosts
+#include "Arduino.h"
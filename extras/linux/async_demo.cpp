@@ -0,0 +1,114 @@
+/*
+ * async_demo - concurrent sensor workflows with R503_AsyncSensor
+ *
+ * Runs identify and enroll on several sensors at once from one thread.
+ * Without arguments the sensors are emulated modules sharing one bus;
+ * with a device path the first sensor is the real module on that port.
+ *
+ * Build from the library root:
+ *   g++ -std=c++20 -O2 -DR503_EMU_MAX_MODULES=3 -Iextras/linux -Isrc \
+ *       extras/linux/async_demo.cpp extras/linux/Arduino.cpp src/R503_*.cpp \
+ *       -o async_demo
+ *
+ * Run:
+ *   async_demo [/dev/ttyUSB0]
+ */
+
+#include <Arduino.h>
+#include "R503_Async.h"
+#include "R503_Emulator.h"
+#include "R503_LinuxSerial.h"
+
+#define SENSORS 3
+
+#if R503_EMU_MAX_MODULES < SENSORS
+#error "build with -DR503_EMU_MAX_MODULES=3 so every sensor gets an emulated module"
+#endif
+
+static R503_Task<uint8_t> identifyAt(R503_AsyncSensor &sensor, const char *name,
+                                     uint32_t timeout) {
+  R503_CancelToken token;
+  token.cancelAfter(timeout);
+
+  uint32_t started = millis();
+  R503_SearchResult found = co_await sensor.identify(64, &token);
+  uint32_t elapsed = millis() - started;
+
+  if (found.confirmCode == R503_OK) {
+    printf("%-8s identify  id=%u score=%u  %u ms\n", name, found.pageID, found.score, (unsigned)elapsed);
+  } else if (found.confirmCode == R503_ASYNC_CANCELLED) {
+    printf("%-8s identify  timed out  %u ms\n", name, (unsigned)elapsed);
+  } else {
+    printf("%-8s identify  code=0x%02X  %u ms\n", name, found.confirmCode, (unsigned)elapsed);
+  }
+  co_return found.confirmCode;
+}
+
+static R503_Task<uint8_t> enrollAt(R503_AsyncSensor &sensor, const char *name, uint16_t pageID) {
+  uint32_t started = millis();
+  uint8_t code = co_await sensor.enroll(pageID);
+  printf("%-8s enroll    id=%u code=0x%02X  %u ms\n", name, pageID, code, (unsigned)(millis() - started));
+
+  // Identify again right away, now that the finger is on file
+  co_return co_await identifyAt(sensor, name, 2000);
+}
+
+int main(int argc, char **argv) {
+  R503_Emulator emulator;
+  R503_Bus emulatedBus(&emulator);
+  R503_TimeoutModel model;
+  emulatedBus.setTimeoutModel(&model);
+
+  R503_Scheduler scheduler;
+  R503_AsyncSensor *sensors[SENSORS];
+  const char *names[SENSORS] = { "sensor0", "sensor1", "sensor2" };
+
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  for (uint8_t s = 0; s < SENSORS; s++) {
+    int8_t module = emulator.addModule(R503_DEFAULT_ADDRESS + s);
+    emulator.setServiceTime(R503_GENIMG, 60);
+    emulator.setServiceTime(R503_IMG2TZ, 90);
+    emulator.setSearchCostPerPage(500);
+
+    for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+      features[i] = (uint8_t)(i * 31 + s * 97 + (i * s) % 13);
+    }
+    if (s != 2) emulator.placeFinger(module, features);
+    if (s == 0) emulator.enrollDirect(module, 5, features);
+
+    sensors[s] = new R503_AsyncSensor(scheduler, emulatedBus, emulatedBus.addModule(R503_DEFAULT_ADDRESS + s));
+  }
+
+  // A real module replaces the first emulated one
+  R503_LinuxSerial *port = NULL;
+  R503_Bus *portBus = NULL;
+  if (argc > 1) {
+    port = new R503_LinuxSerial(argv[1]);
+    if (!port->open(57600)) {
+      fprintf(stderr, "async_demo: cannot open %s\n", argv[1]);
+      return 1;
+    }
+    portBus = new R503_Bus(port);
+    portBus->setTimeoutModel(&model);
+    scheduler.addBus(portBus, port->getFd());
+    sensors[0] = new R503_AsyncSensor(scheduler, *portBus, portBus->addModule(R503_DEFAULT_ADDRESS));
+    names[0] = argv[1];
+  }
+
+  // sensor0 identifies a known finger, sensor1 enrolls a new one and
+  // sensor2 has no finger and times out; all three overlap
+  uint32_t started = millis();
+  R503_Task<uint8_t> tasks[SENSORS];
+  tasks[0] = identifyAt(*sensors[0], names[0], 5000);
+  tasks[1] = enrollAt(*sensors[1], names[1], 7);
+  tasks[2] = identifyAt(*sensors[2], names[2], 500);
+
+  for (uint8_t s = 0; s < SENSORS; s++) {
+    scheduler.start(tasks[s]);
+  }
+  scheduler.run();
+
+  printf("all done in %u ms, %u late replies dropped\n",
+         (unsigned)(millis() - started), (unsigned)scheduler.getDroppedResults());
+  return 0;
+}
@@ -0,0 +1,417 @@
+/*
+ * r503arc - batch archiver for R503 module templates
+ *
+ * Packs whole galleries on every core. A reader thread streams the input,
+ * worker threads pack or unpack, and a writer thread streams the output;
+ * the queues between them are bounded, so memory use does not grow with
+ * the size of the archive.
+ *
+ * Build from the library root:
+ *   g++ -std=c++11 -O2 -pthread -Iextras/linux -Isrc extras/linux/r503arc.cpp \
+ *       extras/linux/Arduino.cpp src/R503_Archive.cpp src/R503_Frame.cpp -o r503arc
+ *
+ * Usage:
+ *   r503arc pack   [-j threads] <dir of <id>.tpl> <out.r503>
+ *   r503arc unpack [-j threads] <in.r503 | dir of .r503> <out dir>
+ *   r503arc bench  [-j threads] [-n templates] [-s bytes]
+ *
+ * pack reads the <id>.tpl files written by R503_FsTemplateStore and writes
+ * one stream of concatenated records; unpack writes <id>.tpl files back.
+ * The templates are stored as the module produced them, so the archive
+ * only restores to R503 modules; see R503_Archive.h.
+ */
+
+#include <Arduino.h>
+#include "R503_Archive.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define R503ARC_QUEUE_PER_THREAD 16
+
+struct Item {
+  uint32_t userID;
+  std::vector<uint8_t> data;
+  uint8_t result;
+};
+
+// Bounded multi-producer/multi-consumer queue; pop() returns false once the
+// queue is closed and empty
+class ItemQueue {
+public:
+  ItemQueue(size_t capacity) : capacity(capacity), closed(false) {}
+  
+  void push(Item &item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this] { return items.size() < capacity; });
+    items.push_back(std::move(item));
+    notEmpty.notify_one();
+  }
+  
+  bool pop(Item &item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notEmpty.wait(lock, [this] { return !items.empty() || closed; });
+    if (items.empty()) return false;
+    item = std::move(items.front());
+    items.pop_front();
+    notFull.notify_one();
+    return true;
+  }
+  
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    notEmpty.notify_all();
+  }
+
+private:
+  size_t capacity;
+  bool closed;
+  std::deque<Item> items;
+  std::mutex mutex;
+  std::condition_variable notEmpty;
+  std::condition_variable notFull;
+};
+
+struct Stats {
+  std::atomic<uint32_t> converted;
+  std::atomic<uint32_t> failed[R503_ARCHIVE_ERR_SPACE + 1];
+  std::atomic<uint32_t> skipped;
+  
+  Stats() : converted(0), skipped(0) {
+    for (uint8_t i = 0; i <= R503_ARCHIVE_ERR_SPACE; i++) failed[i] = 0;
+  }
+};
+
+static const char *errorName(uint8_t result) {
+  switch (result) {
+    case R503_ARCHIVE_ERR_FORMAT: return "not an archive record";
+    case R503_ARCHIVE_ERR_LENGTH: return "bad length";
+    case R503_ARCHIVE_ERR_CHECKSUM: return "checksum";
+    case R503_ARCHIVE_ERR_SPACE: return "too large";
+    default: return "ok";
+  }
+}
+
+static double seconds() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool readFile(const std::string &path, std::vector<uint8_t> &data) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) return false;
+  uint8_t buffer[4096];
+  size_t n;
+  data.clear();
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.insert(data.end(), buffer, buffer + n);
+  }
+  fclose(file);
+  return true;
+}
+
+static bool isDirectory(const std::string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Readers -----------------------------------------------------------------
+
+static void readTemplates(const std::string &dir, ItemQueue &queue, Stats &stats) {
+  DIR *d = opendir(dir.c_str());
+  if (!d) {
+    fprintf(stderr, "r503arc: cannot open %s\n", dir.c_str());
+    return;
+  }
+  
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    // <userID>.tpl as written by R503_FsTemplateStore
+    char *end;
+    unsigned long id = strtoul(entry->d_name, &end, 10);
+    if (end == entry->d_name || strcmp(end, ".tpl") != 0) continue;
+    
+    Item item;
+    item.userID = id;
+    item.result = R503_ARCHIVE_OK;
+    if (!readFile(dir + "/" + entry->d_name, item.data) || item.data.empty()) {
+      stats.skipped++;
+      continue;
+    }
+    queue.push(item);
+  }
+  closedir(d);
+}
+
+static void readRecordStream(const std::string &path, ItemQueue &queue, Stats &stats) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    fprintf(stderr, "r503arc: cannot open %s\n", path.c_str());
+    return;
+  }
+  
+  uint8_t header[R503_ARCHIVE_HEADER_SIZE];
+  while (fread(header, 1, sizeof(header), file) == sizeof(header)) {
+    uint32_t length = R503_Archive::recordLength(header);
+    if (length == 0) {
+      // Without a valid length the rest of the stream cannot be split
+      fprintf(stderr, "r503arc: %s: not a record stream\n", path.c_str());
+      stats.failed[R503_ARCHIVE_ERR_FORMAT]++;
+      break;
+    }
+    
+    Item item;
+    item.userID = 0;
+    item.result = R503_ARCHIVE_OK;
+    item.data.resize(length);
+    memcpy(item.data.data(), header, sizeof(header));
+    if (fread(item.data.data() + sizeof(header), 1, length - sizeof(header), file) !=
+        length - sizeof(header)) {
+      stats.failed[R503_ARCHIVE_ERR_LENGTH]++;
+      break;
+    }
+    queue.push(item);
+  }
+  fclose(file);
+}
+
+static void readRecords(const std::string &path, ItemQueue &queue, Stats &stats) {
+  if (!isDirectory(path)) {
+    readRecordStream(path, queue, stats);
+    return;
+  }
+  
+  DIR *d = opendir(path.c_str());
+  if (!d) return;
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    size_t len = strlen(entry->d_name);
+    if (len > 5 && strcmp(entry->d_name + len - 5, ".r503") == 0) {
+      readRecordStream(path + "/" + entry->d_name, queue, stats);
+    }
+  }
+  closedir(d);
+}
+
+// Workers -----------------------------------------------------------------
+
+static void pack(Item &item) {
+  std::vector<uint8_t> record(R503_ARCHIVE_MAX_RECORD);
+  uint16_t length = R503_Archive::pack(item.data.data(), item.data.size(), item.userID,
+                                       record.data(), record.size());
+  if (length == 0) {
+    item.result = R503_ARCHIVE_ERR_SPACE;
+    return;
+  }
+  record.resize(length);
+  item.data.swap(record);
+}
+
+static void unpack(Item &item) {
+  uint8_t tpl[R503_ARCHIVE_MAX_TEMPLATE];
+  uint16_t length;
+  item.result = R503_Archive::unpack(item.data.data(), item.data.size(), tpl, sizeof(tpl),
+                                     length, item.userID);
+  if (item.result == R503_ARCHIVE_OK) {
+    item.data.assign(tpl, tpl + length);
+  }
+}
+
+static void convert(bool packing, ItemQueue &in, ItemQueue &out) {
+  Item item;
+  while (in.pop(item)) {
+    if (packing) {
+      pack(item);
+    } else {
+      unpack(item);
+    }
+    out.push(item);
+  }
+}
+
+// Writers -----------------------------------------------------------------
+
+static void writeStream(const std::string &path, ItemQueue &queue, Stats &stats) {
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file) {
+    fprintf(stderr, "r503arc: cannot create %s\n", path.c_str());
+  }
+  
+  Item item;
+  while (queue.pop(item)) {
+    if (item.result != R503_ARCHIVE_OK) {
+      stats.failed[item.result]++;
+    } else if (file && fwrite(item.data.data(), 1, item.data.size(), file) == item.data.size()) {
+      stats.converted++;
+    }
+  }
+  if (file) fclose(file);
+}
+
+static void writeTemplates(const std::string &dir, ItemQueue &queue, Stats &stats) {
+  mkdir(dir.c_str(), 0755);
+  
+  Item item;
+  char name[32];
+  while (queue.pop(item)) {
+    if (item.result != R503_ARCHIVE_OK) {
+      stats.failed[item.result]++;
+      continue;
+    }
+    
+    snprintf(name, sizeof(name), "/%u.tpl", (unsigned)item.userID);
+    FILE *file = fopen((dir + name).c_str(), "wb");
+    if (!file) continue;
+    if (fwrite(item.data.data(), 1, item.data.size(), file) == item.data.size()) {
+      stats.converted++;
+    }
+    fclose(file);
+  }
+}
+
+// Commands ----------------------------------------------------------------
+
+static int runConversion(bool packing, const std::string &input, const std::string &output,
+                         unsigned threads) {
+  ItemQueue pending(threads * R503ARC_QUEUE_PER_THREAD);
+  ItemQueue done(threads * R503ARC_QUEUE_PER_THREAD);
+  Stats stats;
+  double started = seconds();
+  
+  std::thread writer(packing ? writeStream : writeTemplates, output, std::ref(done), std::ref(stats));
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < threads; i++) {
+    workers.push_back(std::thread(convert, packing, std::ref(pending), std::ref(done)));
+  }
+  
+  if (packing) {
+    readTemplates(input, pending, stats);
+  } else {
+    readRecords(input, pending, stats);
+  }
+  
+  pending.close();
+  for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+  done.close();
+  writer.join();
+  
+  double elapsed = seconds() - started;
+  printf("%u done in %.3f s (%.0f templates/s, %u threads)\n",
+         stats.converted.load(), elapsed, stats.converted / (elapsed > 0 ? elapsed : 1), threads);
+  uint32_t failures = 0;
+  for (uint8_t i = 1; i <= R503_ARCHIVE_ERR_SPACE; i++) {
+    if (stats.failed[i] == 0) continue;
+    printf("%u failed: %s\n", stats.failed[i].load(), errorName(i));
+    failures += stats.failed[i];
+  }
+  if (stats.skipped > 0) printf("%u unreadable files skipped\n", stats.skipped.load());
+  return failures == 0 && stats.skipped == 0 ? 0 : 1;
+}
+
+static int runBenchmark(unsigned threads, uint32_t count, uint16_t size) {
+  // Synthetic templates, converted in memory so only the codec is measured
+  std::vector<std::vector<uint8_t> > templates(count);
+  for (uint32_t i = 0; i < count; i++) {
+    templates[i].resize(size);
+    for (uint16_t b = 0; b < size; b++) {
+      templates[i][b] = (uint8_t)(i * 131 + b * 7 + (b >> 3));
+    }
+  }
+  std::vector<std::vector<uint8_t> > records(count);
+  
+  std::atomic<uint32_t> errors(0);
+  
+  for (unsigned pass = 0; pass < 2; pass++) {
+    unsigned n = (pass == 0) ? 1 : threads;
+    
+    double started = seconds();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < n; t++) {
+      workers.push_back(std::thread([&, t, n] {
+        uint8_t record[R503_ARCHIVE_MAX_RECORD];
+        for (uint32_t i = t; i < count; i += n) {
+          uint16_t length = R503_Archive::pack(templates[i].data(), size, i, record, sizeof(record));
+          records[i].assign(record, record + length);
+        }
+      }));
+    }
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    double packTime = seconds() - started;
+    
+    started = seconds();
+    workers.clear();
+    for (unsigned t = 0; t < n; t++) {
+      workers.push_back(std::thread([&, t, n] {
+        uint8_t tpl[R503_ARCHIVE_MAX_TEMPLATE];
+        for (uint32_t i = t; i < count; i += n) {
+          uint16_t length;
+          uint32_t userID;
+          if (R503_Archive::unpack(records[i].data(), records[i].size(), tpl, sizeof(tpl),
+                                   length, userID) != R503_ARCHIVE_OK ||
+              userID != i || length != size || memcmp(tpl, templates[i].data(), size) != 0) {
+            errors++;
+          }
+        }
+      }));
+    }
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    double unpackTime = seconds() - started;
+    
+    printf("%2u thread%s  pack %10.0f templates/s   unpack %10.0f templates/s\n",
+           n, n == 1 ? " " : "s", count / packTime, count / unpackTime);
+  }
+  
+  printf("%u templates of %u bytes, %u round-trip errors\n", count, size, errors.load());
+  return errors == 0 ? 0 : 1;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: r503arc pack   [-j threads] <tpl dir> <out.r503>\n"
+          "       r503arc unpack [-j threads] <in.r503 | r503 dir> <out dir>\n"
+          "       r503arc bench  [-j threads] [-n templates] [-s bytes]\n");
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    usage();
+    return 2;
+  }
+  std::string command = argv[1];
+  
+  unsigned threads = std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
+  uint32_t count = 100000;
+  uint16_t size = 512;
+  
+  int opt;
+  optind = 2;
+  while ((opt = getopt(argc, argv, "j:n:s:")) != -1) {
+    switch (opt) {
+      case 'j': threads = max(1, atoi(optarg)); break;
+      case 'n': count = strtoul(optarg, NULL, 10); break;
+      case 's': size = min(atoi(optarg), R503_ARCHIVE_MAX_TEMPLATE); break;
+      default: usage(); return 2;
+    }
+  }
+  
+  if (command == "bench") {
+    return runBenchmark(threads, count, size);
+  }
+  if ((command == "pack" || command == "unpack") && argc - optind == 2) {
+    return runConversion(command == "pack", argv[optind], argv[optind + 1], threads);
+  }
+  usage();
+  return 2;
+}
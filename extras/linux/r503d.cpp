@@ -0,0 +1,716 @@
+/*
+ * r503d - multi-sensor R503 daemon for Linux hosts
+ *
+ * Serves any number of R503 modules on USB-UART adapters from a single
+ * event loop thread. Every port is driven through an R503_Bus, so no call
+ * ever blocks; the loop sleeps in epoll until a port or a client has data
+ * or a capture retry is due. Each sensor has its own job queue.
+ *
+ * Build from the library root:
+ *   g++ -std=c++11 -O2 -Iextras/linux -Isrc extras/linux/r503d.cpp \
+ *       extras/linux/Arduino.cpp src/R503_*.cpp -o r503d
+ *
+ * Run:
+ *   r503d [-s /tmp/r503d.sock] [-b 57600] [-e count] /dev/ttyUSB0 ...
+ *   -e adds emulated sensors (emu0, emu1, ...) for testing without hardware
+ *
+ * Protocol: one request per line on the unix socket, answered with a line
+ * starting with the same request id. Requests for different sensors run
+ * concurrently; requests for one sensor run in order.
+ *   <id> list                      -> <id> ok <name>=<state> ...
+ *   <id> identify <sensor>         -> <id> ok id=<page> score=<score>
+ *   <id> enroll <sensor> <page>    -> <id> ok id=<page>
+ *   <id> sync <sensor>             -> <id> ok count=<n> ids=<page>,<page>,...
+ * Failures answer "<id> err <reason>". Sensors are named by device path
+ * (or emuN) or by their position on the command line.
+ *
+ * A port that hangs up or fails (adapter unplugged) is taken offline: its
+ * queued requests answer "err offline" and the device is reopened every
+ * R503D_REOPEN_INTERVAL ms until it comes back.
+ */
+
+#include <Arduino.h>
+#include "R503_Fingerprint.h"
+#include "R503_Bus.h"
+#include "R503_Emulator.h"
+#include "R503_LinuxSerial.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#define R503D_DEFAULT_SOCKET "/tmp/r503d.sock"
+#define R503D_MAX_EVENTS 64
+#define R503D_MAX_QUEUE 16
+#define R503D_TICK 5
+#define R503D_CAPTURE_TIMEOUT 15000
+#define R503D_CAPTURE_RETRY 50
+#define R503D_LIFT_WAIT 3000
+#define R503D_REOPEN_INTERVAL 1000
+#define R503D_MAX_LINE 256
+
+enum JobType {
+  JOB_INIT,
+  JOB_IDENTIFY,
+  JOB_ENROLL,
+  JOB_SYNC
+};
+
+struct Job {
+  JobType type;
+  int client;
+  std::string id;
+  uint8_t step;
+  uint16_t pageID;
+  uint32_t deadline;
+  uint32_t liftStarted;
+  uint16_t foundID;
+  uint16_t score;
+  uint8_t indexPage;
+  uint16_t count;
+  std::string ids;
+};
+
+struct Sensor {
+  std::string name;
+  R503_LinuxSerial *port;
+  R503_Emulator *emulator;
+  R503_Bus *bus;
+  R503_TimeoutModel model;
+  int8_t module;
+  uint16_t librarySize;
+  bool ready;
+  bool offline;
+  uint32_t reopenAt;
+  std::deque<Job> jobs;
+
+  // Next command of the current job, sent once wakeAt has passed
+  uint8_t command[R503_BUS_MAX_COMMAND];
+  uint8_t commandLen;
+  bool commandPending;
+  bool waiting;
+  uint32_t wakeAt;
+};
+
+struct Client {
+  std::string in;
+  std::string out;
+};
+
+static std::vector<Sensor *> sensors;
+static std::map<int, Client> clients;
+static int epollFd = -1;
+static unsigned long baud = 57600;
+static volatile sig_atomic_t stopping = 0;
+
+// Clients -----------------------------------------------------------------
+
+static void updateClientEvents(int fd) {
+  struct epoll_event ev;
+  ev.events = EPOLLIN | (clients[fd].out.empty() ? 0u : (uint32_t)EPOLLOUT);
+  ev.data.fd = fd;
+  epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+static void flushClient(int fd) {
+  Client &client = clients[fd];
+  while (!client.out.empty()) {
+    ssize_t n = send(fd, client.out.data(), client.out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n <= 0) break;
+    client.out.erase(0, n);
+  }
+  updateClientEvents(fd);
+}
+
+static void reply(int fd, const std::string &id, const std::string &text) {
+  if (fd < 0 || clients.find(fd) == clients.end()) return;
+  clients[fd].out += id + " " + text + "\n";
+  flushClient(fd);
+}
+
+static void closeClient(int fd) {
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+  close(fd);
+  clients.erase(fd);
+
+  // Jobs keep running so the sensor stays consistent; results are dropped
+  for (size_t i = 0; i < sensors.size(); i++) {
+    for (size_t j = 0; j < sensors[i]->jobs.size(); j++) {
+      if (sensors[i]->jobs[j].client == fd) sensors[i]->jobs[j].client = -1;
+    }
+  }
+}
+
+// Sensor jobs -------------------------------------------------------------
+
+static void queueCommand(Sensor &s, const uint8_t *command, uint8_t length, uint32_t delayMs = 0) {
+  memcpy(s.command, command, length);
+  s.commandLen = length;
+  s.commandPending = true;
+  s.wakeAt = millis() + delayMs;
+}
+
+static void queueSimple(Sensor &s, uint8_t opcode, uint32_t delayMs = 0) {
+  queueCommand(s, &opcode, 1, delayMs);
+}
+
+static void queueBuffer(Sensor &s, uint8_t opcode, uint8_t slot) {
+  uint8_t command[2] = { opcode, slot };
+  queueCommand(s, command, 2);
+}
+
+static void finishJob(Sensor &s, const std::string &text) {
+  Job &job = s.jobs.front();
+  reply(job.client, job.id, text);
+  s.jobs.pop_front();
+  s.commandPending = false;
+}
+
+// A finger that has not arrived yet is retried until the job deadline
+static bool retryCapture(Sensor &s, Job &job, const R503_BusResult &result) {
+  if (result.confirmCode != R503_NOFINGER) return false;
+
+  if ((int32_t)(millis() - job.deadline) >= 0) {
+    finishJob(s, "err nofinger");
+  } else {
+    queueSimple(s, R503_GENIMG, R503D_CAPTURE_RETRY);
+  }
+  return true;
+}
+
+static void startJob(Sensor &s) {
+  Job &job = s.jobs.front();
+  job.step = 0;
+  job.deadline = millis() + R503D_CAPTURE_TIMEOUT;
+
+  switch (job.type) {
+    case JOB_INIT:
+      queueSimple(s, R503_READSYSPARA);
+      break;
+    case JOB_IDENTIFY:
+    case JOB_ENROLL:
+      queueSimple(s, R503_GENIMG);
+      break;
+    case JOB_SYNC:
+      queueSimple(s, R503_TEMPLATENUM);
+      break;
+  }
+}
+
+static void advanceIdentify(Sensor &s, Job &job, const R503_BusResult &result) {
+  switch (job.step) {
+    case 0:
+      if (retryCapture(s, job, result)) return;
+      if (result.confirmCode != R503_OK) return finishJob(s, "err capture");
+      queueBuffer(s, R503_IMG2TZ, R503_CHARBUFFER1);
+      break;
+
+    case 1: {
+      if (result.confirmCode != R503_OK) return finishJob(s, "err extract");
+      uint8_t command[6] = {
+        R503_SEARCH, R503_CHARBUFFER1, 0, 0,
+        (uint8_t)(s.librarySize >> 8), (uint8_t)(s.librarySize & 0xFF)
+      };
+      queueCommand(s, command, 6);
+      break;
+    }
+
+    case 2: {
+      bool found = result.confirmCode == R503_OK && result.length >= 5;
+      if (!found && result.confirmCode != R503_NOTFOUND) return finishJob(s, "err search");
+      job.foundID = found ? (result.data[1] << 8) | result.data[2] : 0xFFFF;
+      job.score = found ? (result.data[3] << 8) | result.data[4] : 0;
+
+      // Show the outcome on the ring; its ACK only ends the job
+      uint8_t command[5] = {
+        R503_AURALEDCONFIG, R503_LED_FLASHING, 0x40,
+        (uint8_t)(found ? R503_LED_BLUE : R503_LED_RED), 2
+      };
+      queueCommand(s, command, 5);
+      break;
+    }
+
+    case 3: {
+      if (job.foundID == 0xFFFF) return finishJob(s, "err notfound");
+      char text[48];
+      snprintf(text, sizeof(text), "ok id=%u score=%u", job.foundID, job.score);
+      return finishJob(s, text);
+    }
+  }
+  job.step++;
+}
+
+static void advanceEnroll(Sensor &s, Job &job, const R503_BusResult &result) {
+  switch (job.step) {
+    case 0:
+      if (retryCapture(s, job, result)) return;
+      if (result.confirmCode != R503_OK) return finishJob(s, "err capture");
+      queueBuffer(s, R503_IMG2TZ, R503_CHARBUFFER1);
+      break;
+
+    case 1:
+      if (result.confirmCode != R503_OK) return finishJob(s, "err extract");
+      job.liftStarted = millis();
+      queueSimple(s, R503_GENIMG);
+      break;
+
+    case 2:
+      // Wait for the finger to be lifted, but not forever
+      if (result.confirmCode == R503_OK && millis() - job.liftStarted < R503D_LIFT_WAIT) {
+        queueSimple(s, R503_GENIMG, R503D_CAPTURE_RETRY);
+        return;
+      }
+      job.deadline = millis() + R503D_CAPTURE_TIMEOUT;
+      queueSimple(s, R503_GENIMG);
+      break;
+
+    case 3:
+      if (retryCapture(s, job, result)) return;
+      if (result.confirmCode != R503_OK) return finishJob(s, "err capture");
+      queueBuffer(s, R503_IMG2TZ, R503_CHARBUFFER2);
+      break;
+
+    case 4:
+      if (result.confirmCode != R503_OK) return finishJob(s, "err extract");
+      queueSimple(s, R503_REGMODEL);
+      break;
+
+    case 5: {
+      if (result.confirmCode != R503_OK) return finishJob(s, "err mismatch");
+      uint8_t command[4] = {
+        R503_STORE, R503_CHARBUFFER1,
+        (uint8_t)(job.pageID >> 8), (uint8_t)(job.pageID & 0xFF)
+      };
+      queueCommand(s, command, 4);
+      break;
+    }
+
+    case 6: {
+      if (result.confirmCode != R503_OK) return finishJob(s, "err store");
+      char text[32];
+      snprintf(text, sizeof(text), "ok id=%u", job.pageID);
+      return finishJob(s, text);
+    }
+  }
+  job.step++;
+}
+
+static void advanceSync(Sensor &s, Job &job, const R503_BusResult &result) {
+  if (result.confirmCode != R503_OK) return finishJob(s, "err sync");
+
+  if (job.step == 0) {
+    job.count = (result.data[1] << 8) | result.data[2];
+    job.indexPage = 0;
+  } else {
+    // Index table bits are MSB first, 256 slots per page
+    for (uint16_t i = 0; i < 256 && i < (result.length - 1) * 8; i++) {
+      uint16_t pageID = job.indexPage * 256 + i;
+      if (pageID >= s.librarySize) break;
+      if (result.data[1 + i / 8] & (1 << (7 - i % 8))) {
+        if (!job.ids.empty()) job.ids += ",";
+        job.ids += std::to_string(pageID);
+      }
+    }
+    job.indexPage++;
+  }
+
+  if (job.indexPage * 256 < s.librarySize) {
+    queueBuffer(s, R503_READINDEXTABLE, job.indexPage);
+    job.step++;
+    return;
+  }
+
+  char text[32];
+  snprintf(text, sizeof(text), "ok count=%u ids=", job.count);
+  finishJob(s, text + job.ids);
+}
+
+static void advance(Sensor &s, const R503_BusResult &result) {
+  Job &job = s.jobs.front();
+
+  if (!result.completed) {
+    if (job.type == JOB_INIT) {
+      // Keep trying; the module may still be powering up
+      queueSimple(s, R503_READSYSPARA, 1000);
+      return;
+    }
+    return finishJob(s, "err timeout");
+  }
+
+  switch (job.type) {
+    case JOB_INIT:
+      if (result.confirmCode == R503_OK && result.length >= 7) {
+        s.librarySize = (result.data[5] << 8) | result.data[6];
+        s.ready = true;
+        s.jobs.pop_front();
+        s.commandPending = false;
+      } else {
+        queueSimple(s, R503_READSYSPARA, 1000);
+      }
+      break;
+    case JOB_IDENTIFY:
+      advanceIdentify(s, job, result);
+      break;
+    case JOB_ENROLL:
+      advanceEnroll(s, job, result);
+      break;
+    case JOB_SYNC:
+      advanceSync(s, job, result);
+      break;
+  }
+}
+
+static void service(Sensor &s) {
+  s.bus->poll();
+
+  R503_BusResult result;
+  while (s.bus->getResult(result)) {
+    s.waiting = false;
+    if (!s.jobs.empty()) advance(s, result);
+  }
+
+  if (s.waiting) return;
+
+  if (!s.commandPending && !s.jobs.empty()) {
+    startJob(s);
+  }
+
+  if (s.commandPending && (int32_t)(millis() - s.wakeAt) >= 0) {
+    if (s.bus->submit(s.module, s.command, s.commandLen)) {
+      s.commandPending = false;
+      s.waiting = true;
+      s.bus->poll();
+    }
+  }
+}
+
+// Requests ----------------------------------------------------------------
+
+static Sensor *findSensor(const std::string &name) {
+  for (size_t i = 0; i < sensors.size(); i++) {
+    if (sensors[i]->name == name || std::to_string(i) == name) return sensors[i];
+  }
+  return NULL;
+}
+
+static void handleRequest(int fd, const std::string &line) {
+  char id[32] = "";
+  char command[16] = "";
+  char sensorName[64] = "";
+  unsigned page = 0;
+  int fields = sscanf(line.c_str(), "%31s %15s %63s %u", id, command, sensorName, &page);
+  if (fields < 2) return reply(fd, fields == 1 ? id : "-", "err syntax");
+
+  std::string cmd = command;
+  if (cmd == "list") {
+    std::string text = "ok";
+    for (size_t i = 0; i < sensors.size(); i++) {
+      Sensor &s = *sensors[i];
+      text += " " + s.name + "=" +
+              (s.offline ? "offline" : !s.ready ? "init" : s.jobs.empty() ? "idle" : "busy");
+    }
+    return reply(fd, id, text);
+  }
+
+  if (cmd != "identify" && cmd != "enroll" && cmd != "sync") return reply(fd, id, "err syntax");
+  
+  Sensor *s = findSensor(sensorName);
+  if (!s) return reply(fd, id, "err nosensor");
+  if (s->offline) return reply(fd, id, "err offline");
+  if (s->jobs.size() >= R503D_MAX_QUEUE) return reply(fd, id, "err busy");
+
+  Job job;
+  job.client = fd;
+  job.id = id;
+  job.step = 0;
+  job.pageID = page;
+  job.deadline = 0;
+  job.liftStarted = 0;
+  job.foundID = 0;
+  job.score = 0;
+  job.indexPage = 0;
+  job.count = 0;
+
+  if (cmd == "identify") {
+    job.type = JOB_IDENTIFY;
+  } else if (cmd == "enroll" && fields == 4) {
+    if (s->ready && page >= s->librarySize) return reply(fd, id, "err badpage");
+    job.type = JOB_ENROLL;
+  } else if (cmd == "sync") {
+    job.type = JOB_SYNC;
+  } else {
+    return reply(fd, id, "err syntax");
+  }
+
+  s->jobs.push_back(job);
+}
+
+static void readClient(int fd) {
+  char buffer[512];
+  ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+    closeClient(fd);
+    return;
+  }
+  if (n < 0) return;
+
+  Client &client = clients[fd];
+  client.in.append(buffer, n);
+
+  size_t end;
+  while ((end = client.in.find('\n')) != std::string::npos) {
+    std::string line = client.in.substr(0, end);
+    client.in.erase(0, end + 1);
+    if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+    if (!line.empty()) handleRequest(fd, line);
+    if (clients.find(fd) == clients.end()) return;
+  }
+
+  // A client that never ends its line is not speaking the protocol
+  if (client.in.size() > R503D_MAX_LINE) {
+    reply(fd, "-", "err toolong");
+    closeClient(fd);
+  }
+}
+
+// Ports -------------------------------------------------------------------
+
+static void queueInit(Sensor &s) {
+  Job init;
+  init.type = JOB_INIT;
+  init.client = -1;
+  init.step = 0;
+  s.jobs.push_back(init);
+}
+
+static void addWatch(int fd, uint32_t events) {
+  struct epoll_event ev;
+  ev.events = events;
+  ev.data.fd = fd;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static Sensor *findPort(int fd) {
+  for (size_t i = 0; i < sensors.size(); i++) {
+    if (sensors[i]->port && !sensors[i]->offline && sensors[i]->port->getFd() == fd) {
+      return sensors[i];
+    }
+  }
+  return NULL;
+}
+
+// A hung-up fd stays readable, so it must leave the epoll set until the
+// device is back or the loop would spin
+static void takeOffline(Sensor &s) {
+  fprintf(stderr, "r503d: %s offline\n", s.name.c_str());
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, s.port->getFd(), NULL);
+  s.port->end();
+
+  while (!s.jobs.empty()) {
+    if (s.jobs.front().type != JOB_INIT) {
+      reply(s.jobs.front().client, s.jobs.front().id, "err offline");
+    }
+    s.jobs.pop_front();
+  }
+  s.commandPending = false;
+  s.waiting = false;
+  s.ready = false;
+  s.offline = true;
+  s.reopenAt = millis() + R503D_REOPEN_INTERVAL;
+}
+
+static void reopen(Sensor &s) {
+  // Let the command lost with the port expire first so its result cannot
+  // be taken for the answer to the first command after reopening
+  R503_BusResult stale;
+  s.bus->poll();
+  while (s.bus->getResult(stale)) {
+  }
+  if (!s.bus->isIdle() || (int32_t)(millis() - s.reopenAt) < 0) return;
+
+  if (!s.port->open(baud)) {
+    s.reopenAt = millis() + R503D_REOPEN_INTERVAL;
+    return;
+  }
+  fprintf(stderr, "r503d: %s back online\n", s.name.c_str());
+  addWatch(s.port->getFd(), EPOLLIN);
+  s.offline = false;
+  queueInit(s);
+}
+
+// Setup -------------------------------------------------------------------
+
+static Sensor *addSensor(const std::string &name, R503_LinuxSerial *port, R503_Emulator *emulator) {
+  Sensor *s = new Sensor();
+  s->name = name;
+  s->port = port;
+  s->emulator = emulator;
+  s->bus = new R503_Bus(port ? (Stream *)port : (Stream *)emulator);
+  s->bus->setTimeoutModel(&s->model);
+  s->module = s->bus->addModule(R503_DEFAULT_ADDRESS);
+  s->librarySize = 0;
+  s->ready = false;
+  s->offline = false;
+  s->reopenAt = 0;
+  s->commandLen = 0;
+  s->commandPending = false;
+  s->waiting = false;
+  s->wakeAt = 0;
+
+  queueInit(*s);
+
+  sensors.push_back(s);
+  return s;
+}
+
+static R503_Emulator *createEmulator(uint8_t index) {
+  R503_Emulator *emulator = new R503_Emulator();
+  int8_t module = emulator->addModule();
+  emulator->setServiceTime(R503_GENIMG, 60);
+  emulator->setNoFingerTime(10);
+  emulator->setServiceTime(R503_IMG2TZ, 90);
+  emulator->setServiceTime(R503_SEARCH, 20);
+  emulator->setSearchCostPerPage(500);
+
+  // A few enrolled fingers, one of them resting on the sensor
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  for (uint16_t id = 0; id < 8; id++) {
+    for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+      features[i] = (uint8_t)(i * 31 + id * 97 + index * 7 + (i * id) % 13);
+    }
+    emulator->enrollDirect(module, id, features);
+    if (id == index % 8) emulator->placeFinger(module, features);
+  }
+  return emulator;
+}
+
+static int listenOn(const char *path) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  unlink(path);
+
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void onSignal(int) {
+  stopping = 1;
+}
+
+int main(int argc, char **argv) {
+  const char *socketPath = R503D_DEFAULT_SOCKET;
+  int emulated = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:b:e:")) != -1) {
+    switch (opt) {
+      case 's': socketPath = optarg; break;
+      case 'b': baud = strtoul(optarg, NULL, 10); break;
+      case 'e': emulated = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-s socket] [-b baud] [-e count] device...\n", argv[0]);
+        return 2;
+    }
+  }
+
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+  for (int i = optind; i < argc; i++) {
+    R503_LinuxSerial *port = new R503_LinuxSerial(argv[i]);
+    if (!port->open(baud)) {
+      fprintf(stderr, "r503d: cannot open %s at %lu baud: %s\n", argv[i], baud, strerror(errno));
+      return 1;
+    }
+    addSensor(argv[i], port, NULL);
+    addWatch(port->getFd(), EPOLLIN);
+  }
+  for (int i = 0; i < emulated; i++) {
+    addSensor("emu" + std::to_string(i), NULL, createEmulator(i));
+  }
+  if (sensors.empty()) {
+    fprintf(stderr, "r503d: no sensors given\n");
+    return 2;
+  }
+
+  int listenFd = listenOn(socketPath);
+  if (listenFd < 0) {
+    fprintf(stderr, "r503d: cannot listen on %s: %s\n", socketPath, strerror(errno));
+    return 1;
+  }
+  addWatch(listenFd, EPOLLIN);
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  fprintf(stderr, "r503d: %u sensors, listening on %s\n", (unsigned)sensors.size(), socketPath);
+
+  struct epoll_event events[R503D_MAX_EVENTS];
+  while (!stopping) {
+    // Sleep until I/O arrives; tick while any sensor has work so capture
+    // retries and command deadlines are noticed
+    int timeout = -1;
+    for (size_t i = 0; i < sensors.size(); i++) {
+      if (sensors[i]->offline) {
+        timeout = R503D_REOPEN_INTERVAL;
+      } else if (!sensors[i]->jobs.empty() || sensors[i]->waiting) {
+        timeout = R503D_TICK;
+        break;
+      }
+    }
+
+    int count = epoll_wait(epollFd, events, R503D_MAX_EVENTS, timeout);
+    if (count < 0 && errno != EINTR) break;
+
+    for (int i = 0; i < count; i++) {
+      int fd = events[i].data.fd;
+
+      if (fd == listenFd) {
+        int clientFd;
+        while ((clientFd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+          clients[clientFd] = Client();
+          addWatch(clientFd, EPOLLIN);
+        }
+      } else if (clients.find(fd) != clients.end()) {
+        if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+          closeClient(fd);
+          continue;
+        }
+        if (events[i].events & EPOLLOUT) flushClient(fd);
+        if (events[i].events & EPOLLIN) readClient(fd);
+      } else if (Sensor *s = findPort(fd)) {
+        // Input only wakes the loop; every sensor is serviced below
+        if (events[i].events & (EPOLLHUP | EPOLLERR)) takeOffline(*s);
+      }
+    }
+
+    for (size_t i = 0; i < sensors.size(); i++) {
+      Sensor &s = *sensors[i];
+      if (s.offline) {
+        reopen(s);
+        continue;
+      }
+      service(s);
+      if (s.port && s.port->isLost()) takeOffline(s);
+    }
+  }
+
+  close(listenFd);
+  unlink(socketPath);
+  return 0;
+}
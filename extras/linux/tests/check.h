@@ -0,0 +1,39 @@
+// check.h - minimal assertions for the host tests
+#ifndef R503_TEST_CHECK_H
+#define R503_TEST_CHECK_H
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+// Reports a failed condition and keeps going, so one run shows every failure
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+      checkFailures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(actual, expected) \
+  do { \
+    long long checkActual = (long long)(actual); \
+    long long checkExpected = (long long)(expected); \
+    if (checkActual != checkExpected) { \
+      printf("FAIL %s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, \
+             checkActual, checkExpected); \
+      checkFailures++; \
+    } \
+  } while (0)
+
+// Exit status for main()
+static int checkResult(const char *name) {
+  if (checkFailures == 0) {
+    printf("%s: ok\n", name);
+    return 0;
+  }
+  printf("%s: %d failed\n", name, checkFailures);
+  return 1;
+}
+
+#endif // R503_TEST_CHECK_H
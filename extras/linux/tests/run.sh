@@ -0,0 +1,17 @@
+#!/bin/sh
+# Builds and runs every host test against R503_Emulator.
+# Run from the library root: sh extras/linux/tests/run.sh
+set -e
+
+CXX=${CXX:-g++}
+OUT=${OUT:-/tmp/r503-tests}
+mkdir -p "$OUT"
+
+status=0
+for test in extras/linux/tests/test_*.cpp; do
+  name=$(basename "$test" .cpp)
+  $CXX -std=c++20 -O2 -Wall -Wextra -DR503_EMU_MAX_MODULES=3 -Iextras/linux -Isrc \
+      "$test" extras/linux/Arduino.cpp src/R503_*.cpp -o "$OUT/$name"
+  "$OUT/$name" || status=1
+done
+exit $status
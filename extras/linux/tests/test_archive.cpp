@@ -0,0 +1,54 @@
+/*
+ * test_archive - R503_Archive records
+ *
+ * Build from the library root (or run extras/linux/tests/run.sh):
+ *   g++ -std=c++11 -O2 -Iextras/linux -Isrc extras/linux/tests/test_archive.cpp \
+ *       extras/linux/Arduino.cpp src/R503_*.cpp -o test_archive
+ */
+
+#include <Arduino.h>
+#include "R503_Archive.h"
+#include "check.h"
+
+int main() {
+  uint8_t tpl[512];
+  for (uint16_t i = 0; i < sizeof(tpl); i++) {
+    tpl[i] = (uint8_t)(i * 13 + 5);
+  }
+  
+  uint8_t record[R503_ARCHIVE_MAX_RECORD];
+  uint16_t length = R503_Archive::pack(tpl, sizeof(tpl), 4711, record, sizeof(record));
+  CHECK_EQ(length, R503_ARCHIVE_HEADER_SIZE + sizeof(tpl) + 2);
+  CHECK_EQ(R503_Archive::recordLength(record), length);
+  CHECK_EQ(R503_Archive::pack(tpl, sizeof(tpl), 1, record, length - 1), 0);
+  
+  uint8_t out[R503_ARCHIVE_MAX_TEMPLATE];
+  uint16_t outLength = 0;
+  uint32_t userID = 0;
+  CHECK_EQ(R503_Archive::unpack(record, length, out, sizeof(out), outLength, userID),
+           R503_ARCHIVE_OK);
+  CHECK_EQ(outLength, sizeof(tpl));
+  CHECK_EQ(userID, 4711);
+  CHECK(memcmp(out, tpl, sizeof(tpl)) == 0);
+  
+  CHECK_EQ(R503_Archive::unpack(record, length - 1, out, sizeof(out), outLength, userID),
+           R503_ARCHIVE_ERR_LENGTH);
+  CHECK_EQ(R503_Archive::unpack(record, length, out, 100, outLength, userID),
+           R503_ARCHIVE_ERR_SPACE);
+  
+  // The checksum covers the user ID as well as the template
+  record[9] ^= 0x01;
+  CHECK_EQ(R503_Archive::unpack(record, length, out, sizeof(out), outLength, userID),
+           R503_ARCHIVE_ERR_CHECKSUM);
+  record[9] ^= 0x01;
+  record[R503_ARCHIVE_HEADER_SIZE + 100] ^= 0x80;
+  CHECK_EQ(R503_Archive::unpack(record, length, out, sizeof(out), outLength, userID),
+           R503_ARCHIVE_ERR_CHECKSUM);
+  
+  record[4] = R503_ARCHIVE_VERSION + 1;
+  CHECK_EQ(R503_Archive::recordLength(record), 0);
+  CHECK_EQ(R503_Archive::unpack(record, length, out, sizeof(out), outLength, userID),
+           R503_ARCHIVE_ERR_FORMAT);
+  
+  return checkResult("test_archive");
+}
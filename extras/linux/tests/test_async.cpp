@@ -0,0 +1,94 @@
+/*
+ * test_async - R503_Scheduler slot limits against R503_Emulator
+ *
+ * Every workflow the scheduler accepts must be able to sleep and await a
+ * command, and a full bus queue must not read as a cancellation.
+ *
+ * Build from the library root (or run extras/linux/tests/run.sh):
+ *   g++ -std=c++20 -O2 -Iextras/linux -Isrc extras/linux/tests/test_async.cpp \
+ *       extras/linux/Arduino.cpp src/R503_*.cpp -o test_async
+ */
+
+#include <Arduino.h>
+#include "R503_Async.h"
+#include "R503_Emulator.h"
+#include "check.h"
+
+#if defined(__cpp_impl_coroutine)
+
+#define WORKFLOWS R503_ASYNC_MAX_READY
+
+static R503_Task<bool> sleeper(R503_AsyncSensor &sensor) {
+  co_return co_await sensor.sleep(20);
+}
+
+static R503_Task<uint8_t> handshake(R503_AsyncSensor &sensor) {
+  uint8_t command[1] = { R503_HANDSHAKE };
+  R503_BusResult result = co_await sensor.command(command, 1);
+  co_return result.confirmCode;
+}
+
+// As many sleeping workflows as the scheduler takes
+static void testSleepers() {
+  R503_Emulator emulator;
+  emulator.addModule();
+  R503_Bus bus(&emulator);
+  R503_Scheduler scheduler;
+  R503_AsyncSensor sensor(scheduler, bus, bus.addModule(R503_DEFAULT_ADDRESS));
+  
+  R503_Task<bool> tasks[WORKFLOWS];
+  for (uint8_t i = 0; i < WORKFLOWS; i++) {
+    tasks[i] = sleeper(sensor);
+    CHECK(scheduler.start(tasks[i]));
+  }
+  scheduler.run();
+  
+  uint8_t elapsed = 0;
+  for (uint8_t i = 0; i < WORKFLOWS; i++) {
+    if (tasks[i].isDone() && tasks[i].getResult()) elapsed++;
+  }
+  CHECK_EQ(elapsed, WORKFLOWS);
+}
+
+// More commands for one module than its bus queue holds
+static void testFullQueue() {
+  R503_Emulator emulator;
+  emulator.addModule();
+  emulator.setServiceTime(R503_HANDSHAKE, 20);
+  R503_Bus bus(&emulator);
+  R503_Scheduler scheduler;
+  R503_AsyncSensor sensor(scheduler, bus, bus.addModule(R503_DEFAULT_ADDRESS));
+  
+  R503_Task<uint8_t> tasks[R503_BUS_QUEUE_DEPTH + 2];
+  for (uint8_t i = 0; i < R503_BUS_QUEUE_DEPTH + 2; i++) {
+    tasks[i] = handshake(sensor);
+    CHECK(scheduler.start(tasks[i]));
+  }
+  scheduler.run();
+  
+  uint8_t ok = 0;
+  uint8_t noSlot = 0;
+  for (uint8_t i = 0; i < R503_BUS_QUEUE_DEPTH + 2; i++) {
+    CHECK(tasks[i].isDone());
+    CHECK(tasks[i].getResult() != R503_ASYNC_CANCELLED);
+    if (tasks[i].getResult() == R503_OK) ok++;
+    if (tasks[i].getResult() == R503_ASYNC_NO_SLOT) noSlot++;
+  }
+  CHECK_EQ(ok, R503_BUS_QUEUE_DEPTH);
+  CHECK_EQ(noSlot, 2);
+}
+
+int main() {
+  testSleepers();
+  testFullQueue();
+  return checkResult("test_async");
+}
+
+#else
+
+int main() {
+  printf("test_async: skipped, needs -std=c++20\n");
+  return 0;
+}
+
+#endif
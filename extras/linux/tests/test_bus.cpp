@@ -0,0 +1,108 @@
+/*
+ * test_bus - shared-link behaviour against R503_Emulator
+ *
+ * The late ACK of an expired bus command must not complete the module's
+ * next command, and a large frame from another module must not cost the
+ * driver the reply it is waiting for.
+ *
+ * Build from the library root (or run extras/linux/tests/run.sh):
+ *   g++ -std=c++11 -O2 -DR503_EMU_MAX_MODULES=3 -Iextras/linux -Isrc \
+ *       extras/linux/tests/test_bus.cpp extras/linux/Arduino.cpp src/R503_*.cpp -o test_bus
+ */
+
+#include <Arduino.h>
+#include "R503_Fingerprint.h"
+#include "R503_Bus.h"
+#include "R503_Frame.h"
+#include "R503_Emulator.h"
+#include "check.h"
+
+#if R503_EMU_MAX_MODULES < 2
+#error "build with -DR503_EMU_MAX_MODULES=3 so both modules get an emulated one"
+#endif
+
+static void fillFeatures(uint8_t *features, uint8_t seed) {
+  for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+    features[i] = (uint8_t)(i * 31 + seed * 97);
+  }
+}
+
+static bool waitResult(R503_Bus &bus, R503_BusResult &result) {
+  uint32_t start = millis();
+  while (millis() - start < 5000) {
+    bus.poll();
+    if (bus.getResult(result)) return true;
+    delay(1);
+  }
+  return false;
+}
+
+// STORE expires on the bus; the TEMPLATENUM queued behind it gets its own
+// three-byte reply, not the late one-byte STORE ACK
+static void testExpiredCommand() {
+  R503_Emulator emulator;
+  int8_t module = emulator.addModule();
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  fillFeatures(features, 1);
+  emulator.enrollDirect(module, 1, features);
+  emulator.setServiceTime(R503_STORE, 600);
+  
+  R503_Bus bus(&emulator);
+  bus.setTimeout(300);
+  uint8_t handle = bus.addModule(R503_DEFAULT_ADDRESS);
+  
+  uint8_t store[4] = { R503_STORE, R503_CHARBUFFER1, 0, 5 };
+  uint8_t count[1] = { R503_TEMPLATENUM };
+  CHECK(bus.submit(handle, store, sizeof(store), 1));
+  CHECK(bus.submit(handle, count, sizeof(count), 2));
+  
+  R503_BusResult result;
+  CHECK(waitResult(bus, result));
+  CHECK_EQ(result.tag, 1);
+  CHECK(!result.completed);
+  
+  CHECK(waitResult(bus, result));
+  CHECK_EQ(result.tag, 2);
+  CHECK(result.completed);
+  CHECK_EQ(result.confirmCode, R503_OK);
+  CHECK_EQ(result.length, 3);
+  
+  // The late STORE went through
+  CHECK_EQ((result.data[1] << 8) | result.data[2], 2);
+  CHECK_EQ(bus.getLateReplies(), 1);
+  CHECK(bus.isIdle());
+}
+
+// Module B streams a template while the driver waits for module A's ACK
+static void testForeignDataFrame() {
+  R503_Emulator emulator;
+  int8_t moduleA = emulator.addModule(R503_DEFAULT_ADDRESS);
+  int8_t moduleB = emulator.addModule(R503_DEFAULT_ADDRESS - 1);
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  fillFeatures(features, 2);
+  emulator.enrollDirect(moduleA, 1, features);
+  emulator.enrollDirect(moduleB, 1, features);
+  
+  R503_Fingerprint finger(&emulator);
+  CHECK(finger.begin(57600));
+  
+  // Module B: load a template, then upload it without reading the reply
+  uint8_t frame[R503_FRAME_OVERHEAD + 4];
+  uint8_t load[4] = { R503_LOADCHAR, R503_CHARBUFFER1, 0, 1 };
+  emulator.write(frame, R503_Frame::build(frame, R503_DEFAULT_ADDRESS - 1, R503_COMMAND_PACKET,
+                                          load, sizeof(load)));
+  uint8_t upload[2] = { R503_UPCHAR, R503_CHARBUFFER1 };
+  emulator.write(frame, R503_Frame::build(frame, R503_DEFAULT_ADDRESS - 1, R503_COMMAND_PACKET,
+                                          upload, sizeof(upload)));
+  
+  emulator.setServiceTime(R503_LOADCHAR, 50);
+  uint32_t corrupt = finger.getLinkStats().corruptFrames;
+  CHECK(finger.loadModel(R503_CHARBUFFER1, 1));
+  CHECK_EQ(finger.getLinkStats().corruptFrames, corrupt);
+}
+
+int main() {
+  testExpiredCommand();
+  testForeignDataFrame();
+  return checkResult("test_bus");
+}
@@ -0,0 +1,195 @@
+/*
+ * test_cache - R503_TemplateCache against R503_Emulator
+ *
+ * A user paged in on a miss must not be the next eviction ahead of idle
+ * residents, and one miss must not download the whole host store.
+ *
+ * Build from the library root (or run extras/linux/tests/run.sh):
+ *   g++ -std=c++11 -O2 -Iextras/linux -Isrc extras/linux/tests/test_cache.cpp \
+ *       extras/linux/Arduino.cpp src/R503_*.cpp -o test_cache
+ */
+
+#include <Arduino.h>
+#include "R503_Fingerprint.h"
+#include "R503_TemplateCache.h"
+#include "R503_Emulator.h"
+#include "check.h"
+
+#define STORE_MAX_USERS 40
+
+// Host store in RAM, iterated in enrollment order
+class MemoryStore : public R503_TemplateStore {
+public:
+  MemoryStore() : count(0), cursor(0), reads(0), haveMap(false) {}
+  
+  bool read(uint32_t userID, uint8_t *buffer, uint16_t maxLength, uint16_t &length) {
+    int16_t i = find(userID);
+    if (i < 0 || lengths[i] > maxLength) return false;
+    memcpy(buffer, templates[i], lengths[i]);
+    length = lengths[i];
+    reads++;
+    return true;
+  }
+  
+  bool write(uint32_t userID, const uint8_t *buffer, uint16_t length) {
+    int16_t i = find(userID);
+    if (i < 0) {
+      if (count >= STORE_MAX_USERS || length > R503_EMU_TEMPLATE_SIZE) return false;
+      i = count++;
+      userIDs[i] = userID;
+    }
+    memcpy(templates[i], buffer, length);
+    lengths[i] = length;
+    return true;
+  }
+  
+  bool remove(uint32_t userID) {
+    int16_t i = find(userID);
+    if (i < 0) return false;
+    count--;
+    userIDs[i] = userIDs[count];
+    lengths[i] = lengths[count];
+    memcpy(templates[i], templates[count], R503_EMU_TEMPLATE_SIZE);
+    return true;
+  }
+  
+  bool first(uint32_t &userID) {
+    cursor = 0;
+    return next(userID);
+  }
+  
+  bool next(uint32_t &userID) {
+    if (cursor >= count) return false;
+    userID = userIDs[cursor++];
+    return true;
+  }
+  
+  bool loadSlotMap(uint32_t *ids, uint16_t slots) {
+    if (!haveMap) return false;
+    memcpy(ids, slotMap, slots * sizeof(uint32_t));
+    return true;
+  }
+  
+  bool saveSlotMap(const uint32_t *ids, uint16_t slots) {
+    memcpy(slotMap, ids, slots * sizeof(uint32_t));
+    haveMap = true;
+    return true;
+  }
+  
+  uint16_t getReads() { return reads; }
+  
+private:
+  uint32_t userIDs[STORE_MAX_USERS];
+  uint8_t templates[STORE_MAX_USERS][R503_EMU_TEMPLATE_SIZE];
+  uint16_t lengths[STORE_MAX_USERS];
+  uint16_t count;
+  uint16_t cursor;
+  uint16_t reads;
+  uint32_t slotMap[R503_CACHE_MAX_SLOTS];
+  bool haveMap;
+  
+  int16_t find(uint32_t userID) {
+    for (uint16_t i = 0; i < count; i++) {
+      if (userIDs[i] == userID) return i;
+    }
+    return -1;
+  }
+};
+
+static void fillFeatures(uint8_t *features, uint8_t seed) {
+  for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+    features[i] = (uint8_t)(i * 31 + seed * 97);
+  }
+}
+
+// Puts user's finger on the sensor and its features into CHARBUFFER1
+static bool scan(R503_Emulator &emulator, R503_Fingerprint &finger, uint8_t user) {
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  fillFeatures(features, user);
+  emulator.placeFinger(0, features);
+  return finger.getImage() && finger.image2Tz(R503_CHARBUFFER1);
+}
+
+static bool identifyAs(R503_Emulator &emulator, R503_Fingerprint &finger, R503_TemplateCache &cache,
+                       uint8_t user) {
+  uint32_t userID = 0;
+  uint16_t score = 0;
+  return scan(emulator, finger, user) && cache.identify(userID, score) && userID == user;
+}
+
+// Saves users 1..count to the host store only
+static void fillStore(R503_Emulator &emulator, R503_Fingerprint &finger, MemoryStore &store,
+                      uint8_t count) {
+  uint8_t buffer[R503_CACHE_TEMPLATE_SIZE];
+  uint16_t length;
+  for (uint8_t user = 1; user <= count; user++) {
+    CHECK(scan(emulator, finger, user));
+    CHECK(finger.uploadCharacteristics(R503_CHARBUFFER1, buffer, length));
+    CHECK(store.write(user, buffer, length));
+  }
+}
+
+// Three slots: a regular and two users seen twice each. Paging in user 4
+// replaces user 2; paging in user 5 must then replace user 3, who has not
+// been seen since, rather than user 4 who was only just paged in.
+static void testNewInstallNotFirstVictim() {
+  R503_Emulator emulator;
+  emulator.addModule();
+  R503_Fingerprint finger(&emulator);
+  CHECK(finger.begin(57600));
+  
+  MemoryStore store;
+  fillStore(emulator, finger, store, 5);
+  R503_TemplateCache cache(&finger, &store);
+  CHECK(cache.begin(0, 3));
+  CHECK(cache.prefetch(1));
+  CHECK(cache.prefetch(2));
+  CHECK(cache.prefetch(3));
+  
+  for (uint8_t i = 0; i < 4; i++) {
+    CHECK(identifyAs(emulator, finger, cache, 1));
+  }
+  CHECK(identifyAs(emulator, finger, cache, 2));
+  CHECK(identifyAs(emulator, finger, cache, 3));
+  
+  CHECK(identifyAs(emulator, finger, cache, 4));
+  CHECK(!cache.isResident(2));
+  CHECK(identifyAs(emulator, finger, cache, 5));
+  CHECK(cache.isResident(1));
+  CHECK(cache.isResident(4));
+  CHECK(!cache.isResident(3));
+  CHECK_EQ(cache.getMisses(), 2);
+}
+
+// A miss downloads at most the scan limit; the user is still found on a
+// later attempt, once the scan has reached it
+static void testMissScanBounded() {
+  R503_Emulator emulator;
+  emulator.addModule();
+  R503_Fingerprint finger(&emulator);
+  CHECK(finger.begin(57600));
+  
+  MemoryStore store;
+  fillStore(emulator, finger, store, 30);
+  R503_TemplateCache cache(&finger, &store);
+  CHECK(cache.begin(0, 1));
+  cache.setMissScanLimit(8);
+  
+  uint8_t attempts = 0;
+  bool found = false;
+  while (!found && attempts < 5) {
+    uint16_t before = store.getReads();
+    found = identifyAs(emulator, finger, cache, 20);
+    CHECK(store.getReads() - before <= 8);
+    attempts++;
+  }
+  CHECK(found);
+  CHECK_EQ(attempts, 3);
+  CHECK(cache.isResident(20));
+}
+
+int main() {
+  testNewInstallNotFirstVictim();
+  testMissScanBounded();
+  return checkResult("test_cache");
+}
@@ -0,0 +1,137 @@
+/*
+ * test_dedup - duplicate handling against R503_Emulator
+ *
+ * A rejected enrollment must be told apart from other failures, and a
+ * compaction pass must only delete duplicates when asked to.
+ *
+ * Build from the library root (or run extras/linux/tests/run.sh):
+ *   g++ -std=c++11 -O2 -Iextras/linux -Isrc extras/linux/tests/test_dedup.cpp \
+ *       extras/linux/Arduino.cpp src/R503_*.cpp -o test_dedup
+ */
+
+#include <Arduino.h>
+#include "R503_Fingerprint.h"
+#include "R503_Library.h"
+#include "R503_Emulator.h"
+#include "check.h"
+
+static uint16_t handlerCalls = 0;
+static uint16_t lastKept = 0;
+static uint16_t lastDuplicate = 0;
+
+static void fillFeatures(uint8_t *features, uint8_t seed) {
+  for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+    features[i] = (uint8_t)(i * 31 + seed * 97);
+  }
+}
+
+static void onDuplicate(uint16_t keptID, uint16_t duplicateID) {
+  handlerCalls++;
+  lastKept = keptID;
+  lastDuplicate = duplicateID;
+}
+
+static void runCompaction(R503_Library &library) {
+  for (uint16_t steps = 0; library.compactStep(); steps++) {
+    if (steps > 1000) break;
+  }
+}
+
+// REJECT fails with its own error code and names the slot already in use
+static void testEnrollReject() {
+  R503_Emulator emulator;
+  int8_t module = emulator.addModule();
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  fillFeatures(features, 1);
+  emulator.enrollDirect(module, 3, features);
+  emulator.placeFinger(module, features);
+  
+  R503_Fingerprint finger(&emulator);
+  CHECK(finger.begin(57600));
+  finger.setEnrollDedup(R503_DEDUP_REJECT);
+  
+  CHECK(!finger.enrollFingerprint(7, 2));
+  CHECK_EQ(finger.getLastError(), R503_ERR_DUPLICATE);
+  CHECK_EQ(finger.getEnrolledID(), 3);
+  
+  uint16_t count = 0;
+  CHECK(finger.getTemplateCount(count));
+  CHECK_EQ(count, 1);
+}
+
+// Slot 2 is an exact copy of slot 0 and wins every search, slot 4 a weaker
+// one that the report pass must still find behind it
+static void fillLibrary(R503_Emulator &emulator, int8_t module) {
+  uint8_t a[R503_EMU_TEMPLATE_SIZE];
+  uint8_t b[R503_EMU_TEMPLATE_SIZE];
+  uint8_t near[R503_EMU_TEMPLATE_SIZE];
+  fillFeatures(a, 1);
+  fillFeatures(b, 2);
+  fillFeatures(near, 1);
+  for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i += 4) {
+    near[i] ^= 0x55;
+  }
+  
+  emulator.enrollDirect(module, 0, a);
+  emulator.enrollDirect(module, 1, b);
+  emulator.enrollDirect(module, 2, a);
+  emulator.enrollDirect(module, 4, near);
+}
+
+static void testCompactionReportsOnly() {
+  R503_Emulator emulator;
+  int8_t module = emulator.addModule();
+  fillLibrary(emulator, module);
+  
+  R503_Fingerprint finger(&emulator);
+  CHECK(finger.begin(57600));
+  R503_Library library(&finger);
+  CHECK(library.refresh());
+  library.setDuplicateHandler(onDuplicate);
+  
+  handlerCalls = 0;
+  library.startCompaction();
+  runCompaction(library);
+  
+  CHECK_EQ(library.getDuplicatesFound(), 2);
+  CHECK_EQ(library.getDuplicatesRemoved(), 0);
+  CHECK_EQ(handlerCalls, 2);
+  CHECK_EQ(lastKept, 0);
+  CHECK_EQ(lastDuplicate, 4);
+  
+  uint16_t count = 0;
+  CHECK(finger.getTemplateCount(count));
+  CHECK_EQ(count, 4);
+  CHECK(library.isOccupied(2));
+  CHECK(library.isOccupied(4));
+}
+
+static void testCompactionRemoves() {
+  R503_Emulator emulator;
+  int8_t module = emulator.addModule();
+  fillLibrary(emulator, module);
+  
+  R503_Fingerprint finger(&emulator);
+  CHECK(finger.begin(57600));
+  R503_Library library(&finger);
+  CHECK(library.refresh());
+  
+  library.startCompaction(R503_LIBRARY_MERGE_SCORE, true);
+  runCompaction(library);
+  
+  CHECK_EQ(library.getDuplicatesFound(), 2);
+  CHECK_EQ(library.getDuplicatesRemoved(), 2);
+  
+  uint16_t count = 0;
+  CHECK(finger.getTemplateCount(count));
+  CHECK_EQ(count, 2);
+  CHECK(!library.isOccupied(2));
+  CHECK(!library.isOccupied(4));
+}
+
+int main() {
+  testEnrollReject();
+  testCompactionReportsOnly();
+  testCompactionRemoves();
+  return checkResult("test_dedup");
+}
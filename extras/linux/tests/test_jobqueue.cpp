@@ -0,0 +1,82 @@
+/*
+ * test_jobqueue - R503_JobQueue preemption against R503_Emulator
+ *
+ * A job that fails after an earlier preemption, without talking to the
+ * module again, must complete rather than be requeued as preempted.
+ *
+ * Build from the library root (or run extras/linux/tests/run.sh):
+ *   g++ -std=c++11 -O2 -Iextras/linux -Isrc extras/linux/tests/test_jobqueue.cpp \
+ *       extras/linux/Arduino.cpp src/R503_*.cpp -o test_jobqueue
+ */
+
+#include <Arduino.h>
+#include "R503_Fingerprint.h"
+#include "R503_JobQueue.h"
+#include "R503_Emulator.h"
+#include "check.h"
+
+#define PRIORITY_LOW 1
+#define PRIORITY_HIGH 10
+
+static bool urgentSubmitted = false;
+static uint8_t backgroundRuns = 0;
+static uint8_t urgentRuns = 0;
+static uint8_t completions = 0;
+static bool urgentResult = true;
+
+// A slow search that gets preempted on its first run
+static bool backgroundJob(R503_Fingerprint *finger, R503_Job &job) {
+  (void)job;
+  backgroundRuns++;
+  uint16_t fingerID;
+  uint16_t score;
+  bool found = finger->searchLibrary(R503_CHARBUFFER1, 0, R503_EMU_LIBRARY_SIZE, fingerID, score);
+  return found || finger->getLastConfirmationCode() == R503_NOTFOUND;
+}
+
+// Fails before sending anything, e.g. on a bad argument
+static bool urgentJob(R503_Fingerprint *finger, R503_Job &job) {
+  (void)finger;
+  (void)job;
+  urgentRuns++;
+  return false;
+}
+
+static void requests(R503_JobQueue *queue) {
+  if (!urgentSubmitted) {
+    urgentSubmitted = true;
+    queue->submit(PRIORITY_HIGH, urgentJob);
+  }
+}
+
+static void onDone(const R503_Job &job, bool success) {
+  completions++;
+  if (job.priority == PRIORITY_HIGH) urgentResult = success;
+}
+
+int main() {
+  R503_Emulator emulator;
+  emulator.addModule();
+  emulator.setSearchCostPerPage(2000);
+  
+  R503_Fingerprint finger(&emulator);
+  CHECK(finger.begin(57600));
+  
+  R503_JobQueue jobs(&finger);
+  jobs.setRequestSource(requests);
+  jobs.setCompletionHandler(onDone);
+  CHECK(jobs.submit(PRIORITY_LOW, backgroundJob) != 0);
+  
+  for (uint8_t i = 0; i < 10 && jobs.getPendingCount() > 0; i++) {
+    jobs.poll();
+  }
+  
+  CHECK_EQ(jobs.getPendingCount(), 0);
+  CHECK_EQ(jobs.getPreemptionCount(), 1);
+  CHECK_EQ(urgentRuns, 1);
+  CHECK(!urgentResult);
+  CHECK_EQ(backgroundRuns, 2);
+  CHECK_EQ(completions, 2);
+  
+  return checkResult("test_jobqueue");
+}
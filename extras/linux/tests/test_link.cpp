@@ -0,0 +1,84 @@
+/*
+ * test_link - command transport against R503_Emulator
+ *
+ * A reply that comes after its command timed out must not be taken as the
+ * answer to the next command.
+ *
+ * Build from the library root (or run extras/linux/tests/run.sh):
+ *   g++ -std=c++11 -O2 -Iextras/linux -Isrc extras/linux/tests/test_link.cpp \
+ *       extras/linux/Arduino.cpp src/R503_*.cpp -o test_link
+ */
+
+#include <Arduino.h>
+#include "R503_Fingerprint.h"
+#include "R503_Emulator.h"
+#include "check.h"
+
+static void fillFeatures(uint8_t *features, uint8_t seed) {
+  for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+    features[i] = (uint8_t)(i * 31 + seed * 97);
+  }
+}
+
+// STORE outlives its deadline: the call fails, but the commands after it
+// still get their own replies
+static void testLateAckAfterFailure() {
+  R503_Emulator emulator;
+  int8_t module = emulator.addModule();
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  fillFeatures(features, 1);
+  emulator.enrollDirect(module, 1, features);
+  
+  R503_Fingerprint finger(&emulator);
+  CHECK(finger.begin(57600));
+  CHECK(finger.loadModel(R503_CHARBUFFER1, 1));
+  
+  emulator.setServiceTime(R503_STORE, R503_DEFAULT_TIMEOUT + 500);
+  CHECK(!finger.storeModel(R503_CHARBUFFER1, 5));
+  CHECK_EQ(finger.getLastError(), R503_ERR_TIMEOUT);
+  
+  // The module did store the template, which the count must show
+  uint16_t count = 0;
+  CHECK(finger.getTemplateCount(count));
+  CHECK_EQ(finger.getLastConfirmationCode(), R503_OK);
+  CHECK_EQ(count, 2);
+  
+  R503_SystemParams params;
+  CHECK(finger.readSystemParameters(params));
+  CHECK_EQ(params.librarySize, R503_EMU_LIBRARY_SIZE);
+  CHECK(finger.handshake());
+}
+
+// A retry succeeds after a timeout: the second ACK is still owed and is
+// read off before the next command
+static void testLateAckAfterRetry() {
+  R503_Emulator emulator;
+  int8_t module = emulator.addModule();
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  fillFeatures(features, 2);
+  emulator.enrollDirect(module, 1, features);
+  emulator.enrollDirect(module, 2, features);
+  
+  R503_Fingerprint finger(&emulator);
+  CHECK(finger.begin(57600));
+  
+  emulator.setServiceTime(R503_LOADCHAR, 300);
+  CHECK(finger.loadModel(R503_CHARBUFFER1, 1));
+  CHECK(finger.getLinkStats().timeouts > 0);
+  emulator.setServiceTime(R503_LOADCHAR, 0);
+  
+  uint16_t count = 0;
+  CHECK(finger.getTemplateCount(count));
+  CHECK_EQ(count, 2);
+  
+  uint16_t fingerID = 0;
+  uint16_t score = 0;
+  CHECK(finger.searchLibrary(R503_CHARBUFFER1, 0, R503_EMU_LIBRARY_SIZE, fingerID, score));
+  CHECK_EQ(fingerID, 1);
+}
+
+int main() {
+  testLateAckAfterFailure();
+  testLateAckAfterRetry();
+  return checkResult("test_link");
+}
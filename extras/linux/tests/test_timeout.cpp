@@ -0,0 +1,72 @@
+/*
+ * test_timeout - per-opcode deadlines of R503_TimeoutModel
+ *
+ * Flash writes get one attempt, so fast writes must not teach the model a
+ * deadline that a slow write then overruns.
+ *
+ * Build from the library root (or run extras/linux/tests/run.sh):
+ *   g++ -std=c++11 -O2 -Iextras/linux -Isrc extras/linux/tests/test_timeout.cpp \
+ *       extras/linux/Arduino.cpp src/R503_*.cpp -o test_timeout
+ */
+
+#include <Arduino.h>
+#include "R503_Fingerprint.h"
+#include "R503_Emulator.h"
+#include "check.h"
+
+static void testWriteFloor() {
+  R503_TimeoutModel model;
+  for (uint8_t i = 0; i < 20; i++) {
+    model.record(R503_STORE, 0, 10, R503_OK);
+    model.record(R503_WRITENOTEPAD, 0, 10, R503_OK);
+    model.record(R503_LOADCHAR, 0, 10, R503_OK);
+  }
+  CHECK_EQ(model.deadline(R503_STORE), R503_TIMEOUT_WRITE_FLOOR);
+  CHECK_EQ(model.deadline(R503_WRITENOTEPAD), R503_TIMEOUT_WRITE_FLOOR);
+  CHECK(model.deadline(R503_LOADCHAR) < 100);
+  
+  // A lower ceiling does not cut writes short
+  model.setLimits(R503_TIMEOUT_FLOOR, 500);
+  CHECK_EQ(model.deadline(R503_DELETCHAR), R503_TIMEOUT_WRITE_FLOOR);
+  CHECK_EQ(model.deadline(R503_EMPTY), R503_TIMEOUT_WRITE_FLOOR);
+  
+  // Slow writes still raise it
+  model.setLimits(R503_TIMEOUT_FLOOR, 10000);
+  for (uint8_t i = 0; i < 20; i++) {
+    model.record(R503_STORE, 0, 3000, R503_OK);
+  }
+  CHECK(model.deadline(R503_STORE) > 3000);
+}
+
+// After many fast stores a slow one still succeeds
+static void testSlowStore() {
+  R503_Emulator emulator;
+  int8_t module = emulator.addModule();
+  uint8_t features[R503_EMU_TEMPLATE_SIZE];
+  for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+    features[i] = (uint8_t)(i * 7);
+  }
+  emulator.enrollDirect(module, 0, features);
+  
+  R503_Fingerprint finger(&emulator);
+  CHECK(finger.begin(57600));
+  CHECK(finger.loadModel(R503_CHARBUFFER1, 0));
+  
+  emulator.setServiceTime(R503_STORE, 5);
+  for (uint16_t page = 1; page <= 8; page++) {
+    CHECK(finger.storeModel(R503_CHARBUFFER1, page));
+  }
+  
+  emulator.setServiceTime(R503_STORE, 1500);
+  CHECK(finger.storeModel(R503_CHARBUFFER1, 9));
+  
+  uint16_t count = 0;
+  CHECK(finger.getTemplateCount(count));
+  CHECK_EQ(count, 10);
+}
+
+int main() {
+  testWriteFloor();
+  testSlowStore();
+  return checkResult("test_timeout");
+}
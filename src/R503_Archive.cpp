@@ -0,0 +1,70 @@
+// R503_Archive.cpp
+#include "R503_Archive.h"
+#include "R503_Frame.h"
+
+static const uint8_t archiveMagic[4] = { 'R', '5', '0', '3' };
+
+static void putU16(uint8_t *out, uint16_t value) {
+  out[0] = value >> 8;
+  out[1] = value & 0xFF;
+}
+
+static void putU32(uint8_t *out, uint32_t value) {
+  putU16(out, value >> 16);
+  putU16(out + 2, value & 0xFFFF);
+}
+
+static uint16_t getU16(const uint8_t *in) {
+  return (in[0] << 8) | in[1];
+}
+
+static uint32_t getU32(const uint8_t *in) {
+  return ((uint32_t)getU16(in) << 16) | getU16(in + 2);
+}
+
+// Covers the user ID as well as the template
+static uint16_t recordChecksum(const uint8_t *record, uint16_t tplLength) {
+  uint16_t sum = R503_Frame::checksum(record + 8, 4);
+  return R503_Frame::checksum(record + R503_ARCHIVE_HEADER_SIZE, tplLength, sum);
+}
+
+uint16_t R503_Archive::pack(const uint8_t *tpl, uint16_t length, uint32_t userID,
+                            uint8_t *out, uint16_t maxOut) {
+  uint32_t total = R503_ARCHIVE_HEADER_SIZE + length + 2;
+  if (length > R503_ARCHIVE_MAX_TEMPLATE || total > maxOut) return 0;
+  
+  memcpy(out, archiveMagic, sizeof(archiveMagic));
+  out[4] = R503_ARCHIVE_VERSION;
+  out[5] = 0;
+  putU16(out + 6, length);
+  putU32(out + 8, userID);
+  memcpy(out + R503_ARCHIVE_HEADER_SIZE, tpl, length);
+  putU16(out + R503_ARCHIVE_HEADER_SIZE + length, recordChecksum(out, length));
+  
+  return total;
+}
+
+uint32_t R503_Archive::recordLength(const uint8_t *header) {
+  if (memcmp(header, archiveMagic, sizeof(archiveMagic)) != 0) return 0;
+  if (header[4] != R503_ARCHIVE_VERSION) return 0;
+  return R503_ARCHIVE_HEADER_SIZE + getU16(header + 6) + 2;
+}
+
+uint8_t R503_Archive::unpack(const uint8_t *record, uint32_t length, uint8_t *tpl,
+                             uint16_t maxLength, uint16_t &tplLength, uint32_t &userID) {
+  if (length < R503_ARCHIVE_HEADER_SIZE) return R503_ARCHIVE_ERR_LENGTH;
+  uint32_t total = recordLength(record);
+  if (total == 0) return R503_ARCHIVE_ERR_FORMAT;
+  if (total != length) return R503_ARCHIVE_ERR_LENGTH;
+  
+  uint16_t size = getU16(record + 6);
+  if (size > maxLength) return R503_ARCHIVE_ERR_SPACE;
+  if (recordChecksum(record, size) != getU16(record + R503_ARCHIVE_HEADER_SIZE + size)) {
+    return R503_ARCHIVE_ERR_CHECKSUM;
+  }
+  
+  memcpy(tpl, record + R503_ARCHIVE_HEADER_SIZE, size);
+  tplLength = size;
+  userID = getU32(record + 8);
+  return R503_ARCHIVE_OK;
+}
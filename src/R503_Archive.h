@@ -0,0 +1,48 @@
+// R503_Archive.h
+#ifndef R503_ARCHIVE_H
+#define R503_ARCHIVE_H
+
+#include "R503_Fingerprint.h"
+
+// Record layout: magic "R503" (4), version (1), reserved (1), template
+// length (2), user ID (4), template, checksum (2); big-endian like the
+// module's own frames
+#define R503_ARCHIVE_HEADER_SIZE 12
+#define R503_ARCHIVE_VERSION 1
+#define R503_ARCHIVE_MAX_TEMPLATE 1024
+#define R503_ARCHIVE_MAX_RECORD (R503_ARCHIVE_HEADER_SIZE + R503_ARCHIVE_MAX_TEMPLATE + 2)
+
+// Results of unpack()
+#define R503_ARCHIVE_OK 0
+#define R503_ARCHIVE_ERR_FORMAT 1    // bad magic or unsupported version
+#define R503_ARCHIVE_ERR_LENGTH 2    // truncated, or lengths disagree
+#define R503_ARCHIVE_ERR_CHECKSUM 3
+#define R503_ARCHIVE_ERR_SPACE 4     // output buffer too small
+
+// Archive records for module templates (the bytes of uploadCharacteristics,
+// as kept in .tpl files by R503_FsTemplateStore), for backing up a gallery
+// and restoring it to R503 modules.
+//
+// The R503 template encoding is proprietary and the module has no command
+// that accepts minutiae, so the template is stored as it is, together with
+// the user ID and a checksum over both. The records are only readable by
+// this class and only useful to R503 (or compatible) modules; this is not
+// a migration format to or from other vendors.
+//
+// Records are self-delimiting, so a gallery can be stored as one stream of
+// concatenated records; recordLength() sizes the next one from its header.
+class R503_Archive {
+public:
+  // Returns the record size, or 0 if out is too small
+  static uint16_t pack(const uint8_t *tpl, uint16_t length, uint32_t userID,
+                       uint8_t *out, uint16_t maxOut);
+  
+  static uint8_t unpack(const uint8_t *record, uint32_t length, uint8_t *tpl,
+                        uint16_t maxLength, uint16_t &tplLength, uint32_t &userID);
+  
+  // Total record length from the first R503_ARCHIVE_HEADER_SIZE bytes, or 0
+  // if not a record
+  static uint32_t recordLength(const uint8_t *header);
+};
+
+#endif // R503_ARCHIVE_H
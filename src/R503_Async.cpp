@@ -0,0 +1,390 @@
+// R503_Async.cpp
+#include "R503_Async.h"
+
+#if defined(__linux__) && !defined(ARDUINO) && defined(__cpp_impl_coroutine)
+
+#include <poll.h>
+
+// R503_CancelToken ---------------------------------------------------------
+
+R503_CancelToken::R503_CancelToken(R503_CancelToken *parent) {
+  this->parent = parent;
+  this->cancelled = false;
+  this->hasDeadline = false;
+  this->deadline = 0;
+}
+
+void R503_CancelToken::cancelAfter(uint32_t ms) {
+  deadline = millis() + ms;
+  hasDeadline = true;
+}
+
+bool R503_CancelToken::isCancelled() {
+  if (!cancelled && hasDeadline && (int32_t)(millis() - deadline) >= 0) {
+    cancelled = true;
+  }
+  if (!cancelled && parent && parent->isCancelled()) {
+    cancelled = true;
+  }
+  return cancelled;
+}
+
+// R503_Scheduler -----------------------------------------------------------
+
+R503_Scheduler::R503_Scheduler() {
+  this->busCount = 0;
+  this->waiterCount = 0;
+  this->timerCount = 0;
+  this->readyCount = 0;
+  this->resuming = 0;
+  this->nextTag = 1;
+  this->droppedResults = 0;
+  for (uint8_t i = 0; i < R503_ASYNC_MAX_WAITERS; i++) waiters[i].used = false;
+  for (uint8_t i = 0; i < R503_ASYNC_MAX_TIMERS; i++) timers[i].used = false;
+}
+
+bool R503_Scheduler::addBus(R503_Bus *bus, int fd) {
+  for (uint8_t i = 0; i < busCount; i++) {
+    if (buses[i].bus == bus) {
+      if (fd >= 0) buses[i].fd = fd;
+      return true;
+    }
+  }
+  if (busCount >= R503_ASYNC_MAX_BUSES) return false;
+  
+  buses[busCount].bus = bus;
+  buses[busCount].fd = fd;
+  busCount++;
+  return true;
+}
+
+bool R503_Scheduler::schedule(std::coroutine_handle<> handle) {
+  // A live workflow is ready, being resumed, or parked on one waiter or
+  // timer. Capping them all at the list size means a wakeup always fits;
+  // only new tasks can be refused.
+  if (readyCount + resuming + waiterCount + timerCount >= R503_ASYNC_MAX_READY) return false;
+  
+  ready[readyCount++] = handle;
+  return true;
+}
+
+bool R503_Scheduler::submit(R503_Bus *bus, uint8_t module, const uint8_t *command, uint8_t length,
+                            std::coroutine_handle<> handle, R503_BusResult *result,
+                            R503_CancelToken *token) {
+  if (waiterCount >= R503_ASYNC_MAX_WAITERS) return false;
+  
+  uint32_t tag = nextTag++;
+  if (nextTag == 0) nextTag = 1;
+  if (!bus->submit(module, command, length, tag)) return false;
+  
+  for (uint8_t i = 0; i < R503_ASYNC_MAX_WAITERS; i++) {
+    if (waiters[i].used) continue;
+    waiters[i].used = true;
+    waiters[i].tag = tag;
+    waiters[i].handle = handle;
+    waiters[i].result = result;
+    waiters[i].token = token;
+    waiterCount++;
+    break;
+  }
+  
+  // Send straight away rather than on the next pass
+  bus->poll();
+  return true;
+}
+
+bool R503_Scheduler::addTimer(uint32_t ms, std::coroutine_handle<> handle, bool *elapsed,
+                              R503_CancelToken *token) {
+  for (uint8_t i = 0; i < R503_ASYNC_MAX_TIMERS; i++) {
+    if (timers[i].used) continue;
+    timers[i].used = true;
+    timers[i].due = millis() + ms;
+    timers[i].handle = handle;
+    timers[i].elapsed = elapsed;
+    timers[i].token = token;
+    timerCount++;
+    return true;
+  }
+  return false;
+}
+
+void R503_Scheduler::collect() {
+  for (uint8_t b = 0; b < busCount; b++) {
+    R503_Bus *bus = buses[b].bus;
+    bus->poll();
+    
+    R503_BusResult result;
+    while (bus->getResult(result)) {
+      bool matched = false;
+      for (uint8_t i = 0; i < R503_ASYNC_MAX_WAITERS; i++) {
+        Waiter &w = waiters[i];
+        if (!w.used || w.tag != result.tag) continue;
+        *w.result = result;
+        w.used = false;
+        waiterCount--;
+        schedule(w.handle);
+        matched = true;
+        break;
+      }
+      
+      // Replies to cancelled awaits arrive after their waiter is gone
+      if (!matched) droppedResults++;
+    }
+  }
+}
+
+void R503_Scheduler::expire() {
+  for (uint8_t i = 0; i < R503_ASYNC_MAX_WAITERS && waiterCount > 0; i++) {
+    Waiter &w = waiters[i];
+    if (!w.used || !w.token || !w.token->isCancelled()) continue;
+    
+    memset(w.result, 0, sizeof(R503_BusResult));
+    w.result->tag = w.tag;
+    w.result->confirmCode = R503_ASYNC_CANCELLED;
+    w.used = false;
+    waiterCount--;
+    schedule(w.handle);
+  }
+  
+  uint32_t now = millis();
+  for (uint8_t i = 0; i < R503_ASYNC_MAX_TIMERS && timerCount > 0; i++) {
+    Timer &t = timers[i];
+    if (!t.used) continue;
+    
+    bool due = (int32_t)(now - t.due) >= 0;
+    if (!due && !(t.token && t.token->isCancelled())) continue;
+    
+    *t.elapsed = due;
+    t.used = false;
+    timerCount--;
+    schedule(t.handle);
+  }
+}
+
+void R503_Scheduler::resumeReady() {
+  // Coroutines resumed here may schedule others; those run on the next pass
+  std::coroutine_handle<> batch[R503_ASYNC_MAX_READY];
+  uint8_t count = readyCount;
+  memcpy(batch, ready, sizeof(batch[0]) * count);
+  readyCount = 0;
+  resuming = count;
+  
+  for (uint8_t i = 0; i < count; i++) {
+    batch[i].resume();
+    resuming--;
+  }
+}
+
+void R503_Scheduler::idle(uint32_t maxWait) {
+  uint32_t wait = maxWait;
+  
+  // Outstanding commands need the buses polled for replies and deadlines
+  if (waiterCount > 0 && wait > R503_ASYNC_TICK) wait = R503_ASYNC_TICK;
+  
+  uint32_t now = millis();
+  for (uint8_t i = 0; i < R503_ASYNC_MAX_TIMERS; i++) {
+    if (!timers[i].used) continue;
+    int32_t left = (int32_t)(timers[i].due - now);
+    if (left < 0) left = 0;
+    if ((uint32_t)left < wait) wait = left;
+  }
+  if (wait == 0) return;
+  
+  struct pollfd fds[R503_ASYNC_MAX_BUSES];
+  nfds_t count = 0;
+  for (uint8_t i = 0; i < busCount; i++) {
+    if (buses[i].fd < 0) continue;
+    fds[count].fd = buses[i].fd;
+    fds[count].events = POLLIN;
+    fds[count].revents = 0;
+    count++;
+  }
+  poll(fds, count, wait);
+}
+
+bool R503_Scheduler::runOnce(uint32_t maxWait) {
+  collect();
+  expire();
+  
+  if (readyCount > 0) {
+    resumeReady();
+    return true;
+  }
+  if (waiterCount == 0 && timerCount == 0) return false;
+  
+  idle(maxWait);
+  return true;
+}
+
+void R503_Scheduler::run() {
+  while (runOnce()) {
+  }
+}
+
+// Awaiters -----------------------------------------------------------------
+
+R503_CommandAwaiter::R503_CommandAwaiter(R503_Scheduler &scheduler, R503_Bus &bus, uint8_t module,
+                                         const uint8_t *command, uint8_t length,
+                                         R503_CancelToken *token)
+  : scheduler(scheduler), bus(bus) {
+  this->module = module;
+  this->length = min(length, (uint8_t)R503_BUS_MAX_COMMAND);
+  memcpy(this->command, command, this->length);
+  this->token = token;
+  memset(&result, 0, sizeof(result));
+}
+
+bool R503_CommandAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  result.opcode = command[0];
+  
+  if (token && token->isCancelled()) {
+    result.confirmCode = R503_ASYNC_CANCELLED;
+    return false;
+  }
+  if (!scheduler.submit(&bus, module, command, length, handle, &result, token)) {
+    // Queue full; not a cancellation, so the caller can tell the two apart
+    result.confirmCode = R503_ASYNC_NO_SLOT;
+    return false;
+  }
+  return true;
+}
+
+R503_SearchResult R503_SearchAwaiter::await_resume() {
+  R503_SearchResult found;
+  found.confirmCode = result.confirmCode;
+  found.pageID = 0xFFFF;
+  found.score = 0;
+  
+  if (result.confirmCode == R503_OK && result.length >= 5) {
+    found.pageID = (result.data[1] << 8) | result.data[2];
+    found.score = (result.data[3] << 8) | result.data[4];
+  }
+  return found;
+}
+
+R503_SleepAwaiter::R503_SleepAwaiter(R503_Scheduler &scheduler, uint32_t ms, R503_CancelToken *token)
+  : scheduler(scheduler) {
+  this->ms = ms;
+  this->token = token;
+  this->elapsed = (ms == 0);
+}
+
+bool R503_SleepAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  if (token && token->isCancelled()) return false;
+  return scheduler.addTimer(ms, handle, &elapsed, token);
+}
+
+// R503_AsyncSensor ---------------------------------------------------------
+
+R503_AsyncSensor::R503_AsyncSensor(R503_Scheduler &scheduler, R503_Bus &bus, uint8_t module)
+  : scheduler(scheduler), bus(bus) {
+  this->module = module;
+  scheduler.addBus(&bus);
+}
+
+R503_CommandAwaiter R503_AsyncSensor::command(const uint8_t *command, uint8_t length,
+                                              R503_CancelToken *token) {
+  return R503_CommandAwaiter(scheduler, bus, module, command, length, token);
+}
+
+R503_CodeAwaiter R503_AsyncSensor::captureImage(R503_CancelToken *token) {
+  uint8_t command[1] = { R503_GENIMG };
+  return R503_CodeAwaiter(scheduler, bus, module, command, 1, token);
+}
+
+R503_CodeAwaiter R503_AsyncSensor::image2Tz(uint8_t slot, R503_CancelToken *token) {
+  uint8_t command[2] = { R503_IMG2TZ, slot };
+  return R503_CodeAwaiter(scheduler, bus, module, command, 2, token);
+}
+
+R503_CodeAwaiter R503_AsyncSensor::createModel(R503_CancelToken *token) {
+  uint8_t command[1] = { R503_REGMODEL };
+  return R503_CodeAwaiter(scheduler, bus, module, command, 1, token);
+}
+
+R503_CodeAwaiter R503_AsyncSensor::storeModel(uint16_t pageID, uint8_t slot, R503_CancelToken *token) {
+  uint8_t command[4] = {
+    R503_STORE, slot, (uint8_t)(pageID >> 8), (uint8_t)(pageID & 0xFF)
+  };
+  return R503_CodeAwaiter(scheduler, bus, module, command, 4, token);
+}
+
+R503_CodeAwaiter R503_AsyncSensor::deleteModel(uint16_t pageID, uint16_t count, R503_CancelToken *token) {
+  uint8_t command[5] = {
+    R503_DELETCHAR,
+    (uint8_t)(pageID >> 8), (uint8_t)(pageID & 0xFF),
+    (uint8_t)(count >> 8), (uint8_t)(count & 0xFF)
+  };
+  return R503_CodeAwaiter(scheduler, bus, module, command, 5, token);
+}
+
+R503_SearchAwaiter R503_AsyncSensor::search(uint16_t startPage, uint16_t count, uint8_t slot,
+                                            R503_CancelToken *token) {
+  uint8_t command[6] = {
+    R503_SEARCH, slot,
+    (uint8_t)(startPage >> 8), (uint8_t)(startPage & 0xFF),
+    (uint8_t)(count >> 8), (uint8_t)(count & 0xFF)
+  };
+  return R503_SearchAwaiter(scheduler, bus, module, command, 6, token);
+}
+
+R503_CodeAwaiter R503_AsyncSensor::ledControl(uint8_t control, uint8_t speed, uint8_t color,
+                                              uint8_t times, R503_CancelToken *token) {
+  uint8_t command[5] = { R503_AURALEDCONFIG, control, speed, color, times };
+  return R503_CodeAwaiter(scheduler, bus, module, command, 5, token);
+}
+
+R503_SleepAwaiter R503_AsyncSensor::sleep(uint32_t ms, R503_CancelToken *token) {
+  return R503_SleepAwaiter(scheduler, ms, token);
+}
+
+R503_Task<uint8_t> R503_AsyncSensor::captureFinger(uint8_t slot, R503_CancelToken *token) {
+  // Poll for a finger until one arrives or the token is cancelled
+  uint8_t code;
+  while ((code = co_await captureImage(token)) == R503_NOFINGER) {
+    if (!co_await sleep(R503_ASYNC_CAPTURE_RETRY, token)) co_return R503_ASYNC_CANCELLED;
+  }
+  if (code != R503_OK) co_return code;
+  
+  co_return co_await image2Tz(slot, token);
+}
+
+R503_Task<R503_SearchResult> R503_AsyncSensor::identify(uint16_t count, R503_CancelToken *token) {
+  R503_SearchResult found;
+  found.pageID = 0xFFFF;
+  found.score = 0;
+  
+  found.confirmCode = co_await captureFinger(R503_CHARBUFFER1, token);
+  if (found.confirmCode != R503_OK) co_return found;
+  
+  found = co_await search(0, count, R503_CHARBUFFER1, token);
+  
+  if (found.confirmCode == R503_OK || found.confirmCode == R503_NOTFOUND) {
+    uint8_t color = (found.confirmCode == R503_OK) ? R503_LED_BLUE : R503_LED_RED;
+    co_await ledControl(R503_LED_FLASHING, 0x40, color, 2, token);
+  }
+  co_return found;
+}
+
+R503_Task<uint8_t> R503_AsyncSensor::enroll(uint16_t pageID, R503_CancelToken *token) {
+  uint8_t code = co_await captureFinger(R503_CHARBUFFER1, token);
+  if (code != R503_OK) co_return code;
+  
+  // Wait for the finger to be lifted, but not forever
+  R503_CancelToken lift(token);
+  lift.cancelAfter(R503_ASYNC_LIFT_WAIT);
+  while (co_await captureImage(&lift) == R503_OK) {
+    if (!co_await sleep(R503_ASYNC_CAPTURE_RETRY, &lift)) break;
+  }
+  if (token && token->isCancelled()) co_return R503_ASYNC_CANCELLED;
+  
+  code = co_await captureFinger(R503_CHARBUFFER2, token);
+  if (code != R503_OK) co_return code;
+  
+  code = co_await createModel(token);
+  if (code != R503_OK) co_return code;
+  
+  co_return co_await storeModel(pageID, R503_CHARBUFFER1, token);
+}
+
+#endif // __cpp_impl_coroutine
@@ -0,0 +1,279 @@
+// R503_Async.h
+#ifndef R503_ASYNC_H
+#define R503_ASYNC_H
+
+// Host builds with C++20 coroutines only (g++ -std=c++20, extras/linux on
+// the include path)
+#if defined(__linux__) && !defined(ARDUINO) && defined(__cpp_impl_coroutine)
+
+#include <Arduino.h>
+#include <coroutine>
+#include <exception>
+#include "R503_Fingerprint.h"
+#include "R503_Bus.h"
+
+#define R503_ASYNC_MAX_BUSES 8
+#define R503_ASYNC_MAX_READY 64
+
+// Every live workflow may be parked on a command or a sleep at once
+#define R503_ASYNC_MAX_WAITERS R503_ASYNC_MAX_READY
+#define R503_ASYNC_MAX_TIMERS R503_ASYNC_MAX_READY
+#define R503_ASYNC_TICK 2
+#define R503_ASYNC_CAPTURE_RETRY 50
+#define R503_ASYNC_LIFT_WAIT 3000
+
+// Confirm code reported by an await that was cancelled or timed out
+#define R503_ASYNC_CANCELLED 0xFE
+
+// Confirm code reported when the module's bus queue was full
+#define R503_ASYNC_NO_SLOT 0xFD
+
+// Cancellation flag shared by a workflow and everything it awaits. A token
+// with a parent is cancelled when the parent is, so a per-step timeout can
+// nest inside a per-request one.
+class R503_CancelToken {
+public:
+  R503_CancelToken(R503_CancelToken *parent = NULL);
+  
+  void cancel() { cancelled = true; }
+  void cancelAfter(uint32_t ms);
+  bool isCancelled();
+
+private:
+  R503_CancelToken *parent;
+  bool cancelled;
+  bool hasDeadline;
+  uint32_t deadline;
+};
+
+struct R503_SearchResult {
+  uint8_t confirmCode;
+  uint16_t pageID;
+  uint16_t score;
+};
+
+// Lazily started coroutine returning T. co_await on a task runs it and
+// resumes the caller when it returns; top-level tasks are driven by
+// R503_Scheduler::start()/run().
+template <typename T>
+class R503_Task {
+public:
+  struct promise_type {
+    T value;
+    std::coroutine_handle<> continuation;
+    
+    R503_Task get_return_object() {
+      return R503_Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+        std::coroutine_handle<> next = h.promise().continuation;
+        return next ? next : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    
+    void return_value(T result) { value = result; }
+    void unhandled_exception() { std::terminate(); }
+  };
+  
+  R503_Task() : handle(nullptr) {}
+  explicit R503_Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+  R503_Task(R503_Task &&other) : handle(other.handle) { other.handle = nullptr; }
+  R503_Task &operator=(R503_Task &&other) {
+    if (this != &other) {
+      if (handle) handle.destroy();
+      handle = other.handle;
+      other.handle = nullptr;
+    }
+    return *this;
+  }
+  R503_Task(const R503_Task &) = delete;
+  R503_Task &operator=(const R503_Task &) = delete;
+  ~R503_Task() {
+    if (handle) handle.destroy();
+  }
+  
+  bool isDone() { return !handle || handle.done(); }
+  T getResult() { return handle.promise().value; }
+  std::coroutine_handle<> getHandle() { return handle; }
+  
+  bool await_ready() { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+    handle.promise().continuation = caller;
+    return handle;
+  }
+  T await_resume() { return handle.promise().value; }
+
+private:
+  std::coroutine_handle<promise_type> handle;
+};
+
+// Single-threaded event loop. Polls the registered buses, routes each reply
+// to the coroutine awaiting it, fires sleeps and cancellations, and sleeps
+// in poll() on the port fds when nothing is runnable.
+class R503_Scheduler {
+public:
+  R503_Scheduler();
+  
+  // fd lets idle waits block on the port; -1 for streams without one
+  bool addBus(R503_Bus *bus, int fd = -1);
+  
+  // Queues a task for the next pass; false when R503_ASYNC_MAX_READY
+  // workflows are already live
+  template <typename T>
+  bool start(R503_Task<T> &task) { return schedule(task.getHandle()); }
+  
+  template <typename T>
+  T run(R503_Task<T> &task) {
+    while (!start(task)) runOnce();
+    while (!task.isDone()) runOnce();
+    return task.getResult();
+  }
+  
+  // One pass of the loop; waits at most maxWait ms for I/O or timers.
+  // Returns false when nothing is pending
+  bool runOnce(uint32_t maxWait = 100);
+  
+  // Runs until every started task has finished
+  void run();
+  
+  // Used by the awaiters
+  bool schedule(std::coroutine_handle<> handle);
+  bool submit(R503_Bus *bus, uint8_t module, const uint8_t *command, uint8_t length,
+              std::coroutine_handle<> handle, R503_BusResult *result, R503_CancelToken *token);
+  bool addTimer(uint32_t ms, std::coroutine_handle<> handle, bool *elapsed, R503_CancelToken *token);
+  
+  uint32_t getDroppedResults() { return droppedResults; }
+
+private:
+  struct BusEntry {
+    R503_Bus *bus;
+    int fd;
+  };
+  
+  struct Waiter {
+    bool used;
+    uint32_t tag;
+    std::coroutine_handle<> handle;
+    R503_BusResult *result;
+    R503_CancelToken *token;
+  };
+  
+  struct Timer {
+    bool used;
+    uint32_t due;
+    std::coroutine_handle<> handle;
+    bool *elapsed;
+    R503_CancelToken *token;
+  };
+  
+  BusEntry buses[R503_ASYNC_MAX_BUSES];
+  uint8_t busCount;
+  Waiter waiters[R503_ASYNC_MAX_WAITERS];
+  uint8_t waiterCount;
+  Timer timers[R503_ASYNC_MAX_TIMERS];
+  uint8_t timerCount;
+  std::coroutine_handle<> ready[R503_ASYNC_MAX_READY];
+  uint8_t readyCount;
+  uint8_t resuming;
+  uint32_t nextTag;
+  uint32_t droppedResults;
+  
+  void collect();
+  void expire();
+  void resumeReady();
+  void idle(uint32_t maxWait);
+};
+
+// co_await yields the R503_BusResult of one command/ACK exchange
+class R503_CommandAwaiter {
+public:
+  R503_CommandAwaiter(R503_Scheduler &scheduler, R503_Bus &bus, uint8_t module,
+                      const uint8_t *command, uint8_t length, R503_CancelToken *token);
+  
+  bool await_ready() { return false; }
+  bool await_suspend(std::coroutine_handle<> handle);
+  R503_BusResult await_resume() { return result; }
+
+protected:
+  R503_Scheduler &scheduler;
+  R503_Bus &bus;
+  uint8_t module;
+  uint8_t command[R503_BUS_MAX_COMMAND];
+  uint8_t length;
+  R503_CancelToken *token;
+  R503_BusResult result;
+};
+
+// Same exchange, yielding only the confirmation code
+class R503_CodeAwaiter : public R503_CommandAwaiter {
+public:
+  using R503_CommandAwaiter::R503_CommandAwaiter;
+  uint8_t await_resume() { return result.confirmCode; }
+};
+
+class R503_SearchAwaiter : public R503_CommandAwaiter {
+public:
+  using R503_CommandAwaiter::R503_CommandAwaiter;
+  R503_SearchResult await_resume();
+};
+
+// co_await yields true if the full time elapsed, false if cancelled
+class R503_SleepAwaiter {
+public:
+  R503_SleepAwaiter(R503_Scheduler &scheduler, uint32_t ms, R503_CancelToken *token);
+  
+  bool await_ready() { return ms == 0; }
+  bool await_suspend(std::coroutine_handle<> handle);
+  bool await_resume() { return elapsed; }
+
+private:
+  R503_Scheduler &scheduler;
+  uint32_t ms;
+  R503_CancelToken *token;
+  bool elapsed;
+};
+
+// Awaitable counterpart of R503_Fingerprint for one module on a bus. Any
+// number of sensors can run workflows concurrently on one scheduler.
+// Cancelled awaits resume with R503_ASYNC_CANCELLED; the module still
+// finishes the command and its late reply is discarded. A command that
+// finds the module's bus queue full (R503_BUS_QUEUE_DEPTH) resumes at once
+// with R503_ASYNC_NO_SLOT.
+class R503_AsyncSensor {
+public:
+  R503_AsyncSensor(R503_Scheduler &scheduler, R503_Bus &bus, uint8_t module);
+  
+  R503_CommandAwaiter command(const uint8_t *command, uint8_t length, R503_CancelToken *token = NULL);
+  R503_CodeAwaiter captureImage(R503_CancelToken *token = NULL);
+  R503_CodeAwaiter image2Tz(uint8_t slot = R503_CHARBUFFER1, R503_CancelToken *token = NULL);
+  R503_CodeAwaiter createModel(R503_CancelToken *token = NULL);
+  R503_CodeAwaiter storeModel(uint16_t pageID, uint8_t slot = R503_CHARBUFFER1, R503_CancelToken *token = NULL);
+  R503_CodeAwaiter deleteModel(uint16_t pageID, uint16_t count = 1, R503_CancelToken *token = NULL);
+  R503_SearchAwaiter search(uint16_t startPage, uint16_t count, uint8_t slot = R503_CHARBUFFER1,
+                            R503_CancelToken *token = NULL);
+  R503_CodeAwaiter ledControl(uint8_t control, uint8_t speed, uint8_t color, uint8_t times,
+                              R503_CancelToken *token = NULL);
+  R503_SleepAwaiter sleep(uint32_t ms, R503_CancelToken *token = NULL);
+  
+  // Composite workflows
+  R503_Task<uint8_t> captureFinger(uint8_t slot, R503_CancelToken *token = NULL);
+  R503_Task<R503_SearchResult> identify(uint16_t count, R503_CancelToken *token = NULL);
+  R503_Task<uint8_t> enroll(uint16_t pageID, R503_CancelToken *token = NULL);
+  
+  R503_Scheduler &getScheduler() { return scheduler; }
+
+private:
+  R503_Scheduler &scheduler;
+  R503_Bus &bus;
+  uint8_t module;
+};
+
+#endif // __cpp_impl_coroutine
+
+#endif // R503_ASYNC_H
@@ -0,0 +1,214 @@
+// R503_Bus.cpp
+#include "R503_Bus.h"
+
+R503_Bus::R503_Bus(Stream *stream) : parser(rxBuffer, R503_BUS_MAX_RESPONSE) {
+  this->stream = stream;
+  this->moduleCount = 0;
+  this->nextModule = 0;
+  this->inFlight = 0;
+  this->maxInFlight = R503_BUS_MAX_MODULES;
+  this->timeout = R503_DEFAULT_TIMEOUT;
+  this->timeoutModel = NULL;
+  this->resultHead = 0;
+  this->resultCount = 0;
+  this->strayFrames = 0;
+  this->badFrames = 0;
+  this->lateReplies = 0;
+}
+
+int8_t R503_Bus::addModule(uint32_t address) {
+  if (moduleCount >= R503_BUS_MAX_MODULES) return -1;
+  if (findModule(address) >= 0) return -1;
+  
+  BusModule &m = modules[moduleCount];
+  m.address = address;
+  m.queueHead = 0;
+  m.queueCount = 0;
+  m.outstanding = false;
+  m.awaitingLate = false;
+  m.sentAt = 0;
+  return moduleCount++;
+}
+
+uint32_t R503_Bus::getAddress(uint8_t module) {
+  if (module >= moduleCount) return 0;
+  return modules[module].address;
+}
+
+void R503_Bus::setTimeout(uint32_t timeout) {
+  this->timeout = timeout;
+}
+
+void R503_Bus::setTimeoutModel(R503_TimeoutModel *model) {
+  this->timeoutModel = model;
+}
+
+void R503_Bus::setMaxInFlight(uint8_t count) {
+  maxInFlight = (count == 0) ? 1 : count;
+}
+
+bool R503_Bus::submit(uint8_t module, const uint8_t *command, uint16_t length, uint32_t tag) {
+  if (module >= moduleCount || length == 0 || length > R503_BUS_MAX_COMMAND) return false;
+  
+  BusModule &m = modules[module];
+  if (m.queueCount >= R503_BUS_QUEUE_DEPTH) return false;
+  
+  BusCommand &cmd = m.queue[(m.queueHead + m.queueCount) % R503_BUS_QUEUE_DEPTH];
+  memcpy(cmd.data, command, length);
+  cmd.length = length;
+  cmd.tag = tag;
+  m.queueCount++;
+  return true;
+}
+
+void R503_Bus::poll() {
+  receive();
+  expire();
+  dispatch();
+}
+
+bool R503_Bus::getResult(R503_BusResult &result) {
+  if (resultCount == 0) return false;
+  
+  result = results[resultHead];
+  resultHead = (resultHead + 1) % R503_BUS_RESULT_DEPTH;
+  resultCount--;
+  return true;
+}
+
+bool R503_Bus::isBusy(uint8_t module) {
+  if (module >= moduleCount) return false;
+  return modules[module].outstanding || modules[module].queueCount > 0;
+}
+
+bool R503_Bus::isIdle() {
+  if (inFlight > 0) return false;
+  
+  for (uint8_t i = 0; i < moduleCount; i++) {
+    if (modules[i].queueCount > 0) return false;
+  }
+  return true;
+}
+
+void R503_Bus::receive() {
+  while (stream->available()) {
+    R503_FrameParser::Result r = parser.feed(stream->read());
+    
+    if (r == R503_FrameParser::BAD_LENGTH || r == R503_FrameParser::BAD_CHECKSUM) {
+      badFrames++;
+      continue;
+    }
+    if (r != R503_FrameParser::FRAME_READY) continue;
+    
+    int8_t module = findModule(parser.getAddress());
+    
+    // The answer to an expired command; the module is free again
+    if (module >= 0 && modules[module].awaitingLate && parser.getPid() == R503_ACK_PACKET) {
+      modules[module].awaitingLate = false;
+      inFlight--;
+      lateReplies++;
+      continue;
+    }
+    
+    if (module < 0 || !modules[module].outstanding ||
+        parser.getPid() != R503_ACK_PACKET || parser.getDataLength() == 0) {
+      strayFrames++;
+      continue;
+    }
+    
+    complete(module, true, parser.getData(), parser.getDataLength());
+  }
+}
+
+void R503_Bus::expire() {
+  uint32_t now = millis();
+  for (uint8_t i = 0; i < moduleCount; i++) {
+    BusModule &m = modules[i];
+    
+    // A command the module never got is not answered at all
+    if (m.awaitingLate && now - m.sentAt > m.deadline + timeout) {
+      m.awaitingLate = false;
+      inFlight--;
+    }
+    
+    if (m.outstanding && now - m.sentAt > m.deadline) {
+      if (timeoutModel) {
+        timeoutModel->recordTimeout(m.queue[m.queueHead].data[0]);
+      }
+      complete(i, false, NULL, 0);
+      
+      // Held until the late ACK is in, so it cannot answer the next command
+      m.awaitingLate = true;
+      inFlight++;
+    }
+  }
+}
+
+void R503_Bus::dispatch() {
+  if (moduleCount == 0) return;
+  
+  // Each command in flight needs a result slot once it completes
+  for (uint8_t n = 0; n < moduleCount; n++) {
+    if (inFlight >= maxInFlight) return;
+    if (inFlight + resultCount >= R503_BUS_RESULT_DEPTH) return;
+    
+    uint8_t i = (nextModule + n) % moduleCount;
+    BusModule &m = modules[i];
+    if (m.outstanding || m.awaitingLate || m.queueCount == 0) continue;
+    
+    BusCommand &cmd = m.queue[m.queueHead];
+    uint8_t frame[R503_BUS_MAX_COMMAND + R503_FRAME_OVERHEAD];
+    uint16_t frameLen = R503_Frame::build(frame, m.address, R503_COMMAND_PACKET,
+                                          cmd.data, cmd.length);
+    stream->write(frame, frameLen);
+    
+    m.outstanding = true;
+    m.sentAt = millis();
+    m.deadline = timeout;
+    if (timeoutModel) {
+      m.deadline = timeoutModel->deadline(cmd.data[0], searchCount(cmd));
+    }
+    inFlight++;
+  }
+  
+  nextModule = (nextModule + 1) % moduleCount;
+}
+
+uint16_t R503_Bus::searchCount(const BusCommand &cmd) {
+  if (cmd.data[0] != R503_SEARCH || cmd.length < 6) return 0;
+  return (cmd.data[4] << 8) | cmd.data[5];
+}
+
+int8_t R503_Bus::findModule(uint32_t address) {
+  for (uint8_t i = 0; i < moduleCount; i++) {
+    if (modules[i].address == address) return i;
+  }
+  return -1;
+}
+
+void R503_Bus::complete(uint8_t module, bool completed, const uint8_t *data, uint16_t length) {
+  BusModule &m = modules[module];
+  BusCommand &cmd = m.queue[m.queueHead];
+  
+  R503_BusResult &result = results[(resultHead + resultCount) % R503_BUS_RESULT_DEPTH];
+  result.module = module;
+  result.opcode = cmd.data[0];
+  result.tag = cmd.tag;
+  result.completed = completed;
+  result.confirmCode = completed ? data[0] : 0xFF;
+  result.length = min(length, (uint16_t)R503_BUS_MAX_RESPONSE);
+  if (result.length > 0) {
+    memcpy(result.data, data, result.length);
+  }
+  result.latency = millis() - m.sentAt;
+  resultCount++;
+  
+  if (completed && timeoutModel) {
+    timeoutModel->record(cmd.data[0], searchCount(cmd), result.latency, result.confirmCode);
+  }
+  
+  m.queueHead = (m.queueHead + 1) % R503_BUS_QUEUE_DEPTH;
+  m.queueCount--;
+  m.outstanding = false;
+  inFlight--;
+}
@@ -0,0 +1,116 @@
+// R503_Bus.h
+#ifndef R503_BUS_H
+#define R503_BUS_H
+
+#include "R503_Fingerprint.h"
+#include "R503_Frame.h"
+#include "R503_TimeoutModel.h"
+
+#define R503_BUS_MAX_MODULES 8
+#define R503_BUS_QUEUE_DEPTH 4
+#define R503_BUS_RESULT_DEPTH 8
+#define R503_BUS_MAX_COMMAND 34
+#define R503_BUS_MAX_RESPONSE 64
+
+// Completed command/ACK exchange
+struct R503_BusResult {
+  uint8_t module;
+  uint8_t opcode;
+  uint32_t tag;
+  bool completed;        // false if the module did not answer before the timeout
+  uint8_t confirmCode;
+  uint8_t data[R503_BUS_MAX_RESPONSE];
+  uint16_t length;
+  uint32_t latency;
+};
+
+// Drives several modules with distinct addresses over one link. Each module
+// has at most one command outstanding; commands for different modules are
+// interleaved round-robin and replies are routed by the address in the frame.
+//
+// A module whose command expired still answers it later, so it gets no
+// new command until that late ACK has arrived (and is dropped) or another
+// full timeout has passed; until then it counts as in flight.
+//
+// Only command/ACK exchanges are supported. Data phases (UPCHAR, UPIMAGE,
+// ...) carry no opcode and must go through an R503_Fingerprint instance
+// while the bus is idle.
+class R503_Bus {
+public:
+  R503_Bus(Stream *stream);
+  
+  // Returns the module handle, or -1 if the table is full or the address is taken
+  int8_t addModule(uint32_t address);
+  uint8_t getModuleCount() { return moduleCount; }
+  uint32_t getAddress(uint8_t module);
+  
+  void setTimeout(uint32_t timeout);
+  
+  // Per-opcode deadlines learned from reply latencies (NULL = fixed timeout)
+  void setTimeoutModel(R503_TimeoutModel *model);
+  
+  // Upper bound on commands awaiting replies across all modules. Use 1 on a
+  // half-duplex RS-485 segment where simultaneous replies would collide.
+  void setMaxInFlight(uint8_t count);
+  
+  // Queue a command packet (opcode followed by parameters)
+  bool submit(uint8_t module, const uint8_t *command, uint16_t length, uint32_t tag = 0);
+  
+  // Route received replies, expire timeouts and send queued commands
+  void poll();
+  
+  // Pop the oldest completed exchange
+  bool getResult(R503_BusResult &result);
+  
+  bool isBusy(uint8_t module);
+  bool isIdle();
+  uint32_t getStrayFrames() { return strayFrames; }
+  uint32_t getBadFrames() { return badFrames; }
+  uint32_t getLateReplies() { return lateReplies; }
+  
+private:
+  struct BusCommand {
+    uint8_t data[R503_BUS_MAX_COMMAND];
+    uint8_t length;
+    uint32_t tag;
+  };
+  
+  struct BusModule {
+    uint32_t address;
+    BusCommand queue[R503_BUS_QUEUE_DEPTH];
+    uint8_t queueHead;
+    uint8_t queueCount;
+    bool outstanding;
+    bool awaitingLate;
+    uint32_t sentAt;
+    uint32_t deadline;
+  };
+  
+  Stream *stream;
+  BusModule modules[R503_BUS_MAX_MODULES];
+  uint8_t moduleCount;
+  uint8_t nextModule;
+  uint8_t inFlight;
+  uint8_t maxInFlight;
+  uint32_t timeout;
+  R503_TimeoutModel *timeoutModel;
+  
+  R503_BusResult results[R503_BUS_RESULT_DEPTH];
+  uint8_t resultHead;
+  uint8_t resultCount;
+  
+  uint8_t rxBuffer[R503_BUS_MAX_RESPONSE];
+  R503_FrameParser parser;
+  uint32_t strayFrames;
+  uint32_t badFrames;
+  uint32_t lateReplies;
+  
+  void receive();
+  void expire();
+  void dispatch();
+  int8_t findModule(uint32_t address);
+  uint16_t searchCount(const BusCommand &cmd);
+  void complete(uint8_t module, bool completed, const uint8_t *data, uint16_t length);
+};
+
+#endif // R503_BUS_H
@@ -0,0 +1,166 @@
+// R503_Defragmenter.cpp
+#include "R503_Defragmenter.h"
+
+#if R503_ENABLE_NOTEPAD
+
+#define DEFRAG_MAGIC_0 'D'
+#define DEFRAG_MAGIC_1 'F'
+#define DEFRAG_STATE_IDLE 0x00
+#define DEFRAG_STATE_MOVING 0x01
+
+R503_Defragmenter::R503_Defragmenter(R503_Fingerprint *finger, R503_Library *library, uint8_t journalPage) {
+  this->finger = finger;
+  this->library = library;
+  this->journalPage = journalPage;
+  this->frequency = NULL;
+  this->moveHandler = NULL;
+  this->running = false;
+  this->position = 0;
+  this->moves = 0;
+}
+
+bool R503_Defragmenter::recover() {
+  bool moving;
+  uint16_t from;
+  uint16_t to;
+  if (!readJournal(moving, from, to)) return false;
+  if (!library->refresh()) return false;
+  if (!moving) return true;
+  
+  // The index table tells how far the move got: while the source is still
+  // there it is copied again, otherwise the copy was already stored
+  if (library->isOccupied(from)) {
+    if (!finger->loadModel(R503_CHARBUFFER1, from)) return false;
+    if (!finger->storeModel(R503_CHARBUFFER1, to)) return false;
+    if (!finger->deleteModel(from)) return false;
+    library->setOccupied(to, true);
+    library->setOccupied(from, false);
+  }
+  
+  if (moveHandler) {
+    moveHandler(from, to);
+  }
+  return writeJournal(false, 0, 0);
+}
+
+void R503_Defragmenter::setFrequencySource(uint32_t (*frequency)(uint16_t pageID)) {
+  this->frequency = frequency;
+}
+
+void R503_Defragmenter::setMoveHandler(void (*handler)(uint16_t from, uint16_t to)) {
+  moveHandler = handler;
+}
+
+void R503_Defragmenter::start() {
+  running = true;
+  position = 0;
+  moves = 0;
+}
+
+bool R503_Defragmenter::step() {
+  if (!running) return false;
+  
+  uint16_t count = library->getCount();
+  
+  // Slots below position already hold the right templates
+  while (position < count) {
+    int16_t wanted = wantedAt(position);
+    if (wanted < 0 || wanted != position) break;
+    position++;
+  }
+  if (position >= count) {
+    running = false;
+    return false;
+  }
+  
+  int16_t wanted = wantedAt(position);
+  
+  if (!library->isOccupied(position)) {
+    if (!move(wanted, position)) {
+      running = false;
+      return false;
+    }
+    return true;
+  }
+  
+  // Another template sits in the way; park it above the packed range
+  int16_t spare = library->findFree(count);
+  if (spare < 0) spare = library->findFree(position + 1);
+  if (spare < 0 || !move(position, spare)) {
+    running = false;
+    return false;
+  }
+  return true;
+}
+
+bool R503_Defragmenter::run() {
+  start();
+  while (step()) {
+  }
+  return library->getUsedEnd() == library->getCount();
+}
+
+bool R503_Defragmenter::move(uint16_t from, uint16_t to) {
+  if (!writeJournal(true, from, to)) return false;
+  
+  if (!finger->loadModel(R503_CHARBUFFER1, from)) return false;
+  if (!finger->storeModel(R503_CHARBUFFER1, to)) return false;
+  library->setOccupied(to, true);
+  
+  if (!finger->deleteModel(from)) return false;
+  library->setOccupied(from, false);
+  moves++;
+  
+  if (moveHandler) {
+    moveHandler(from, to);
+  }
+  return writeJournal(false, 0, 0);
+}
+
+int16_t R503_Defragmenter::wantedAt(uint16_t pos) {
+  // Most used template at or above pos, lowest slot first on ties
+  int16_t best = -1;
+  uint32_t bestUses = 0;
+  for (uint16_t i = pos; i < library->getSize(); i++) {
+    if (!library->isOccupied(i)) continue;
+    uint32_t uses = usesOf(i);
+    if (best < 0 || uses > bestUses) {
+      best = i;
+      bestUses = uses;
+    }
+  }
+  return best;
+}
+
+uint32_t R503_Defragmenter::usesOf(uint16_t pageID) {
+  return frequency ? frequency(pageID) : 0;
+}
+
+bool R503_Defragmenter::writeJournal(bool moving, uint16_t from, uint16_t to) {
+  uint8_t page[32];
+  memset(page, 0, sizeof(page));
+  page[0] = DEFRAG_MAGIC_0;
+  page[1] = DEFRAG_MAGIC_1;
+  page[2] = moving ? DEFRAG_STATE_MOVING : DEFRAG_STATE_IDLE;
+  page[3] = (from >> 8) & 0xFF;
+  page[4] = from & 0xFF;
+  page[5] = (to >> 8) & 0xFF;
+  page[6] = to & 0xFF;
+  page[7] = ~(page[2] + page[3] + page[4] + page[5] + page[6]);
+  return finger->writeNotepad(journalPage, page);
+}
+
+bool R503_Defragmenter::readJournal(bool &moving, uint16_t &from, uint16_t &to) {
+  uint8_t page[32];
+  if (!finger->readNotepad(journalPage, page)) return false;
+  
+  // Anything that is not a valid record means no move was in progress
+  uint8_t check = ~(page[2] + page[3] + page[4] + page[5] + page[6]);
+  moving = page[0] == DEFRAG_MAGIC_0 && page[1] == DEFRAG_MAGIC_1 &&
+           page[2] == DEFRAG_STATE_MOVING && page[7] == check;
+  from = (page[3] << 8) | page[4];
+  to = (page[5] << 8) | page[6];
+  return true;
+}
+
+#endif
@@ -0,0 +1,62 @@
+// R503_Defragmenter.h
+#ifndef R503_DEFRAGMENTER_H
+#define R503_DEFRAGMENTER_H
+
+#include "R503_Fingerprint.h"
+#include "R503_Library.h"
+
+#if R503_ENABLE_NOTEPAD
+
+// Notepad page holding the move journal. R503_NotepadStore leaves it out
+// of its default range; keep it out of any custom range as well.
+#define R503_DEFRAG_JOURNAL_PAGE 15
+
+// Packs the library into slots 0..count-1 so searches can stop at
+// getUsedEnd(). With a frequency source the most used templates end up
+// lowest, in descending order of use.
+//
+// Every relocation is a single move into a free slot: journal the move in
+// the notepad, loadModel/storeModel into the new slot, deleteModel the old
+// one, clear the journal. The source is only deleted after the copy is
+// stored, so an interrupted run never loses a template; call recover()
+// at startup, before any enrollment, to finish a move cut short.
+class R503_Defragmenter {
+public:
+  R503_Defragmenter(R503_Fingerprint *finger, R503_Library *library,
+                    uint8_t journalPage = R503_DEFRAG_JOURNAL_PAGE);
+  
+  // Finish a move recorded in the journal; refreshes the library index
+  bool recover();
+  
+  // Uses of the template at pageID; NULL packs in slot order
+  void setFrequencySource(uint32_t (*frequency)(uint16_t pageID));
+  
+  // Called after each completed move (may repeat one move after recover)
+  void setMoveHandler(void (*handler)(uint16_t from, uint16_t to));
+  
+  void start();
+  bool step();
+  bool run();
+  bool isRunning() { return running; }
+  uint16_t getMoveCount() { return moves; }
+  
+private:
+  R503_Fingerprint *finger;
+  R503_Library *library;
+  uint8_t journalPage;
+  uint32_t (*frequency)(uint16_t pageID);
+  void (*moveHandler)(uint16_t from, uint16_t to);
+  bool running;
+  uint16_t position;
+  uint16_t moves;
+  
+  bool move(uint16_t from, uint16_t to);
+  int16_t wantedAt(uint16_t pos);
+  uint32_t usesOf(uint16_t pageID);
+  bool writeJournal(bool moving, uint16_t from, uint16_t to);
+  bool readJournal(bool &moving, uint16_t &from, uint16_t &to);
+};
+
+#endif
+
+#endif // R503_DEFRAGMENTER_H
@@ -0,0 +1,607 @@
+// R503_Emulator.cpp
+#include "R503_Emulator.h"
+
+R503_Emulator::R503_Emulator() : parser(frameBuffer, R503_MAX_PACKET_DATA) {
+  this->moduleCount = 0;
+  this->rxHead = 0;
+  this->rxCount = 0;
+  this->noFingerTime = 0;
+  this->searchCostPerPage = 0;
+  this->lineRate = 0;
+  this->corruptOneIn = 0;
+  this->noiseState = 0x2545F491;
+  memset(serviceTime, 0, sizeof(serviceTime));
+}
+
+int8_t R503_Emulator::addModule(uint32_t address, uint32_t password) {
+  if (moduleCount >= R503_EMU_MAX_MODULES) return -1;
+  
+  EmuModule &m = modules[moduleCount];
+  memset(&m, 0, sizeof(EmuModule));
+  m.address = address;
+  m.password = password;
+  m.securityLevel = 3;
+  m.packetSizeCode = R503_PACKAGE_SIZE_128;
+  m.baudMultiplier = 6;
+  m.ledControl = R503_LED_OFF;
+  
+  // Power-on handshake byte, as sent by a real module after reset
+  m.tx[0] = 0x55;
+  m.txLen = 1;
+  m.readyAt = millis();
+  m.released = 0;
+  
+  return moduleCount++;
+}
+
+void R503_Emulator::placeFinger(uint8_t module, const uint8_t *features) {
+  if (module >= moduleCount) return;
+  
+  // A clean image whose four pixels per feature all carry the feature value
+  for (uint16_t i = 0; i < R503_EMU_IMAGE_SIZE; i++) {
+    modules[module].sensorImage[i] = features[(i / 4) % R503_EMU_TEMPLATE_SIZE];
+  }
+  modules[module].fingerPresent = true;
+}
+
+void R503_Emulator::placeImage(uint8_t module, const uint8_t *image) {
+  if (module >= moduleCount) return;
+  memcpy(modules[module].sensorImage, image, R503_EMU_IMAGE_SIZE);
+  modules[module].fingerPresent = true;
+}
+
+void R503_Emulator::removeFinger(uint8_t module) {
+  if (module >= moduleCount) return;
+  modules[module].fingerPresent = false;
+}
+
+bool R503_Emulator::enrollDirect(uint8_t module, uint16_t pageID, const uint8_t *features) {
+  if (module >= moduleCount || pageID >= R503_EMU_LIBRARY_SIZE) return false;
+  memcpy(modules[module].library[pageID], features, R503_EMU_TEMPLATE_SIZE);
+  setOccupied(modules[module], pageID, true);
+  return true;
+}
+
+void R503_Emulator::setServiceTime(uint8_t opcode, uint16_t ms) {
+  serviceTime[opcode] = ms;
+}
+
+void R503_Emulator::setNoFingerTime(uint16_t ms) {
+  noFingerTime = ms;
+}
+
+void R503_Emulator::setSearchCostPerPage(uint16_t us) {
+  searchCostPerPage = us;
+}
+
+void R503_Emulator::setLineRate(uint32_t baud) {
+  lineRate = baud;
+}
+
+void R503_Emulator::setCorruptionRate(uint16_t oneIn) {
+  corruptOneIn = oneIn;
+}
+
+uint32_t R503_Emulator::getCommandCount(uint8_t module) {
+  if (module >= moduleCount) return 0;
+  return modules[module].commandCount;
+}
+
+uint8_t R503_Emulator::getLedControl(uint8_t module) {
+  if (module >= moduleCount) return 0;
+  return modules[module].ledControl;
+}
+
+uint8_t R503_Emulator::getLedColor(uint8_t module) {
+  if (module >= moduleCount) return 0;
+  return modules[module].ledColor;
+}
+
+int R503_Emulator::available() {
+  pump();
+  return rxCount;
+}
+
+int R503_Emulator::read() {
+  pump();
+  if (rxCount == 0) return -1;
+  
+  uint8_t byte = rx[rxHead];
+  rxHead = (rxHead + 1) % R503_EMU_RX_BUFFER;
+  rxCount--;
+  return byte;
+}
+
+int R503_Emulator::peek() {
+  pump();
+  if (rxCount == 0) return -1;
+  return rx[rxHead];
+}
+
+size_t R503_Emulator::write(uint8_t byte) {
+  if (parser.feed(byte) == R503_FrameParser::FRAME_READY) {
+    handleFrame();
+  }
+  return 1;
+}
+
+void R503_Emulator::pump() {
+  uint32_t now = millis();
+  
+  // Modules answer independently; whichever reply is due first reaches the
+  // host first, which is what a shared RS-485 segment would show
+  while (rxCount < R503_EMU_RX_BUFFER) {
+    int8_t next = -1;
+    for (uint8_t i = 0; i < moduleCount; i++) {
+      EmuModule &m = modules[i];
+      if (m.txLen == 0 || (int32_t)(now - m.readyAt) < 0) continue;
+      if (next < 0 || (int32_t)(m.readyAt - modules[next].readyAt) < 0) {
+        next = i;
+      }
+    }
+    if (next < 0) return;
+    
+    EmuModule &m = modules[next];
+    uint16_t count = min((uint16_t)(R503_EMU_RX_BUFFER - rxCount), m.txLen);
+    if (lineRate > 0) {
+      uint32_t due = (uint64_t)(now - m.readyAt) * lineRate / 10000;
+      if (due <= m.released) return;
+      count = min((uint32_t)count, due - m.released);
+      m.released += count;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+      uint8_t byte = m.tx[i];
+      if (corruptOneIn > 0) {
+        noiseState ^= noiseState << 13;
+        noiseState ^= noiseState >> 17;
+        noiseState ^= noiseState << 5;
+        if (noiseState % corruptOneIn == 0) {
+          byte ^= 1 << (noiseState >> 29);
+        }
+      }
+      rx[(rxHead + rxCount) % R503_EMU_RX_BUFFER] = byte;
+      rxCount++;
+    }
+    m.txLen -= count;
+    if (m.txLen > 0) {
+      memmove(m.tx, m.tx + count, m.txLen);
+    }
+  }
+}
+
+void R503_Emulator::handleFrame() {
+  EmuModule *m = NULL;
+  for (uint8_t i = 0; i < moduleCount; i++) {
+    if (modules[i].address == parser.getAddress()) {
+      m = &modules[i];
+      break;
+    }
+  }
+  if (m == NULL) return;
+  
+  uint8_t pid = parser.getPid();
+  if (pid == R503_COMMAND_PACKET) {
+    m->downloading = false;
+    if (parser.getDataLength() > 0) {
+      handleCommand(*m, parser.getData(), parser.getDataLength());
+    }
+  } else if ((pid == R503_DATA_PACKET || pid == R503_END_DATA_PACKET) && m->downloading) {
+    handleDownload(*m, pid, parser.getData(), parser.getDataLength());
+  }
+}
+
+void R503_Emulator::handleCommand(EmuModule &m, const uint8_t *cmd, uint16_t len) {
+  uint8_t opcode = cmd[0];
+  uint8_t data[48];
+  
+  m.commandCount++;
+  uint32_t ready = millis() + serviceTime[opcode];
+  if ((opcode == R503_GENIMG || opcode == R503_GETIMAGEEX) && !m.fingerPresent) {
+    ready = millis() + noFingerTime;
+  }
+  if (opcode == R503_SEARCH && len >= 6) {
+    ready += ((uint32_t)((cmd[4] << 8) | cmd[5]) * searchCostPerPage) / 1000;
+  }
+  if (m.txLen == 0 || (int32_t)(ready - m.readyAt) > 0) {
+    m.readyAt = ready;
+    m.released = 0;
+  }
+  
+  switch (opcode) {
+    case R503_HANDSHAKE:
+    case R503_CHECKSENSOR:
+    case R503_CONTROL:
+    case R503_CANCEL:
+      reply(m, R503_OK);
+      break;
+      
+    case R503_SOFTRST:
+      m.imageValid = false;
+      m.ledControl = R503_LED_OFF;
+      reply(m, R503_OK);
+      break;
+      
+    case R503_VFYPWD:
+    case R503_SETPWD:
+    case R503_SETADDER: {
+      if (len < 5) {
+        reply(m, R503_PACKETRECIEVEERR);
+        break;
+      }
+      uint32_t value = ((uint32_t)cmd[1] << 24) | ((uint32_t)cmd[2] << 16) |
+                       ((uint32_t)cmd[3] << 8) | cmd[4];
+      if (opcode == R503_VFYPWD) {
+        reply(m, value == m.password ? R503_OK : R503_WRONGPASSWORD);
+      } else if (opcode == R503_SETPWD) {
+        m.password = value;
+        reply(m, R503_OK);
+      } else {
+        // The ACK still carries the old address
+        reply(m, R503_OK);
+        m.address = value;
+      }
+      break;
+    }
+    
+    case R503_SETSYSPARA:
+      if (len < 3) {
+        reply(m, R503_PACKETRECIEVEERR);
+      } else if (cmd[1] == R503_PARAM_BAUD && cmd[2] >= 1 && cmd[2] <= 12) {
+        m.baudMultiplier = cmd[2];
+        reply(m, R503_OK);
+      } else if (cmd[1] == R503_PARAM_SECURITY && cmd[2] >= 1 && cmd[2] <= 5) {
+        m.securityLevel = cmd[2];
+        reply(m, R503_OK);
+      } else if (cmd[1] == R503_PARAM_PACKAGE_SIZE && cmd[2] <= R503_PACKAGE_SIZE_256) {
+        m.packetSizeCode = cmd[2];
+        reply(m, R503_OK);
+      } else {
+        reply(m, R503_INVALIDREG);
+      }
+      break;
+      
+    case R503_READSYSPARA:
+      data[0] = 0;
+      data[1] = m.imageValid ? R503_STATUS_IMGBUF : 0;
+      data[2] = 0x00;
+      data[3] = 0x09;
+      data[4] = (R503_EMU_LIBRARY_SIZE >> 8) & 0xFF;
+      data[5] = R503_EMU_LIBRARY_SIZE & 0xFF;
+      data[6] = 0;
+      data[7] = m.securityLevel;
+      data[8] = (m.address >> 24) & 0xFF;
+      data[9] = (m.address >> 16) & 0xFF;
+      data[10] = (m.address >> 8) & 0xFF;
+      data[11] = m.address & 0xFF;
+      data[12] = 0;
+      data[13] = m.packetSizeCode;
+      data[14] = 0;
+      data[15] = m.baudMultiplier;
+      reply(m, R503_OK, data, 16);
+      break;
+      
+    case R503_TEMPLATENUM: {
+      uint16_t count = 0;
+      for (uint16_t i = 0; i < R503_EMU_LIBRARY_SIZE; i++) {
+        if (isOccupied(m, i)) count++;
+      }
+      data[0] = (count >> 8) & 0xFF;
+      data[1] = count & 0xFF;
+      reply(m, R503_OK, data, 2);
+      break;
+    }
+    
+    case R503_READINDEXTABLE:
+      if (len < 2 || cmd[1] > 3) {
+        reply(m, R503_INVALIDREG);
+        break;
+      }
+      memset(data, 0, 32);
+      for (uint16_t i = 0; i < 256; i++) {
+        uint16_t id = cmd[1] * 256 + i;
+        if (id < R503_EMU_LIBRARY_SIZE && isOccupied(m, id)) {
+          data[i / 8] |= 1 << (7 - (i % 8));
+        }
+      }
+      reply(m, R503_OK, data, 32);
+      break;
+      
+    case R503_GENIMG:
+    case R503_GETIMAGEEX:
+      m.imageValid = m.fingerPresent;
+      if (m.fingerPresent) {
+        memcpy(m.image, m.sensorImage, R503_EMU_IMAGE_SIZE);
+      }
+      reply(m, m.fingerPresent ? R503_OK : R503_NOFINGER);
+      break;
+      
+    case R503_IMG2TZ:
+      if (len < 2) {
+        reply(m, R503_PACKETRECIEVEERR);
+      } else if (!m.imageValid) {
+        reply(m, R503_INVALIDIMAGE);
+      } else {
+        extractFeatures(m.image, m.charBuffer[bufferIndex(cmd[1])]);
+        reply(m, R503_OK);
+      }
+      break;
+      
+    case R503_REGMODEL:
+      if (score(m.charBuffer[0], m.charBuffer[1]) < threshold(m)) {
+        reply(m, R503_ENROLLMISMATCH);
+      } else {
+        memcpy(m.charBuffer[1], m.charBuffer[0], R503_EMU_TEMPLATE_SIZE);
+        reply(m, R503_OK);
+      }
+      break;
+      
+    case R503_STORE:
+    case R503_LOADCHAR: {
+      if (len < 4) {
+        reply(m, R503_PACKETRECIEVEERR);
+        break;
+      }
+      uint16_t pageID = (cmd[2] << 8) | cmd[3];
+      uint8_t idx = bufferIndex(cmd[1]);
+      if (pageID >= R503_EMU_LIBRARY_SIZE) {
+        reply(m, R503_BADLOCATION);
+      } else if (opcode == R503_STORE) {
+        memcpy(m.library[pageID], m.charBuffer[idx], R503_EMU_TEMPLATE_SIZE);
+        setOccupied(m, pageID, true);
+        reply(m, R503_OK);
+      } else if (!isOccupied(m, pageID)) {
+        reply(m, R503_DBRANGEFAIL);
+      } else {
+        memcpy(m.charBuffer[idx], m.library[pageID], R503_EMU_TEMPLATE_SIZE);
+        reply(m, R503_OK);
+      }
+      break;
+    }
+    
+    case R503_DELETCHAR: {
+      if (len < 5) {
+        reply(m, R503_PACKETRECIEVEERR);
+        break;
+      }
+      uint16_t start = (cmd[1] << 8) | cmd[2];
+      uint16_t count = (cmd[3] << 8) | cmd[4];
+      if ((uint32_t)start + count > R503_EMU_LIBRARY_SIZE) {
+        reply(m, R503_DELETEFAIL);
+        break;
+      }
+      for (uint16_t i = 0; i < count; i++) {
+        setOccupied(m, start + i, false);
+      }
+      reply(m, R503_OK);
+      break;
+    }
+    
+    case R503_EMPTY:
+      memset(m.occupied, 0, sizeof(m.occupied));
+      reply(m, R503_OK);
+      break;
+      
+    case R503_MATCH: {
+      uint16_t s = score(m.charBuffer[0], m.charBuffer[1]);
+      data[0] = (s >> 8) & 0xFF;
+      data[1] = s & 0xFF;
+      reply(m, s >= threshold(m) ? R503_OK : R503_NOMATCH, data, 2);
+      break;
+    }
+    
+    case R503_SEARCH: {
+      if (len < 6) {
+        reply(m, R503_PACKETRECIEVEERR);
+        break;
+      }
+      uint8_t idx = bufferIndex(cmd[1]);
+      uint16_t start = (cmd[2] << 8) | cmd[3];
+      uint16_t count = (cmd[4] << 8) | cmd[5];
+      uint16_t bestID = 0;
+      uint16_t bestScore = 0;
+      for (uint32_t id = start; id < (uint32_t)start + count && id < R503_EMU_LIBRARY_SIZE; id++) {
+        if (!isOccupied(m, id)) continue;
+        uint16_t s = score(m.charBuffer[idx], m.library[id]);
+        if (s > bestScore) {
+          bestScore = s;
+          bestID = id;
+        }
+      }
+      if (bestScore >= threshold(m)) {
+        data[0] = (bestID >> 8) & 0xFF;
+        data[1] = bestID & 0xFF;
+        data[2] = (bestScore >> 8) & 0xFF;
+        data[3] = bestScore & 0xFF;
+        reply(m, R503_OK, data, 4);
+      } else {
+        memset(data, 0, 4);
+        reply(m, R503_NOTFOUND, data, 4);
+      }
+      break;
+    }
+    
+    case R503_UPCHAR:
+      if (len < 2) {
+        reply(m, R503_PACKETRECIEVEERR);
+        break;
+      }
+      reply(m, R503_OK);
+      replyData(m, m.charBuffer[bufferIndex(cmd[1])], R503_EMU_TEMPLATE_SIZE);
+      break;
+      
+    case R503_DOWNCHAR:
+      if (len < 2) {
+        reply(m, R503_PACKETRECIEVEERR);
+        break;
+      }
+      m.downloading = true;
+      m.downloadSlot = bufferIndex(cmd[1]);
+      m.downloadImage = false;
+      m.downloadOffset = 0;
+      reply(m, R503_OK);
+      break;
+      
+    case R503_UPIMAGE:
+      reply(m, R503_OK);
+      replyData(m, m.image, R503_EMU_IMAGE_SIZE);
+      break;
+      
+    case R503_DOWNIMAGE:
+      m.downloading = true;
+      m.downloadImage = true;
+      m.imageValid = false;
+      m.downloadOffset = 0;
+      reply(m, R503_OK);
+      break;
+      
+    case R503_WRITENOTEPAD:
+      if (len < 34) {
+        reply(m, R503_PACKETRECIEVEERR);
+      } else if (cmd[1] > 15) {
+        reply(m, R503_WRONGNOTEPAGE);
+      } else {
+        memcpy(m.notepad[cmd[1]], cmd + 2, 32);
+        reply(m, R503_OK);
+      }
+      break;
+      
+    case R503_READNOTEPAD:
+      if (len < 2) {
+        reply(m, R503_PACKETRECIEVEERR);
+      } else if (cmd[1] > 15) {
+        reply(m, R503_WRONGNOTEPAGE);
+      } else {
+        reply(m, R503_OK, m.notepad[cmd[1]], 32);
+      }
+      break;
+      
+    case R503_GETRANDOMCODE: {
+      uint32_t x = millis() ^ (m.commandCount * 2654435761UL) ^ m.address;
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      data[0] = (x >> 24) & 0xFF;
+      data[1] = (x >> 16) & 0xFF;
+      data[2] = (x >> 8) & 0xFF;
+      data[3] = x & 0xFF;
+      reply(m, R503_OK, data, 4);
+      break;
+    }
+    
+    case R503_AURALEDCONFIG:
+      if (len < 5) {
+        reply(m, R503_PACKETRECIEVEERR);
+        break;
+      }
+      m.ledControl = cmd[1];
+      m.ledColor = cmd[3];
+      reply(m, R503_OK);
+      break;
+      
+    case R503_GETALGVER:
+    case R503_GETFWVER:
+      memset(data, 0, 32);
+      strncpy((char *)data, opcode == R503_GETALGVER ? "EMU-ALG-1.0" : "EMU-FW-1.0", 32);
+      reply(m, R503_OK, data, 32);
+      break;
+      
+    case R503_READPRODINFO:
+      memset(data, 0, 46);
+      memcpy(data, "R503-EMULATOR", 13);
+      memcpy(data + 16, "0001", 4);
+      memcpy(data + 20, "00000001", 8);
+      data[28] = 0x01;
+      data[29] = 0x00;
+      memcpy(data + 30, "EMU", 3);
+      data[38] = 0;
+      data[39] = 192;
+      data[40] = 0;
+      data[41] = 192;
+      data[42] = (R503_EMU_TEMPLATE_SIZE >> 8) & 0xFF;
+      data[43] = R503_EMU_TEMPLATE_SIZE & 0xFF;
+      data[44] = (R503_EMU_LIBRARY_SIZE >> 8) & 0xFF;
+      data[45] = R503_EMU_LIBRARY_SIZE & 0xFF;
+      reply(m, R503_OK, data, 46);
+      break;
+      
+    default:
+      reply(m, R503_PACKETRECIEVEERR);
+      break;
+  }
+}
+
+void R503_Emulator::handleDownload(EmuModule &m, uint8_t pid, const uint8_t *data, uint16_t len) {
+  uint8_t *target = m.downloadImage ? m.image : m.charBuffer[m.downloadSlot];
+  uint16_t room = (m.downloadImage ? R503_EMU_IMAGE_SIZE : R503_EMU_TEMPLATE_SIZE) - m.downloadOffset;
+  uint16_t count = min(len, room);
+  memcpy(target + m.downloadOffset, data, count);
+  m.downloadOffset += count;
+  
+  if (pid == R503_END_DATA_PACKET) {
+    m.downloading = false;
+    if (m.downloadImage) {
+      m.imageValid = true;
+    }
+  }
+}
+
+void R503_Emulator::queueFrame(EmuModule &m, uint8_t pid, const uint8_t *data, uint16_t len) {
+  if (m.txLen + len + R503_FRAME_OVERHEAD > R503_EMU_TX_BUFFER) return;
+  m.txLen += R503_Frame::build(m.tx + m.txLen, m.address, pid, data, len);
+}
+
+void R503_Emulator::reply(EmuModule &m, uint8_t code, const uint8_t *data, uint16_t len) {
+  uint8_t payload[64];
+  payload[0] = code;
+  if (len > 0) {
+    memcpy(payload + 1, data, len);
+  }
+  queueFrame(m, R503_ACK_PACKET, payload, len + 1);
+}
+
+void R503_Emulator::replyData(EmuModule &m, const uint8_t *data, uint16_t len) {
+  uint16_t packetSize = 32 << m.packetSizeCode;
+  uint16_t offset = 0;
+  
+  while (offset < len) {
+    uint16_t chunkSize = min((uint16_t)(len - offset), packetSize);
+    bool isLastPacket = (offset + chunkSize >= len);
+    queueFrame(m, isLastPacket ? R503_END_DATA_PACKET : R503_DATA_PACKET, data + offset, chunkSize);
+    offset += chunkSize;
+  }
+}
+
+void R503_Emulator::extractFeatures(const uint8_t *image, uint8_t *features) {
+  for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+    const uint8_t *pixels = image + i * 4;
+    features[i] = (pixels[0] + pixels[1] + pixels[2] + pixels[3]) / 4;
+  }
+}
+
+uint16_t R503_Emulator::score(const uint8_t *a, const uint8_t *b) {
+  uint32_t same = 0;
+  for (uint16_t i = 0; i < R503_EMU_TEMPLATE_SIZE; i++) {
+    if (a[i] == b[i]) same++;
+  }
+  return (same * 300) / R503_EMU_TEMPLATE_SIZE;
+}
+
+uint16_t R503_Emulator::threshold(EmuModule &m) {
+  return R503_EMU_BASE_THRESHOLD + 15 * m.securityLevel;
+}
+
+bool R503_Emulator::isOccupied(EmuModule &m, uint16_t pageID) {
+  return (m.occupied[pageID / 8] >> (pageID % 8)) & 1;
+}
+
+void R503_Emulator::setOccupied(EmuModule &m, uint16_t pageID, bool value) {
+  if (value) {
+    m.occupied[pageID / 8] |= 1 << (pageID % 8);
+  } else {
+    m.occupied[pageID / 8] &= ~(1 << (pageID % 8));
+  }
+}
+
+uint8_t R503_Emulator::bufferIndex(uint8_t slot) {
+  return (slot == R503_CHARBUFFER2) ? 1 : 0;
+}
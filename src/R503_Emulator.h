@@ -0,0 +1,137 @@
+// R503_Emulator.h
+#ifndef R503_EMULATOR_H
+#define R503_EMULATOR_H
+
+#include "R503_Fingerprint.h"
+#include "R503_Frame.h"
+
+// Each module holds its library, buffers and notepad in RAM (about 41 KB
+// with the defaults); raise the count only for multi-module bus tests
+#ifndef R503_EMU_MAX_MODULES
+#define R503_EMU_MAX_MODULES 1
+#endif
+#ifndef R503_EMU_LIBRARY_SIZE
+#define R503_EMU_LIBRARY_SIZE 64
+#endif
+#define R503_EMU_TEMPLATE_SIZE 512
+// A real module's image is 36864 bytes; host builds can use that size to
+// time image transfers (with setLineRate)
+#ifndef R503_EMU_IMAGE_SIZE
+#define R503_EMU_IMAGE_SIZE (R503_EMU_TEMPLATE_SIZE * 4)
+#endif
+// Room for a whole image data phase in 32-byte packets plus an ACK
+#define R503_EMU_TX_BUFFER (R503_EMU_IMAGE_SIZE + R503_EMU_IMAGE_SIZE / 32 * R503_FRAME_OVERHEAD + 64)
+#define R503_EMU_RX_BUFFER 2048
+#define R503_EMU_BASE_THRESHOLD 30
+
+// In-memory stand-in for one or more R503 modules sharing a link. Pass it
+// to R503_Fingerprint or R503_Bus as the Stream to run without hardware.
+//
+// Fingerprints are modelled as feature vectors of R503_EMU_TEMPLATE_SIZE
+// bytes. Images are R503_EMU_IMAGE_SIZE bytes and IMG2TZ extracts each
+// feature byte as the mean of four pixels. Images can come from the sensor
+// (placeFinger/placeImage, then GENIMG) or from the host via DOWNIMAGE. The
+// match score is the share of identical feature bytes scaled to 0..300.
+class R503_Emulator : public Stream {
+public:
+  R503_Emulator();
+  
+  // Returns the module handle, or -1 if the table is full
+  int8_t addModule(uint32_t address = R503_DEFAULT_ADDRESS,
+                   uint32_t password = R503_DEFAULT_PASSWORD);
+  
+  // Sensor simulation
+  void placeFinger(uint8_t module, const uint8_t *features);
+  void placeImage(uint8_t module, const uint8_t *image);
+  void removeFinger(uint8_t module);
+  bool enrollDirect(uint8_t module, uint16_t pageID, const uint8_t *features);
+  
+  // Delay before the reply to an opcode becomes visible to the host
+  void setServiceTime(uint8_t opcode, uint16_t ms);
+  
+  // Delay of GENIMG and GETIMAGEEX with no finger on the sensor, which a
+  // real module answers without capturing (replaces their service time)
+  void setNoFingerTime(uint16_t ms);
+  
+  // Extra SEARCH time for every page in the requested range
+  void setSearchCostPerPage(uint16_t us);
+  
+  // Release reply bytes at the pace of a UART at baud (10 bits per byte)
+  // instead of all at once; 0 turns pacing off
+  void setLineRate(uint32_t baud);
+  
+  // Corrupt roughly one in every oneIn bytes sent to the host (0 = clean line)
+  void setCorruptionRate(uint16_t oneIn);
+  
+  uint32_t getCommandCount(uint8_t module);
+  uint8_t getLedControl(uint8_t module);
+  uint8_t getLedColor(uint8_t module);
+  
+  // Stream interface
+  int available();
+  int read();
+  int peek();
+  size_t write(uint8_t byte);
+  using Print::write;
+  
+private:
+  struct EmuModule {
+    uint32_t address;
+    uint32_t password;
+    uint8_t securityLevel;
+    uint8_t packetSizeCode;
+    uint8_t baudMultiplier;
+    bool fingerPresent;
+    bool imageValid;
+    uint8_t image[R503_EMU_IMAGE_SIZE];
+    uint8_t sensorImage[R503_EMU_IMAGE_SIZE];
+    uint8_t charBuffer[2][R503_EMU_TEMPLATE_SIZE];
+    uint8_t library[R503_EMU_LIBRARY_SIZE][R503_EMU_TEMPLATE_SIZE];
+    uint8_t occupied[(R503_EMU_LIBRARY_SIZE + 7) / 8];
+    uint8_t notepad[16][32];
+    uint8_t ledControl;
+    uint8_t ledColor;
+    uint8_t tx[R503_EMU_TX_BUFFER];
+    uint16_t txLen;
+    uint32_t readyAt;
+    uint32_t released;
+    bool downloading;
+    uint8_t downloadSlot;
+    bool downloadImage;
+    uint16_t downloadOffset;
+    uint32_t commandCount;
+  };
+  
+  EmuModule modules[R503_EMU_MAX_MODULES];
+  uint8_t moduleCount;
+  uint16_t serviceTime[256];
+  uint16_t noFingerTime;
+  uint16_t searchCostPerPage;
+  uint32_t lineRate;
+  uint16_t corruptOneIn;
+  uint32_t noiseState;
+  
+  uint8_t rx[R503_EMU_RX_BUFFER];
+  uint16_t rxHead;
+  uint16_t rxCount;
+  
+  uint8_t frameBuffer[R503_MAX_PACKET_DATA];
+  R503_FrameParser parser;
+  
+  void pump();
+  void handleFrame();
+  void handleCommand(EmuModule &m, const uint8_t *cmd, uint16_t len);
+  void handleDownload(EmuModule &m, uint8_t pid, const uint8_t *data, uint16_t len);
+  void queueFrame(EmuModule &m, uint8_t pid, const uint8_t *data, uint16_t len);
+  void reply(EmuModule &m, uint8_t code, const uint8_t *data = NULL, uint16_t len = 0);
+  void replyData(EmuModule &m, const uint8_t *data, uint16_t len);
+  
+  void extractFeatures(const uint8_t *image, uint8_t *features);
+  uint16_t score(const uint8_t *a, const uint8_t *b);
+  uint16_t threshold(EmuModule &m);
+  bool isOccupied(EmuModule &m, uint16_t pageID);
+  void setOccupied(EmuModule &m, uint16_t pageID, bool value);
+  uint8_t bufferIndex(uint8_t slot);
+};
+
+#endif // R503_EMULATOR_H
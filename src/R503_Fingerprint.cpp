@@ -1,19 +1,66 @@
 // R503_Fingerprint.cpp
 #include "R503_Fingerprint.h"
+#include "R503_Frame.h"
+#include "R503_Journal.h"
+
+#if R503_ENROLL_PROMPTS
+#define R503_PROMPT(text) Serial.println(text)
+#else
+#define R503_PROMPT(text)
+#endif
 
 R503_Fingerprint::R503_Fingerprint(HardwareSerial *serial) {
   this->serial = serial;
+  this->hwSerial = serial;
   this->password = R503_DEFAULT_PASSWORD;
   this->address = R503_DEFAULT_ADDRESS;
   this->timeout = R503_DEFAULT_TIMEOUT;
   this->lastConfirmCode = 0xFF;
+  this->pendingAcks = 0;
+  this->retries = 2;
+  this->lastError = R503_ERR_NONE;
+  this->linkDirty = false;
+  memset(&linkStats, 0, sizeof(linkStats));
+  this->infoValid = 0;
+  this->dedupMode = R503_DEDUP_OFF;
+  this->enrolledID = 0;
+  this->preemptHook = NULL;
+  this->preemptContext = NULL;
+  this->preemptCheckedAt = 0;
+  this->preemptBlocked = false;
+  this->journal = NULL;
+}
+
+R503_Fingerprint::R503_Fingerprint(Stream *stream) {
+  this->serial = stream;
+  this->hwSerial = NULL;
+  this->password = R503_DEFAULT_PASSWORD;
+  this->address = R503_DEFAULT_ADDRESS;
+  this->timeout = R503_DEFAULT_TIMEOUT;
+  this->lastConfirmCode = 0xFF;
+  this->pendingAcks = 0;
+  this->retries = 2;
+  this->lastError = R503_ERR_NONE;
+  this->linkDirty = false;
+  memset(&linkStats, 0, sizeof(linkStats));
+  this->infoValid = 0;
+  this->dedupMode = R503_DEDUP_OFF;
+  this->enrolledID = 0;
+  this->preemptHook = NULL;
+  this->preemptContext = NULL;
+  this->preemptCheckedAt = 0;
+  this->preemptBlocked = false;
+  this->journal = NULL;
 }
 
 bool R503_Fingerprint::begin(uint32_t baud, uint32_t password, uint32_t address) {
   this->password = password;
   this->address = address;
   
-  serial->begin(baud);
+  // Non-UART streams (emulator, bus adapters) are already configured
+  if (hwSerial) {
+    hwSerial->begin(baud);
+  }
   delay(R503_RESET_DELAY);
   
   // Wait for handshake signal 0x55
@@ -37,6 +84,11 @@ bool R503_Fingerprint::begin(uint32_t baud, uint32_t password, uint32_t address)
 
 void R503_Fingerprint::setTimeout(uint32_t timeout) {
   this->timeout = timeout;
+  timeoutModel.setLimits(R503_TIMEOUT_FLOOR, timeout);
+}
+
+void R503_Fingerprint::setRetries(uint8_t retries) {
+  this->retries = retries;
 }
 
 bool R503_Fingerprint::verifyPassword(uint32_t password) {
@@ -47,16 +99,17 @@ bool R503_Fingerprint::verifyPassword(uint32_t password) {
   packet[3] = (password >> 8) & 0xFF;
   packet[4] = password & 0xFF;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 5)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 5, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
 
 bool R503_Fingerprint::setPassword(uint32_t password) {
+  // Invalidate even if the reply is lost; the module may have applied it
+  infoValid = 0;
+  
   uint8_t packet[5];
   packet[0] = R503_SETPWD;
   packet[1] = (password >> 24) & 0xFF;
@@ -64,11 +117,9 @@ bool R503_Fingerprint::setPassword(uint32_t password) {
   packet[3] = (password >> 8) & 0xFF;
   packet[4] = password & 0xFF;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 5)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 5, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode == R503_OK) {
     this->password = password;
@@ -78,6 +129,8 @@ bool R503_Fingerprint::setPassword(uint32_t password) {
 }
 
 bool R503_Fingerprint::setAddress(uint32_t address) {
+  infoValid = 0;
+  
   uint8_t packet[5];
   packet[0] = R503_SETADDER;
   packet[1] = (address >> 24) & 0xFF;
@@ -85,11 +138,9 @@ bool R503_Fingerprint::setAddress(uint32_t address) {
   packet[3] = (address >> 8) & 0xFF;
   packet[4] = address & 0xFF;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 5)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 5, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode == R503_OK) {
     this->address = address;
@@ -99,16 +150,16 @@ bool R503_Fingerprint::setAddress(uint32_t address) {
 }
 
 bool R503_Fingerprint::setSystemParameter(uint8_t paramNumber, uint8_t value) {
+  infoValid = 0;
+  
   uint8_t packet[3];
   packet[0] = R503_SETSYSPARA;
   packet[1] = paramNumber;
   packet[2] = value;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 3)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 3, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
@@ -117,11 +168,9 @@ bool R503_Fingerprint::readSystemParameters(R503_SystemParams &params) {
   uint8_t packet[1];
   packet[0] = R503_READSYSPARA;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[32];
+  uint8_t response[R503_ACK_SYSPARA_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode == R503_OK && len >= 17) {
     params.statusRegister = (response[1] << 8) | response[2];
@@ -132,6 +181,8 @@ bool R503_Fingerprint::readSystemParameters(R503_SystemParams &params) {
                           ((uint32_t)response[11] << 8) | response[12];
     params.dataPacketSize = (response[13] << 8) | response[14];
     params.baudRate = (response[15] << 8) | response[16];
+    deviceInfo.params = params;
+    infoValid |= R503_INFO_PARAMS;
     return true;
   }
   return false;
@@ -142,11 +193,9 @@ bool R503_Fingerprint::portControl(bool enable) {
   packet[0] = R503_CONTROL;
   packet[1] = enable ? 1 : 0;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 2)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 2, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
@@ -155,11 +204,9 @@ bool R503_Fingerprint::getTemplateCount(uint16_t &count) {
   uint8_t packet[1];
   packet[0] = R503_TEMPLATENUM;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_COUNT_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode == R503_OK && len >= 3) {
     count = (response[1] << 8) | response[2];
@@ -173,11 +220,9 @@ bool R503_Fingerprint::readIndexTable(uint8_t page, uint8_t *indexTable) {
   packet[0] = R503_READINDEXTABLE;
   packet[1] = page;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 2)) return false;
-  
-  uint8_t response[64];
+  uint8_t response[R503_ACK_INDEX_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 2, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode == R503_OK && len >= 33) {
     memcpy(indexTable, response + 1, 32);
@@ -190,11 +235,9 @@ bool R503_Fingerprint::handshake() {
   uint8_t packet[1];
   packet[0] = R503_HANDSHAKE;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
@@ -203,24 +246,21 @@ bool R503_Fingerprint::checkSensor() {
   uint8_t packet[1];
   packet[0] = R503_CHECKSENSOR;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
 
+#if R503_ENABLE_INFO
 bool R503_Fingerprint::getAlgorithmVersion(char *version) {
   uint8_t packet[1];
   packet[0] = R503_GETALGVER;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[64];
+  uint8_t response[R503_ACK_VERSION_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode == R503_OK && len >= 33) {
     memcpy(version, response + 1, 32);
@@ -234,11 +274,9 @@ bool R503_Fingerprint::getFirmwareVersion(char *version) {
   uint8_t packet[1];
   packet[0] = R503_GETFWVER;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[64];
+  uint8_t response[R503_ACK_VERSION_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode == R503_OK && len >= 33) {
     memcpy(version, response + 1, 32);
@@ -252,11 +290,9 @@ bool R503_Fingerprint::readProductInfo(R503_ProductInfo &info) {
   uint8_t packet[1];
   packet[0] = R503_READPRODINFO;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[64];
+  uint8_t response[R503_ACK_PRODINFO_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode == R503_OK && len >= 47) {
     memcpy(info.moduleType, response + 1, 16);
@@ -272,20 +308,23 @@ bool R503_Fingerprint::readProductInfo(R503_ProductInfo &info) {
     info.sensorHeight = (response[41] << 8) | response[42];
     info.templateSize = (response[43] << 8) | response[44];
     info.databaseSize = (response[45] << 8) | response[46];
+    deviceInfo.product = info;
+    infoValid |= R503_INFO_PRODUCT;
     return true;
   }
   return false;
 }
+#endif
 
 bool R503_Fingerprint::softReset() {
+  infoValid = 0;
+  
   uint8_t packet[1];
   packet[0] = R503_SOFTRST;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode == R503_OK) {
     delay(R503_RESET_DELAY);
@@ -295,15 +334,63 @@ bool R503_Fingerprint::softReset() {
   return false;
 }
 
+bool R503_Fingerprint::getSystemParams(R503_SystemParams &params) {
+  if (!(infoValid & R503_INFO_PARAMS)) {
+    R503_SystemParams fresh;
+    if (!readSystemParameters(fresh)) return false;
+  }
+  params = deviceInfo.params;
+  return true;
+}
+
+#if R503_ENABLE_INFO
+bool R503_Fingerprint::getProductInfo(R503_ProductInfo &info) {
+  if (!(infoValid & R503_INFO_PRODUCT)) {
+    R503_ProductInfo fresh;
+    if (!readProductInfo(fresh)) return false;
+  }
+  info = deviceInfo.product;
+  return true;
+}
+
+bool R503_Fingerprint::getFirmwareVersionCached(char *version) {
+  if (!(infoValid & R503_INFO_FIRMWARE)) {
+    if (!getFirmwareVersion(deviceInfo.firmwareVersion)) return false;
+    infoValid |= R503_INFO_FIRMWARE;
+  }
+  strcpy(version, deviceInfo.firmwareVersion);
+  return true;
+}
+
+bool R503_Fingerprint::getAlgorithmVersionCached(char *version) {
+  if (!(infoValid & R503_INFO_ALGORITHM)) {
+    if (!getAlgorithmVersion(deviceInfo.algorithmVersion)) return false;
+    infoValid |= R503_INFO_ALGORITHM;
+  }
+  strcpy(version, deviceInfo.algorithmVersion);
+  return true;
+}
+#endif
+
+uint16_t R503_Fingerprint::getDataPacketSize() {
+  R503_SystemParams params;
+  if (!getSystemParams(params)) return 0;
+  return 32 << min(params.dataPacketSize, (uint16_t)R503_PACKAGE_SIZE_256);
+}
+
+uint32_t R503_Fingerprint::getBaudRate() {
+  R503_SystemParams params;
+  if (!getSystemParams(params)) return 0;
+  return 9600UL * params.baudRate;
+}
+
 bool R503_Fingerprint::getImage() {
   uint8_t packet[1];
   packet[0] = R503_GENIMG;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
@@ -312,11 +399,9 @@ bool R503_Fingerprint::getImageEx() {
   uint8_t packet[1];
   packet[0] = R503_GETIMAGEEX;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
@@ -326,11 +411,9 @@ bool R503_Fingerprint::image2Tz(uint8_t slot) {
   packet[0] = R503_IMG2TZ;
   packet[1] = slot;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 2)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 2, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
@@ -339,11 +422,9 @@ bool R503_Fingerprint::createModel() {
   uint8_t packet[1];
   packet[0] = R503_REGMODEL;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
@@ -355,11 +436,9 @@ bool R503_Fingerprint::storeModel(uint8_t slot, uint16_t pageID) {
   packet[2] = (pageID >> 8) & 0xFF;
   packet[3] = pageID & 0xFF;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 4)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 4, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
@@ -371,11 +450,9 @@ bool R503_Fingerprint::loadModel(uint8_t slot, uint16_t pageID) {
   packet[2] = (pageID >> 8) & 0xFF;
   packet[3] = pageID & 0xFF;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 4)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 4, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
@@ -388,11 +465,9 @@ bool R503_Fingerprint::deleteModel(uint16_t startPage, uint16_t count) {
   packet[3] = (count >> 8) & 0xFF;
   packet[4] = count & 0xFF;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 5)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 5, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
@@ -401,11 +476,9 @@ bool R503_Fingerprint::emptyDatabase() {
   uint8_t packet[1];
   packet[0] = R503_EMPTY;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
@@ -414,11 +487,9 @@ bool R503_Fingerprint::matchTemplates(uint16_t &score) {
   uint8_t packet[1];
   packet[0] = R503_MATCH;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_MATCH_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode == R503_OK && len >= 3) {
     score = (response[1] << 8) | response[2];
@@ -437,11 +508,9 @@ bool R503_Fingerprint::searchLibrary(uint8_t slot, uint16_t startPage, uint16_t
   packet[4] = (count >> 8) & 0xFF;
   packet[5] = count & 0xFF;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 6)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SEARCH_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 6, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode == R503_OK && len >= 5) {
     fingerID = (response[1] << 8) | response[2];
@@ -456,15 +525,7 @@ bool R503_Fingerprint::uploadCharacteristics(uint8_t slot, uint8_t *buffer, uint
   packet[0] = R503_UPCHAR;
   packet[1] = slot;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 2)) return false;
-  
-  uint8_t response[16];
-  uint16_t len;
-  if (!receiveAck(response, len)) return false;
-  
-  if (lastConfirmCode != R503_OK) return false;
-  
-  return receiveData(buffer, 1024, length);
+  return sendDataCommand(packet, 2, buffer, R503_TEMPLATE_BUFFER_SIZE, length);
 }
 
 bool R503_Fingerprint::downloadCharacteristics(uint8_t slot, uint8_t *buffer, uint16_t length) {
@@ -472,17 +533,15 @@ bool R503_Fingerprint::downloadCharacteristics(uint8_t slot, uint8_t *buffer, ui
   packet[0] = R503_DOWNCHAR;
   packet[1] = slot;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 2)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 2, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode != R503_OK) return false;
   
   // Send data packets
   uint16_t offset = 0;
-  uint16_t packetSize = 128; // Can be 32, 64, 128, or 256
+  uint16_t packetSize = transferPacketSize();
   
   while (offset < length) {
     uint16_t chunkSize = min((uint16_t)(length - offset), packetSize);
@@ -496,37 +555,28 @@ bool R503_Fingerprint::downloadCharacteristics(uint8_t slot, uint8_t *buffer, ui
   return true;
 }
 
+#if R503_ENABLE_IMAGE
 bool R503_Fingerprint::uploadImage(uint8_t *buffer, uint32_t &length) {
   uint8_t packet[1];
   packet[0] = R503_UPIMAGE;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[16];
-  uint16_t len;
-  if (!receiveAck(response, len)) return false;
-  
-  if (lastConfirmCode != R503_OK) return false;
-  
   length = 0;
   uint16_t tempLen;
-  return receiveData(buffer, 36864, tempLen) && (length = tempLen, true);
+  return sendDataCommand(packet, 1, buffer, R503_IMAGE_BUFFER_SIZE, tempLen) && (length = tempLen, true);
 }
 
 bool R503_Fingerprint::downloadImage(uint8_t *buffer, uint32_t length) {
   uint8_t packet[1];
   packet[0] = R503_DOWNIMAGE;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode != R503_OK) return false;
   
   uint32_t offset = 0;
-  uint16_t packetSize = 128;
+  uint16_t packetSize = transferPacketSize();
   
   while (offset < length) {
     uint16_t chunkSize = min((uint32_t)(length - offset), (uint32_t)packetSize);
@@ -539,7 +589,9 @@ bool R503_Fingerprint::downloadImage(uint8_t *buffer, uint32_t length) {
   
   return true;
 }
+#endif
 
+#if R503_ENABLE_LED
 bool R503_Fingerprint::setLED(uint8_t control, uint8_t speed, uint8_t color, uint8_t times) {
   uint8_t packet[5];
   packet[0] = R503_AURALEDCONFIG;
@@ -548,15 +600,44 @@ bool R503_Fingerprint::setLED(uint8_t control, uint8_t speed, uint8_t color, uin
   packet[3] = color;
   packet[4] = times;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 5)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 5, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
 
+bool R503_Fingerprint::setLEDAsync(uint8_t control, uint8_t speed, uint8_t color, uint8_t times) {
+  uint8_t packet[5];
+  packet[0] = R503_AURALEDCONFIG;
+  packet[1] = control;
+  packet[2] = speed;
+  packet[3] = color;
+  packet[4] = times;
+  
+  if (!sendPacket(R503_COMMAND_PACKET, packet, 5)) return false;
+  
+  pendingAcks++;
+  return true;
+}
+
+bool R503_Fingerprint::drainPendingAcks() {
+  // The module handles one command at a time, so outstanding LED ACKs have
+  // to be consumed before the next command goes out. They normally arrived
+  // while the host was busy elsewhere and are already sitting in the FIFO.
+  while (pendingAcks > 0) {
+    uint8_t response[R503_ACK_SIZE];
+    uint16_t len;
+    if (!receiveAck(response, sizeof(response), len, timeoutModel.deadline(R503_AURALEDCONFIG))) {
+      pendingAcks = 0;
+      flushInput();
+      return false;
+    }
+    pendingAcks--;
+  }
+  return true;
+}
+
 bool R503_Fingerprint::ledOn(uint8_t color) {
   return setLED(R503_LED_ON, 0, color, 0);
 }
@@ -572,7 +653,9 @@ bool R503_Fingerprint::ledBreathe(uint8_t color, uint8_t speed, uint8_t times) {
 bool R503_Fingerprint::ledFlash(uint8_t color, uint8_t speed, uint8_t times) {
   return setLED(R503_LED_FLASHING, speed, color, times);
 }
+#endif
 
+#if R503_ENABLE_NOTEPAD
 bool R503_Fingerprint::writeNotepad(uint8_t page, uint8_t *data) {
   if (page > 15) return false;
   
@@ -581,11 +664,9 @@ bool R503_Fingerprint::writeNotepad(uint8_t page, uint8_t *data) {
   packet[1] = page;
   memcpy(packet + 2, data, 32);
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 34)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 34, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
@@ -597,11 +678,9 @@ bool R503_Fingerprint::readNotepad(uint8_t page, uint8_t *data) {
   packet[0] = R503_READNOTEPAD;
   packet[1] = page;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 2)) return false;
-  
-  uint8_t response[64];
+  uint8_t response[R503_ACK_NOTEPAD_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 2, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode == R503_OK && len >= 33) {
     memcpy(data, response + 1, 32);
@@ -609,16 +688,15 @@ bool R503_Fingerprint::readNotepad(uint8_t page, uint8_t *data) {
   }
   return false;
 }
+#endif
 
 bool R503_Fingerprint::getRandomCode(uint32_t &randomNumber) {
   uint8_t packet[1];
   packet[0] = R503_GETRANDOMCODE;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_RANDOM_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   if (lastConfirmCode == R503_OK && len >= 5) {
     randomNumber = ((uint32_t)response[1] << 24) | ((uint32_t)response[2] << 16) |
@@ -628,289 +706,586 @@ bool R503_Fingerprint::getRandomCode(uint32_t &randomNumber) {
   return false;
 }
 
+#if R503_ENABLE_INFO
 bool R503_Fingerprint::readInformationPage(uint8_t *buffer) {
   uint8_t packet[1];
   packet[0] = R503_READINFPAGE;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[16];
-  uint16_t len;
-  if (!receiveAck(response, len)) return false;
-  
-  if (lastConfirmCode != R503_OK) return false;
-  
   uint16_t dataLen;
-  return receiveData(buffer, 512, dataLen);
+  return sendDataCommand(packet, 1, buffer, R503_INFO_PAGE_SIZE, dataLen);
 }
+#endif
 
 bool R503_Fingerprint::cancel() {
   uint8_t packet[1];
   packet[0] = R503_CANCEL;
   
-  if (!sendPacket(R503_COMMAND_PACKET, packet, 1)) return false;
-  
-  uint8_t response[16];
+  uint8_t response[R503_ACK_SIZE];
   uint16_t len;
-  if (!receiveAck(response, len)) return false;
+  if (!sendCommand(packet, 1, response, sizeof(response), len)) return false;
   
   return lastConfirmCode == R503_OK;
 }
 
+void R503_Fingerprint::setPreemptHook(bool (*hook)(void *context), void *context) {
+  preemptHook = hook;
+  preemptContext = context;
+}
+
 bool R503_Fingerprint::enrollFingerprint(uint16_t pageID, uint8_t enrollCount) {
+  uint32_t startedAt = millis();
+  bool ok = enrollModel(pageID, enrollCount);
+  
+  // A preempted enrollment is retried later and logged then
+  if (!wasPreempted()) {
+    logEvent(R503_EVENT_ENROLL, ok ? enrolledID : R503_JOURNAL_NO_ID, 0, startedAt);
+  }
+  return ok;
+}
+
+bool R503_Fingerprint::enrollModel(uint16_t pageID, uint8_t enrollCount) {
   if (enrollCount < 2 || enrollCount > 6) enrollCount = 6;
   
   // Collect first image
-  Serial.println("Place finger...");
+  R503_PROMPT("Place finger...");
   while (!getImage()) {
-    delay(100);
+    if (wasPreempted() || !preemptibleDelay(100)) return false;
   }
-  Serial.println("Image captured");
+  R503_PROMPT("Image captured");
   
   if (!image2Tz(R503_CHARBUFFER1)) {
-    Serial.println("Failed to convert image 1");
+    R503_PROMPT("Failed to convert image 1");
     return false;
   }
   
-  Serial.println("Remove finger");
-  delay(1000);
+  R503_PROMPT("Remove finger");
+  if (!preemptibleDelay(1000)) return false;
   
   // Collect remaining images
   for (uint8_t i = 1; i < enrollCount; i++) {
+#if R503_ENROLL_PROMPTS
     Serial.print("Place same finger again (");
     Serial.print(i + 1);
     Serial.print("/");
     Serial.print(enrollCount);
     Serial.println(")...");
+#endif
     
     while (!getImage()) {
-      delay(100);
+      if (wasPreempted() || !preemptibleDelay(100)) return false;
     }
-    Serial.println("Image captured");
+    R503_PROMPT("Image captured");
     
     if (!image2Tz(R503_CHARBUFFER2)) {
-      Serial.println("Failed to convert image");
+      R503_PROMPT("Failed to convert image");
       return false;
     }
     
     if (i == 1) {
       if (!createModel()) {
-        Serial.println("Failed to create model");
+        R503_PROMPT("Failed to create model");
         return false;
       }
     }
     
     if (i < enrollCount - 1) {
-      Serial.println("Remove finger");
-      delay(1000);
+      R503_PROMPT("Remove finger");
+      if (!preemptibleDelay(1000)) return false;
+    }
+  }
+  
+  // Check whether this finger is already enrolled under another ID
+  uint16_t storeID = pageID;
+  if (dedupMode != R503_DEDUP_OFF) {
+    R503_SystemParams params;
+    if (!getSystemParams(params)) {
+      R503_PROMPT("Failed to read library size");
+      return false;
+    }
+    
+    uint16_t existingID;
+    uint16_t score;
+    if (searchLibrary(R503_CHARBUFFER1, 0, params.librarySize, existingID, score)) {
+      if (existingID != pageID) {
+#if R503_ENROLL_PROMPTS
+        Serial.print("Finger already enrolled as ID ");
+        Serial.println(existingID);
+#endif
+        
+        if (dedupMode == R503_DEDUP_REJECT) {
+          enrolledID = existingID;
+          lastError = R503_ERR_DUPLICATE;
+          return false;
+        }
+        storeID = existingID;
+      }
+    } else if (lastConfirmCode != R503_NOTFOUND) {
+      R503_PROMPT("Failed to search for duplicates");
+      return false;
     }
   }
   
   // Store the template
-  if (!storeModel(R503_CHARBUFFER1, pageID)) {
-    Serial.println("Failed to store model");
+  if (!storeModel(R503_CHARBUFFER1, storeID)) {
+    R503_PROMPT("Failed to store model");
     return false;
   }
+  enrolledID = storeID;
   
-  Serial.println("Fingerprint enrolled successfully!");
+  R503_PROMPT("Fingerprint enrolled successfully!");
   return true;
 }
 
 bool R503_Fingerprint::verifyFingerprint(uint16_t &fingerID, uint16_t &confidence) {
+  uint32_t startedAt = millis();
   if (!getImage()) {
     return false;
   }
   
-  if (!image2Tz(R503_CHARBUFFER1)) {
-    return false;
-  }
-  
+  // Only attempts with a finger on the sensor are journaled
+  bool found = false;
   R503_SystemParams params;
-  if (!readSystemParameters(params)) {
-    return false;
+  if (image2Tz(R503_CHARBUFFER1) && getSystemParams(params)) {
+    found = searchLibrary(R503_CHARBUFFER1, 0, params.librarySize, fingerID, confidence);
   }
   
-  return searchLibrary(R503_CHARBUFFER1, 0, params.librarySize, fingerID, confidence);
+  logEvent(R503_EVENT_IDENTIFY, found ? fingerID : R503_JOURNAL_NO_ID, found ? confidence : 0,
+           startedAt);
+  return found;
 }
 
-bool R503_Fingerprint::sendPacket(uint8_t packetType, uint8_t *data, uint16_t dataLen) {
-  uint16_t length = dataLen + 2;
-  
-  if (!writePacketHeader(packetType, length)) return false;
-  
-  uint16_t checksum = packetType + ((length >> 8) & 0xFF) + (length & 0xFF);
+bool R503_Fingerprint::verifyClaimed(uint16_t claimedID, uint16_t &score) {
+  uint32_t startedAt = millis();
   
-  for (uint16_t i = 0; i < dataLen; i++) {
-    serial->write(data[i]);
-    checksum += data[i];
+  // The claimed template goes into CHARBUFFER2 first, so it is in place
+  // while the finger is still on its way to the sensor
+  if (!loadModel(R503_CHARBUFFER2, claimedID)) {
+    return false;
   }
   
-  writeU16(checksum);
+  if (!getImage()) {
+    return false;
+  }
   
-  return true;
+  bool matched = image2Tz(R503_CHARBUFFER1) && matchTemplates(score);
+  logEvent(R503_EVENT_VERIFY, claimedID, matched ? score : 0, startedAt);
+  return matched;
 }
 
-bool R503_Fingerprint::receivePacket(uint8_t *buffer, uint16_t &length, uint8_t expectedType) {
-  uint32_t startTime = millis();
-  
-  while (serial->available() < 9) {
-    if (millis() - startTime > timeout) {
-      return false;
-    }
-    delay(1);
-  }
-  
-  uint16_t header = readU16();
-  if (header != R503_STARTCODE) {
+bool R503_Fingerprint::verifyClaimed(const uint8_t *claimedTemplate, uint16_t length, uint16_t &score) {
+  uint32_t startedAt = millis();
+  if (!downloadCharacteristics(R503_CHARBUFFER2, (uint8_t *)claimedTemplate, length)) {
     return false;
   }
   
-  uint32_t addr = readU32();
-  if (addr != address) {
+  if (!getImage()) {
     return false;
   }
   
-  uint8_t pid = serial->read();
-  if (pid != expectedType) {
-    return false;
+  bool matched = image2Tz(R503_CHARBUFFER1) && matchTemplates(score);
+  logEvent(R503_EVENT_VERIFY, R503_JOURNAL_NO_ID, matched ? score : 0, startedAt);
+  return matched;
+}
+
+void R503_Fingerprint::logEvent(uint8_t type, uint16_t fingerID, uint16_t score, uint32_t startedAt) {
+  if (journal) {
+    journal->log(type, lastConfirmCode, fingerID, score, millis() - startedAt);
   }
-  
-  uint16_t len = readU16();
-  if (len < 2) {
-    return false;
+}
+
+bool R503_Fingerprint::sendPacket(uint8_t packetType, uint8_t *data, uint16_t dataLen) {
+  if (packetType == R503_COMMAND_PACKET) {
+#if R503_ENABLE_LED
+    if (pendingAcks > 0) {
+      drainPendingAcks();
+    }
+#endif
+    if (linkDirty) {
+      clearSerialBuffer();
+      linkDirty = false;
+    }
   }
   
-  length = len - 2;
+  if (dataLen > R503_MAX_PACKET_DATA) return false;
+  if (dataLen > R503_TX_BUFFER) return sendLongPacket(packetType, data, dataLen);
+  
+  // Assemble the whole frame so it goes out in a single write
+  uint8_t frame[R503_TX_BUFFER + R503_FRAME_OVERHEAD];
+  uint16_t frameLen = R503_Frame::build(frame, address, packetType, data, dataLen);
   
-  startTime = millis();
-  while (serial->available() < length + 2) {
-    if (millis() - startTime > timeout) {
+  return serial->write(frame, frameLen) == frameLen;
+}
+
+bool R503_Fingerprint::sendLongPacket(uint8_t packetType, uint8_t *data, uint16_t dataLen) {
+  // Data packets larger than the transmit buffer are written straight from
+  // the caller's buffer, framed by a separately built header and checksum
+  uint8_t header[R503_FRAME_OVERHEAD];
+  R503_Frame::build(header, address, packetType, NULL, 0);
+  uint16_t packetLen = dataLen + 2;
+  header[7] = packetLen >> 8;
+  header[8] = packetLen & 0xFF;
+  
+  uint16_t sum = R503_Frame::checksum(data, dataLen, R503_Frame::checksum(header + 6, 3));
+  uint8_t trailer[2];
+  trailer[0] = sum >> 8;
+  trailer[1] = sum & 0xFF;
+  
+  return serial->write(header, R503_FRAME_HEADER_SIZE) == R503_FRAME_HEADER_SIZE &&
+         serial->write(data, dataLen) == dataLen &&
+         serial->write(trailer, sizeof(trailer)) == sizeof(trailer);
+}
+
+bool R503_Fingerprint::sendCommand(uint8_t *packet, uint16_t packetLen,
+                                   uint8_t *response, uint16_t responseSize, uint16_t &length,
+                                   bool retry) {
+  uint8_t opcode = packet[0];
+  uint8_t attempts = (retry && isIdempotent(opcode)) ? retries + 1 : 1;
+  uint16_t count = (opcode == R503_SEARCH && packetLen >= 6) ? (packet[4] << 8) | packet[5] : 0;
+  uint8_t lateReplies = 0;
+  
+  linkStats.commands++;
+  lastConfirmCode = 0xFF;
+  
+  for (uint8_t attempt = 0; attempt < attempts; attempt++) {
+    // The model backs off after every timeout, so each retry waits longer
+    uint32_t waitTime = timeoutModel.deadline(opcode, count);
+    
+    if (attempt > 0) {
+      linkStats.retries++;
+    }
+    
+    if (!sendPacket(R503_COMMAND_PACKET, packet, packetLen)) return false;
+    uint32_t sentAt = millis();
+    
+    if (receiveAck(response, responseSize, length, waitTime)) {
+      // After a timeout the reply may be the late one to an earlier attempt,
+      // so it is not timed and the backoff stays until a clean exchange
+      if (lateReplies > 0) {
+        drainLateReplies(lateReplies);
+      } else {
+        timeoutModel.record(opcode, count, millis() - sentAt, lastConfirmCode);
+      }
+      return true;
+    }
+    
+    if (lastError == R503_ERR_PREEMPTED) {
+      abortExchange(1);
       return false;
     }
-    delay(1);
+    
+    if (lastError == R503_ERR_TIMEOUT) {
+      linkStats.timeouts++;
+      timeoutModel.recordTimeout(opcode);
+      lateReplies++;
+    } else {
+      linkStats.corruptFrames++;
+    }
+    flushInput();
   }
   
-  uint16_t calcChecksum = pid + ((len >> 8) & 0xFF) + (len & 0xFF);
-  
-  for (uint16_t i = 0; i < length; i++) {
-    buffer[i] = serial->read();
-    calcChecksum += buffer[i];
+  if (lateReplies > 0) {
+    drainLateReplies(lateReplies);
+  }
+  return false;
+}
+
+bool R503_Fingerprint::sendDataCommand(uint8_t *packet, uint16_t packetLen,
+                                       uint8_t *buffer, uint16_t maxLength, uint16_t &actualLength) {
+  uint8_t attempts = isIdempotent(packet[0]) ? retries + 1 : 1;
+  bool received = false;
+  
+  // The module streams the data phase without flow control and reads
+  // CANCEL only after it, so preempting a transfer would not free the link
+  // any sooner; it would only throw the data away
+  bool blocked = preemptBlocked;
+  preemptBlocked = true;
+  
+  // Retries happen here only: a lost ACK or a broken transfer both repeat
+  // the whole exchange, so at most retries + 1 commands go out
+  for (uint8_t attempt = 0; attempt < attempts && !received; attempt++) {
+    if (attempt > 0) {
+      linkStats.retries++;
+    }
+    
+    // sendCommand has already counted and flushed a failed attempt
+    uint8_t response[R503_ACK_SIZE];
+    uint16_t len;
+    if (!sendCommand(packet, packetLen, response, sizeof(response), len, false)) continue;
+    if (lastConfirmCode != R503_OK) break;
+    
+    received = receiveData(buffer, maxLength, actualLength);
+    if (!received) {
+      // Let the rest of the broken transfer pass before asking again
+      if (lastError == R503_ERR_TIMEOUT) {
+        linkStats.timeouts++;
+      } else {
+        linkStats.corruptFrames++;
+      }
+      flushInput();
+    }
   }
   
-  uint16_t checksum = readU16();
+  preemptBlocked = blocked;
+  return received;
+}
+
+bool R503_Fingerprint::receivePacket(uint8_t *buffer, uint16_t maxLength, uint16_t &length,
+                                     uint8_t &pid, uint32_t waitTime) {
+  R503_FrameParser parser(buffer, maxLength);
+  parser.setOwnAddress(address);
+  bool inFrame = false;
+  bool foreignFrame = false;
+  uint32_t startTime = millis();
   
-  return (checksum == calcChecksum);
+  while (true) {
+    if (!serial->available()) {
+      // A frame that has started is read to the end, or the drain after a
+      // preempt would miss its ACK
+      if (!inFrame && checkPreempt()) return false;
+      if (millis() - startTime > waitTime) {
+        if (inFrame) {
+          lastError = R503_ERR_TRUNCATED;
+        } else {
+          lastError = foreignFrame ? R503_ERR_ADDRESS : R503_ERR_TIMEOUT;
+        }
+        return false;
+      }
+      delay(1);
+      continue;
+    }
+    
+    R503_FrameParser::Result result = parser.feed(serial->read());
+    
+    if (result == R503_FrameParser::NEED_MORE) {
+      // A lone 0xEF is not a frame yet; a glitch byte followed by the real
+      // start code must not cost the reply
+      inFrame = parser.hasStartCode();
+      continue;
+    }
+    
+    if (result == R503_FrameParser::BAD_START) {
+      // Stray bytes between frames are line noise and are skipped; a bad
+      // byte inside a frame means the frame is lost
+      if (inFrame) {
+        lastError = R503_ERR_BAD_START;
+        return false;
+      }
+      linkStats.noiseBytes++;
+      continue;
+    }
+    
+    if (result == R503_FrameParser::FOREIGN_FRAME) {
+      inFrame = false;
+      foreignFrame = true;
+      continue;
+    }
+    
+    if (result == R503_FrameParser::BAD_LENGTH) {
+      lastError = R503_ERR_BAD_LENGTH;
+      return false;
+    }
+    
+    if (result == R503_FrameParser::BAD_CHECKSUM) {
+      lastError = R503_ERR_BAD_CHECKSUM;
+      return false;
+    }
+    
+    // Frames from other modules on a shared link are not ours to consume
+    inFrame = false;
+    if (parser.getAddress() != address) {
+      foreignFrame = true;
+      continue;
+    }
+    
+    pid = parser.getPid();
+    length = parser.getDataLength();
+    lastError = R503_ERR_NONE;
+    return true;
+  }
 }
 
-bool R503_Fingerprint::receiveAck(uint8_t *buffer, uint16_t &length) {
-  if (!receivePacket(buffer, length, R503_ACK_PACKET)) {
+bool R503_Fingerprint::receiveAck(uint8_t *buffer, uint16_t maxLength, uint16_t &length,
+                                  uint32_t waitTime) {
+  uint8_t pid;
+  if (!receivePacket(buffer, maxLength, length, pid, waitTime)) {
     return false;
   }
   
-  if (length > 0) {
-    lastConfirmCode = buffer[0];
+  if (pid != R503_ACK_PACKET || length == 0) {
+    lastError = R503_ERR_BAD_PID;
+    return false;
   }
   
+  lastConfirmCode = buffer[0];
   return true;
 }
 
 bool R503_Fingerprint::receiveData(uint8_t *buffer, uint16_t maxLength, uint16_t &actualLength) {
   actualLength = 0;
-  uint8_t packetType = R503_DATA_PACKET;
   
-  while (packetType != R503_END_DATA_PACKET) {
+  while (true) {
     uint16_t chunkLen;
-    if (!receivePacket(buffer + actualLength, chunkLen, packetType)) {
+    uint8_t pid;
+    if (!receivePacket(buffer + actualLength, maxLength - actualLength, chunkLen, pid,
+                       R503_DATA_TIMEOUT)) {
       return false;
     }
     
-    actualLength += chunkLen;
-    
-    if (actualLength >= maxLength) {
+    if (pid != R503_DATA_PACKET && pid != R503_END_DATA_PACKET) {
+      lastError = R503_ERR_BAD_PID;
       return false;
     }
     
-    packetType = R503_END_DATA_PACKET;
+    actualLength += chunkLen;
     
-    uint32_t startTime = millis();
-    while (serial->available() < 9) {
-      if (millis() - startTime > 100) {
-        break;
-      }
-      delay(1);
+    if (pid == R503_END_DATA_PACKET) {
+      return true;
     }
-    
-    if (serial->available() >= 9) {
-      if (serial->peek() == 0xEF) {
-        uint8_t temp[9];
-        for (int i = 0; i < 9; i++) {
-          temp[i] = serial->read();
-        }
-        
-        if (temp[0] == 0xEF && temp[1] == 0x01) {
-          uint8_t pid = temp[8];
-          if (pid == R503_DATA_PACKET) {
-            for (int i = 0; i < 9; i++) {
-              serial->available();
-            }
-            packetType = R503_DATA_PACKET;
-            
-            for (int i = 8; i >= 0; i--) {
-              // Push back bytes
-            }
-          }
-        }
-      }
+  }
+}
+
+bool R503_Fingerprint::isIdempotent(uint8_t opcode) {
+  switch (opcode) {
+    case R503_GENIMG:
+    case R503_GETIMAGEEX:
+    case R503_IMG2TZ:
+    case R503_MATCH:
+    case R503_SEARCH:
+    case R503_LOADCHAR:
+    case R503_UPCHAR:
+    case R503_UPIMAGE:
+    case R503_READSYSPARA:
+    case R503_VFYPWD:
+    case R503_READINFPAGE:
+    case R503_READNOTEPAD:
+    case R503_TEMPLATENUM:
+    case R503_READINDEXTABLE:
+    case R503_AURALEDCONFIG:
+    case R503_CHECKSENSOR:
+    case R503_GETALGVER:
+    case R503_GETFWVER:
+    case R503_READPRODINFO:
+    case R503_HANDSHAKE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void R503_Fingerprint::flushInput() {
+  // Discard until the line has been quiet for a moment, so the tail of a
+  // broken frame cannot be mistaken for the start of the next reply
+  uint32_t lastByte = millis();
+  while (millis() - lastByte < R503_RESYNC_QUIET_TIME) {
+    if (serial->available()) {
+      serial->read();
+      lastByte = millis();
+    } else {
+      delay(1);
     }
   }
-  
-  return true;
 }
 
-uint16_t R503_Fingerprint::calculateChecksum(uint8_t *data, uint16_t length) {
-  uint16_t sum = 0;
-  for (uint16_t i = 0; i < length; i++) {
-    sum += data[i];
+void R503_Fingerprint::drainLateReplies(uint8_t count) {
+  // Every attempt that timed out may still be answered, and the module
+  // replies in order, so those ACKs are read off here; otherwise the next
+  // command would take one of them as its own answer. A command the module
+  // never got costs one full timeout.
+  uint8_t savedError = lastError;
+  bool blocked = preemptBlocked;
+  preemptBlocked = true;
+  
+  uint8_t response[R503_ACK_MAX_SIZE];
+  while (count > 0) {
+    uint16_t len;
+    uint8_t pid;
+    if (!receivePacket(response, sizeof(response), len, pid, timeout) &&
+        lastError == R503_ERR_TIMEOUT) {
+      break;
+    }
+    // A broken frame is still the reply
+    count--;
   }
-  return sum;
+  
+  // Clear whatever is left of a broken frame before the next command
+  linkDirty = true;
+  preemptBlocked = blocked;
+  lastError = savedError;
 }
 
-bool R503_Fingerprint::writePacketHeader(uint8_t packetType, uint16_t length) {
-  writeU16(R503_STARTCODE);
-  writeU32(address);
-  serial->write(packetType);
-  writeU16(length);
+bool R503_Fingerprint::checkPreempt() {
+  if (!preemptHook || preemptBlocked) return false;
+  
+  // Wait loops spin much faster than requests can arrive
+  uint32_t now = millis();
+  if (now == preemptCheckedAt) return false;
+  preemptCheckedAt = now;
+  
+  if (!preemptHook(preemptContext)) return false;
+  lastError = R503_ERR_PREEMPTED;
   return true;
 }
 
-void R503_Fingerprint::clearSerialBuffer() {
-  while (serial->available()) {
-    serial->read();
+void R503_Fingerprint::abortExchange(uint8_t expectedAcks) {
+  // The module answers the interrupted command before it reads CANCEL, so
+  // frames are skipped until the ACK of the CANCEL itself has arrived.
+  // Data transfers are never preempted, so no data phase is left to drain
+  preemptBlocked = true;
+  
+  uint8_t packet[1];
+  packet[0] = R503_CANCEL;
+  
+  if (sendPacket(R503_COMMAND_PACKET, packet, 1)) {
+    expectedAcks++;
+    
+    uint8_t response[R503_ACK_MAX_SIZE];
+    uint32_t startTime = millis();
+    while (expectedAcks > 0 && millis() - startTime < R503_PREEMPT_DRAIN_TIMEOUT) {
+      uint16_t len;
+      uint8_t pid;
+      // Data packets do not fit the buffer; their remaining bytes are
+      // skipped as noise by the next call
+      if (receivePacket(response, sizeof(response), len, pid, R503_PREEMPT_DRAIN_TIMEOUT) &&
+          pid == R503_ACK_PACKET) {
+        expectedAcks--;
+      }
+    }
+  }
+  
+  // Anything still in flight is cleared before the next command
+  if (expectedAcks > 0) {
+    linkDirty = true;
   }
+  
+  lastConfirmCode = 0xFF;
+  lastError = R503_ERR_PREEMPTED;
+  preemptBlocked = false;
 }
 
-void R503_Fingerprint::writeU16(uint16_t value) {
-  serial->write((value >> 8) & 0xFF);
-  serial->write(value & 0xFF);
+bool R503_Fingerprint::preemptibleDelay(uint32_t ms) {
+  uint32_t startTime = millis();
+  while (millis() - startTime < ms) {
+    if (checkPreempt()) return false;
+    delay(1);
+  }
+  return true;
 }
 
-void R503_Fingerprint::writeU32(uint32_t value) {
-  serial->write((value >> 24) & 0xFF);
-  serial->write((value >> 16) & 0xFF);
-  serial->write((value >> 8) & 0xFF);
-  serial->write(value & 0xFF);
+uint16_t R503_Fingerprint::transferPacketSize() {
+  // Use the module's configured size once known, without adding a query
+  // to the transfer itself
+  if (infoValid & R503_INFO_PARAMS) {
+    return 32 << min(deviceInfo.params.dataPacketSize, (uint16_t)R503_PACKAGE_SIZE_256);
+  }
+  return 128;
 }
 
-uint16_t R503_Fingerprint::readU16() {
-  uint16_t value = serial->read() << 8;
-  value |= serial->read();
-  return value;
+uint16_t R503_Fingerprint::calculateChecksum(uint8_t *data, uint16_t length) {
+  return R503_Frame::checksum(data, length);
 }
 
-uint32_t R503_Fingerprint::readU32() {
-  uint32_t value = (uint32_t)serial->read() << 24;
-  value |= (uint32_t)serial->read() << 16;
-  value |= (uint32_t)serial->read() << 8;
-  value |= serial->read();
-  return value;
+void R503_Fingerprint::clearSerialBuffer() {
+  while (serial->available()) {
+    serial->read();
+  }
 }
\ No newline at end of file
@@ -4,6 +4,72 @@
 
 #include <Arduino.h>
 #include <HardwareSerial.h>
+#include "R503_TimeoutModel.h"
+
+// Build profile. Command groups can be left out of the driver with
+// -DR503_ENABLE_<GROUP>=0 in the build flags; -DR503_MINIMAL drops all of
+// them, the enrollment prompts and the large transmit buffer. The helpers
+// built on a group (R503_NotepadStore, R503_Defragmenter, R503_ImageReplay,
+// R503_LedScheduler) compile to nothing without it.
+#ifdef R503_MINIMAL
+#ifndef R503_ENABLE_IMAGE
+#define R503_ENABLE_IMAGE 0
+#endif
+#ifndef R503_ENABLE_NOTEPAD
+#define R503_ENABLE_NOTEPAD 0
+#endif
+#ifndef R503_ENABLE_LED
+#define R503_ENABLE_LED 0
+#endif
+#ifndef R503_ENABLE_INFO
+#define R503_ENABLE_INFO 0
+#endif
+#ifndef R503_ENROLL_PROMPTS
+#define R503_ENROLL_PROMPTS 0
+#endif
+#ifndef R503_TX_BUFFER
+#define R503_TX_BUFFER R503_MAX_COMMAND_DATA
+#endif
+#endif
+
+// uploadImage, downloadImage
+#ifndef R503_ENABLE_IMAGE
+#define R503_ENABLE_IMAGE 1
+#endif
+
+// writeNotepad, readNotepad
+#ifndef R503_ENABLE_NOTEPAD
+#define R503_ENABLE_NOTEPAD 1
+#endif
+
+// setLED and the led* helpers, setLEDAsync
+#ifndef R503_ENABLE_LED
+#define R503_ENABLE_LED 1
+#endif
+
+// Version strings, product info and information page, and their cache
+#ifndef R503_ENABLE_INFO
+#define R503_ENABLE_INFO 1
+#endif
+
+// enrollFingerprint progress messages on Serial
+#ifndef R503_ENROLL_PROMPTS
+#define R503_ENROLL_PROMPTS 1
+#endif
+
+// Largest packet sent with a single write from a stack buffer; longer data
+// packets go out as header, payload and checksum without being copied
+#ifndef R503_TX_BUFFER
+#define R503_TX_BUFFER 256
+#endif
+
+// Caller buffer sizes for the transfer commands
+#ifndef R503_TEMPLATE_BUFFER_SIZE
+#define R503_TEMPLATE_BUFFER_SIZE 1024
+#endif
+#define R503_IMAGE_BUFFER_SIZE 36864
+#define R503_INFO_PAGE_SIZE 512
+#define R503_NOTEPAD_PAGE_SIZE 32
 
 // Package identifiers
 #define R503_COMMAND_PACKET 0x01
@@ -103,6 +169,23 @@
 #define R503_STARTCODE 0xEF01
 #define R503_DEFAULT_TIMEOUT 2000
 #define R503_RESET_DELAY 200
+#define R503_DATA_TIMEOUT 500
+#define R503_RESYNC_QUIET_TIME 5
+#define R503_PREEMPT_DRAIN_TIMEOUT 1000
+
+// Transport error codes (getLastError)
+#define R503_ERR_NONE 0x00
+#define R503_ERR_TIMEOUT 0x01
+#define R503_ERR_TRUNCATED 0x02
+#define R503_ERR_BAD_START 0x03
+#define R503_ERR_BAD_LENGTH 0x04
+#define R503_ERR_BAD_CHECKSUM 0x05
+#define R503_ERR_BAD_PID 0x06
+#define R503_ERR_ADDRESS 0x07
+#define R503_ERR_PREEMPTED 0x08
+
+// Enrollment rejected: the finger is already stored (R503_DEDUP_REJECT)
+#define R503_ERR_DUPLICATE 0x09
 
 // Package size options
 #define R503_PACKAGE_SIZE_32 0
@@ -116,6 +199,37 @@
 #define R503_STATUS_PWD 0x04
 #define R503_STATUS_IMGBUF 0x08
 
+// Duplicate handling in enrollFingerprint
+#define R503_DEDUP_OFF 0
+#define R503_DEDUP_REJECT 1
+#define R503_DEDUP_REUSE 2
+
+// Reply sizes (ACK data including the confirmation code); replies are
+// received into buffers of exactly this size
+#define R503_ACK_SIZE 1
+#define R503_ACK_COUNT_SIZE 3
+#define R503_ACK_MATCH_SIZE 3
+#define R503_ACK_SEARCH_SIZE 5
+#define R503_ACK_RANDOM_SIZE 5
+#define R503_ACK_SYSPARA_SIZE 17
+#define R503_ACK_INDEX_SIZE 33
+#define R503_ACK_NOTEPAD_SIZE 33
+#define R503_ACK_VERSION_SIZE 33
+#define R503_ACK_PRODINFO_SIZE 47
+
+#if R503_ENABLE_INFO
+#define R503_ACK_MAX_SIZE R503_ACK_PRODINFO_SIZE
+#else
+#define R503_ACK_MAX_SIZE R503_ACK_INDEX_SIZE
+#endif
+
+// Longest command packet (WRITENOTEPAD, else SEARCH)
+#if R503_ENABLE_NOTEPAD
+#define R503_MAX_COMMAND_DATA (2 + R503_NOTEPAD_PAGE_SIZE)
+#else
+#define R503_MAX_COMMAND_DATA 6
+#endif
+
 // Structure for system parameters
 struct R503_SystemParams {
   uint16_t statusRegister;
@@ -140,14 +254,42 @@ struct R503_ProductInfo {
   uint16_t databaseSize;
 };
 
+// Cached device descriptor; each part is read on first use
+struct R503_DeviceInfo {
+  R503_SystemParams params;
+#if R503_ENABLE_INFO
+  R503_ProductInfo product;
+  char firmwareVersion[33];
+  char algorithmVersion[33];
+#endif
+};
+
+#define R503_INFO_PARAMS 0x01
+#define R503_INFO_PRODUCT 0x02
+#define R503_INFO_FIRMWARE 0x04
+#define R503_INFO_ALGORITHM 0x08
+
+// Link health counters
+struct R503_LinkStats {
+  uint32_t commands;
+  uint32_t retries;
+  uint32_t timeouts;
+  uint32_t corruptFrames;
+  uint32_t noiseBytes;
+};
+
+class R503_Journal;
+  
 class R503_Fingerprint {
 public:
   R503_Fingerprint(HardwareSerial *serial);
+  R503_Fingerprint(Stream *stream);
   
   // Initialization
   bool begin(uint32_t baud = 57600, uint32_t password = R503_DEFAULT_PASSWORD, 
              uint32_t address = R503_DEFAULT_ADDRESS);
   void setTimeout(uint32_t timeout);
+  void setRetries(uint8_t retries);
   
   // System commands
   bool verifyPassword(uint32_t password = R503_DEFAULT_PASSWORD);
@@ -160,11 +302,29 @@ public:
   bool readIndexTable(uint8_t page, uint8_t *indexTable);
   bool handshake();
   bool checkSensor();
+#if R503_ENABLE_INFO
   bool getAlgorithmVersion(char *version);
   bool getFirmwareVersion(char *version);
   bool readProductInfo(R503_ProductInfo &info);
+#endif
   bool softReset();
   
+  // Device info served from the cache after the first read. Only
+  // setSystemParameter, setAddress, setPassword and softReset invalidate it;
+  // the cached status register is a snapshot, use readSystemParameters for
+  // live status
+  bool getSystemParams(R503_SystemParams &params);
+#if R503_ENABLE_INFO
+  bool getProductInfo(R503_ProductInfo &info);
+  bool getFirmwareVersionCached(char *version);
+  bool getAlgorithmVersionCached(char *version);
+#endif
+  const R503_DeviceInfo &getDeviceInfo() { return deviceInfo; }
+  bool isDeviceInfoCached(uint8_t parts) { return (infoValid & parts) == parts; }
+  void invalidateDeviceInfo() { infoValid = 0; }
+  uint16_t getDataPacketSize();
+  uint32_t getBaudRate();
+  
   // Fingerprint processing
   bool getImage();
   bool getImageEx();
@@ -178,12 +338,16 @@ public:
   bool searchLibrary(uint8_t slot, uint16_t startPage, uint16_t count, 
                      uint16_t &fingerID, uint16_t &score);
   
-  // Template transfer
+  // Template transfer; buffer holds R503_TEMPLATE_BUFFER_SIZE bytes
   bool uploadCharacteristics(uint8_t slot, uint8_t *buffer, uint16_t &length);
   bool downloadCharacteristics(uint8_t slot, uint8_t *buffer, uint16_t length);
+#if R503_ENABLE_IMAGE
+  // buffer holds R503_IMAGE_BUFFER_SIZE bytes
   bool uploadImage(uint8_t *buffer, uint32_t &length);
   bool downloadImage(uint8_t *buffer, uint32_t length);
+#endif
   
+#if R503_ENABLE_LED
   // LED control
   bool setLED(uint8_t control, uint8_t speed, uint8_t color, uint8_t times);
   bool ledOn(uint8_t color = R503_LED_BLUE);
@@ -191,49 +355,118 @@ public:
   bool ledBreathe(uint8_t color = R503_LED_BLUE, uint8_t speed = 0x80, uint8_t times = 0);
   bool ledFlash(uint8_t color = R503_LED_BLUE, uint8_t speed = 0x80, uint8_t times = 5);
   
+  // Fire-and-forget LED command; the ACK is drained before the next command
+  bool setLEDAsync(uint8_t control, uint8_t speed, uint8_t color, uint8_t times);
+  bool drainPendingAcks();
+  uint8_t getPendingAckCount() { return pendingAcks; }
+#endif
+  
+#if R503_ENABLE_NOTEPAD
   // Notepad operations
   bool writeNotepad(uint8_t page, uint8_t *data);
   bool readNotepad(uint8_t page, uint8_t *data);
+#endif
   
   // Random number
   bool getRandomCode(uint32_t &randomNumber);
   
-  // Information page
+#if R503_ENABLE_INFO
+  // Information page; buffer holds R503_INFO_PAGE_SIZE bytes
   bool readInformationPage(uint8_t *buffer);
+#endif
   
   // Cancel operation
   bool cancel();
   
+  // Called while the driver waits on the module (replies, data packets,
+  // finger polling). Returning true abandons the current operation: it
+  // fails with R503_ERR_PREEMPTED, the module is sent CANCEL and the rest
+  // of the interrupted exchange is drained so the next command starts clean.
+  // The module finishes a command it is executing before it reads CANCEL,
+  // so long searches should be split into ranges to bound the wait.
+  // Template, image and information page uploads are not preempted: the
+  // module streams them without flow control, so they always run to the
+  // end. An image upload (36864 bytes in 128-byte packets, 40032 bytes on
+  // the wire) holds the link for about 7 s at 57600 baud.
+  void setPreemptHook(bool (*hook)(void *context), void *context = NULL);
+  bool wasPreempted() { return lastError == R503_ERR_PREEMPTED; }
+  
   // Helper enrollment functions
   bool enrollFingerprint(uint16_t pageID, uint8_t enrollCount = 6);
+  
+  // Search the library with the merged model before storing it. REJECT
+  // fails the enrollment with R503_ERR_DUPLICATE if the finger is already
+  // stored under another ID, REUSE overwrites that slot instead of pageID.
+  // getEnrolledID() reports the slot used (or the duplicate found).
+  void setEnrollDedup(uint8_t mode) { dedupMode = mode; }
+  uint16_t getEnrolledID() { return enrolledID; }
   bool verifyFingerprint(uint16_t &fingerID, uint16_t &confidence);
   
+  // 1:1 verification against a claimed identity (card, PIN); the cost does
+  // not depend on how many templates the library holds
+  bool verifyClaimed(uint16_t claimedID, uint16_t &score);
+  bool verifyClaimed(const uint8_t *claimedTemplate, uint16_t length, uint16_t &score);
+  
+  // Identify, verify and enroll results are logged here when set
+  void setJournal(R503_Journal *journal) { this->journal = journal; }
+  
   // Getters
   uint8_t getLastConfirmationCode() { return lastConfirmCode; }
+  uint8_t getLastError() { return lastError; }
+  const R503_LinkStats &getLinkStats() { return linkStats; }
+  R503_TimeoutModel &getTimeoutModel() { return timeoutModel; }
   uint32_t getPassword() { return password; }
   uint32_t getAddress() { return address; }
   
 private:
-  HardwareSerial *serial;
+  Stream *serial;
+  HardwareSerial *hwSerial;
   uint32_t password;
   uint32_t address;
   uint32_t timeout;
   uint8_t lastConfirmCode;
+  uint8_t pendingAcks;
+  uint8_t retries;
+  uint8_t lastError;
+  bool linkDirty;
+  R503_LinkStats linkStats;
+  R503_TimeoutModel timeoutModel;
+  R503_DeviceInfo deviceInfo;
+  uint8_t infoValid;
+  uint8_t dedupMode;
+  uint16_t enrolledID;
+  bool (*preemptHook)(void *context);
+  void *preemptContext;
+  uint32_t preemptCheckedAt;
+  bool preemptBlocked;
+  R503_Journal *journal;
+  
+  // Command transport with retries for idempotent opcodes; callers that
+  // retry the whole exchange themselves pass retry = false
+  bool sendCommand(uint8_t *packet, uint16_t packetLen,
+                   uint8_t *response, uint16_t responseSize, uint16_t &length,
+                   bool retry = true);
+  bool sendDataCommand(uint8_t *packet, uint16_t packetLen,
+                       uint8_t *buffer, uint16_t maxLength, uint16_t &actualLength);
+  bool isIdempotent(uint8_t opcode);
+  void flushInput();
+  void drainLateReplies(uint8_t count);
+  bool checkPreempt();
+  void abortExchange(uint8_t expectedAcks);
+  bool preemptibleDelay(uint32_t ms);
+  bool enrollModel(uint16_t pageID, uint8_t enrollCount);
+  void logEvent(uint8_t type, uint16_t fingerID, uint16_t score, uint32_t startedAt);
+  uint16_t transferPacketSize();
   
   // Packet handling
   bool sendPacket(uint8_t packetType, uint8_t *data, uint16_t dataLen);
-  bool receivePacket(uint8_t *buffer, uint16_t &length, uint8_t expectedType = R503_ACK_PACKET);
-  bool receiveAck(uint8_t *buffer, uint16_t &length);
+  bool sendLongPacket(uint8_t packetType, uint8_t *data, uint16_t dataLen);
+  bool receivePacket(uint8_t *buffer, uint16_t maxLength, uint16_t &length,
+                     uint8_t &pid, uint32_t waitTime);
+  bool receiveAck(uint8_t *buffer, uint16_t maxLength, uint16_t &length, uint32_t waitTime);
   bool receiveData(uint8_t *buffer, uint16_t maxLength, uint16_t &actualLength);
   uint16_t calculateChecksum(uint8_t *data, uint16_t length);
-  bool writePacketHeader(uint8_t packetType, uint16_t length);
   void clearSerialBuffer();
-  
-  // Utility
-  void writeU16(uint16_t value);
-  void writeU32(uint32_t value);
-  uint16_t readU16();
-  uint32_t readU32();
 };
 
 #endif // R503_FINGERPRINT_H
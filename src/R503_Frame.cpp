@@ -0,0 +1,205 @@
+// R503_Frame.cpp
+#include "R503_Frame.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Bytes per lane fold in the word-at-a-time checksum (128 words x 510 < 2^16)
+#define R503_CHECKSUM_FOLD_BYTES 512
+
+// Parser states
+#define FRAME_STATE_START_HI 0
+#define FRAME_STATE_START_LO 1
+#define FRAME_STATE_ADDRESS 2
+#define FRAME_STATE_PID 3
+#define FRAME_STATE_LENGTH 4
+#define FRAME_STATE_DATA 5
+#define FRAME_STATE_CHECKSUM 6
+#define FRAME_STATE_SKIP 7
+
+uint16_t R503_Frame::checksum(const uint8_t *data, uint16_t length, uint16_t seed) {
+  uint32_t sum = seed;
+  uint16_t i = 0;
+  
+#if defined(__SSE2__)
+  // PSADBW against zero adds 16 bytes into two 64-bit lanes per step
+  __m128i acc = _mm_setzero_si128();
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= length; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(block, zero));
+  }
+  sum += (uint32_t)_mm_cvtsi128_si32(acc) + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#elif defined(__ARM_NEON)
+  // Widen pairwise into 32-bit lanes; 16 bytes per step cannot overflow
+  uint32x4_t acc = vdupq_n_u32(0);
+  for (; i + 16 <= length; i += 16) {
+    acc = vpadalq_u16(acc, vpaddlq_u8(vld1q_u8(data + i)));
+  }
+  uint64x2_t wide = vpaddlq_u32(acc);
+  sum += (uint32_t)(vgetq_lane_u64(wide, 0) + vgetq_lane_u64(wide, 1));
+#elif !defined(__AVR__)
+  // 32-bit targets (Xtensa, Cortex-M): add four bytes per aligned load as
+  // two 16-bit lanes, folding before a lane can overflow
+  while (i < length && ((uintptr_t)(data + i) & 3)) {
+    sum += data[i++];
+  }
+  while (i + 4 <= length) {
+    uint32_t lanes = 0;
+    uint16_t blockEnd = i + min((uint16_t)(length - i) & ~3, R503_CHECKSUM_FOLD_BYTES);
+    for (; i < blockEnd; i += 4) {
+      uint32_t word;
+      memcpy(&word, data + i, 4);
+      lanes += (word & 0x00FF00FF) + ((word >> 8) & 0x00FF00FF);
+    }
+    sum += (lanes & 0xFFFF) + (lanes >> 16);
+  }
+#endif
+  
+  for (; i < length; i++) {
+    sum += data[i];
+  }
+  return (uint16_t)sum;
+}
+
+uint16_t R503_Frame::build(uint8_t *out, uint32_t address, uint8_t pid,
+                           const uint8_t *data, uint16_t dataLen) {
+  uint16_t length = dataLen + 2;
+  
+  out[0] = 0xEF;
+  out[1] = 0x01;
+  out[2] = (address >> 24) & 0xFF;
+  out[3] = (address >> 16) & 0xFF;
+  out[4] = (address >> 8) & 0xFF;
+  out[5] = address & 0xFF;
+  out[6] = pid;
+  out[7] = (length >> 8) & 0xFF;
+  out[8] = length & 0xFF;
+  
+  if (dataLen > 0) {
+    memcpy(out + R503_FRAME_HEADER_SIZE, data, dataLen);
+  }
+  
+  uint16_t sum = checksum(out + 6, dataLen + 3);
+  out[R503_FRAME_HEADER_SIZE + dataLen] = (sum >> 8) & 0xFF;
+  out[R503_FRAME_HEADER_SIZE + dataLen + 1] = sum & 0xFF;
+  
+  return dataLen + R503_FRAME_OVERHEAD;
+}
+
+R503_FrameParser::R503_FrameParser(uint8_t *buffer, uint16_t capacity) {
+  this->buffer = buffer;
+  this->capacity = capacity;
+  this->ownAddress = 0;
+  this->filterAddress = false;
+  reset();
+}
+
+void R503_FrameParser::setOwnAddress(uint32_t address) {
+  ownAddress = address;
+  filterAddress = true;
+}
+
+void R503_FrameParser::reset() {
+  state = FRAME_STATE_START_HI;
+  pos = 0;
+  address = 0;
+  pid = 0;
+  packetLen = 0;
+  dataLen = 0;
+  sum = 0;
+  received = 0;
+}
+
+bool R503_FrameParser::hasStartCode() {
+  return state >= FRAME_STATE_ADDRESS;
+}
+
+R503_FrameParser::Result R503_FrameParser::feed(uint8_t byte) {
+  switch (state) {
+    case FRAME_STATE_START_HI:
+      if (byte != 0xEF) return BAD_START;
+      state = FRAME_STATE_START_LO;
+      return NEED_MORE;
+      
+    case FRAME_STATE_START_LO:
+      if (byte != 0x01) {
+        state = (byte == 0xEF) ? FRAME_STATE_START_LO : FRAME_STATE_START_HI;
+        return BAD_START;
+      }
+      state = FRAME_STATE_ADDRESS;
+      pos = 0;
+      address = 0;
+      return NEED_MORE;
+      
+    case FRAME_STATE_ADDRESS:
+      address = (address << 8) | byte;
+      if (++pos == 4) state = FRAME_STATE_PID;
+      return NEED_MORE;
+      
+    case FRAME_STATE_PID:
+      if (byte != R503_COMMAND_PACKET && byte != R503_DATA_PACKET &&
+          byte != R503_ACK_PACKET && byte != R503_END_DATA_PACKET) {
+        reset();
+        return BAD_START;
+      }
+      pid = byte;
+      sum = byte;
+      state = FRAME_STATE_LENGTH;
+      pos = 0;
+      packetLen = 0;
+      return NEED_MORE;
+      
+    case FRAME_STATE_LENGTH:
+      packetLen = (packetLen << 8) | byte;
+      sum += byte;
+      if (++pos < 2) return NEED_MORE;
+      if (packetLen >= 2 && packetLen - 2 > capacity && packetLen - 2 <= R503_MAX_PACKET_DATA &&
+          filterAddress && address != ownAddress) {
+        // Someone else's frame: skip its data and checksum unread
+        pos = 0;
+        state = FRAME_STATE_SKIP;
+        return NEED_MORE;
+      }
+      if (packetLen < 2 || packetLen - 2 > capacity) {
+        reset();
+        return BAD_LENGTH;
+      }
+      dataLen = packetLen - 2;
+      pos = 0;
+      state = (dataLen > 0) ? FRAME_STATE_DATA : FRAME_STATE_CHECKSUM;
+      return NEED_MORE;
+      
+    case FRAME_STATE_DATA:
+      // The payload is summed in one pass once it is complete
+      buffer[pos++] = byte;
+      if (pos == dataLen) {
+        sum = R503_Frame::checksum(buffer, dataLen, sum);
+        state = FRAME_STATE_CHECKSUM;
+        pos = 0;
+      }
+      return NEED_MORE;
+      
+    case FRAME_STATE_CHECKSUM:
+      received = (received << 8) | byte;
+      if (++pos < 2) return NEED_MORE;
+      state = FRAME_STATE_START_HI;
+      if (received != sum) {
+        received = 0;
+        return BAD_CHECKSUM;
+      }
+      received = 0;
+      return FRAME_READY;
+      
+    case FRAME_STATE_SKIP:
+      if (++pos < packetLen) return NEED_MORE;
+      state = FRAME_STATE_START_HI;
+      return FOREIGN_FRAME;
+  }
+  
+  reset();
+  return BAD_START;
+}
@@ -0,0 +1,70 @@
+// R503_Frame.h
+#ifndef R503_FRAME_H
+#define R503_FRAME_H
+
+#include "R503_Fingerprint.h"
+
+// Frame layout: start code (2), address (4), PID (1), length (2), data, checksum (2)
+#define R503_FRAME_HEADER_SIZE 9
+#define R503_FRAME_OVERHEAD 11
+#define R503_MAX_PACKET_DATA 256
+
+// Encoding helpers shared by the driver, the bus manager and the emulator
+class R503_Frame {
+public:
+  // Sum of bytes modulo 2^16, added on top of seed. Uses SSE2/NEON on
+  // hosts and 32-bit word loads on 32-bit MCUs
+  static uint16_t checksum(const uint8_t *data, uint16_t length, uint16_t seed = 0);
+  
+  // Writes a complete frame to out and returns its size in bytes
+  static uint16_t build(uint8_t *out, uint32_t address, uint8_t pid,
+                        const uint8_t *data, uint16_t dataLen);
+};
+
+// Incremental parser fed one byte at a time. Bytes that cannot start a
+// frame are skipped, so the parser re-synchronises on the next start code.
+class R503_FrameParser {
+public:
+  enum Result {
+    NEED_MORE,
+    FRAME_READY,
+    BAD_START,
+    BAD_LENGTH,
+    BAD_CHECKSUM,
+    FOREIGN_FRAME    // skipped whole, see setOwnAddress()
+  };
+  
+  R503_FrameParser(uint8_t *buffer, uint16_t capacity);
+  
+  Result feed(uint8_t byte);
+  void reset();
+  
+  // Frames for other addresses that do not fit the buffer are skipped
+  // instead of failing with BAD_LENGTH, so a large frame from another
+  // module on a shared link does not cost the reply being waited for
+  void setOwnAddress(uint32_t address);
+  
+  // True once a full start code has been seen, i.e. a frame is underway
+  bool hasStartCode();
+  
+  uint32_t getAddress() { return address; }
+  uint8_t getPid() { return pid; }
+  uint8_t *getData() { return buffer; }
+  uint16_t getDataLength() { return dataLen; }
+  
+private:
+  uint8_t *buffer;
+  uint16_t capacity;
+  uint8_t state;
+  uint16_t pos;
+  uint32_t address;
+  uint8_t pid;
+  uint16_t packetLen;
+  uint16_t dataLen;
+  uint16_t sum;
+  uint16_t received;
+  uint32_t ownAddress;
+  bool filterAddress;
+};
+
+#endif // R503_FRAME_H
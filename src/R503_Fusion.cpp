@@ -0,0 +1,148 @@
+// R503_Fusion.cpp
+#include "R503_Fusion.h"
+
+R503_Fusion::R503_Fusion(R503_Fingerprint *finger) {
+  this->finger = finger;
+  this->rule = R503_FUSION_SUM;
+  this->acceptScore = 100;
+  this->voteScore = 0;
+  this->maxAttempts = 3;
+  this->missLimit = 3;
+  this->startPage = 0;
+  this->pageCount = 0;
+  this->identityMap = NULL;
+  this->candidateCount = 0;
+}
+
+void R503_Fusion::setRule(uint8_t rule, uint16_t acceptScore, uint16_t voteScore) {
+  this->rule = rule;
+  this->acceptScore = acceptScore;
+  this->voteScore = voteScore;
+}
+
+void R503_Fusion::setMaxAttempts(uint8_t attempts) {
+  this->maxAttempts = (attempts == 0) ? 1 : attempts;
+}
+
+void R503_Fusion::setMissLimit(uint8_t misses) {
+  this->missLimit = (misses == 0) ? 1 : misses;
+}
+
+void R503_Fusion::setSearchRange(uint16_t startPage, uint16_t count) {
+  this->startPage = startPage;
+  this->pageCount = count;
+}
+
+void R503_Fusion::setIdentityMap(uint16_t (*map)(uint16_t pageID)) {
+  this->identityMap = map;
+}
+
+bool R503_Fusion::identify(R503_FusionResult &result) {
+  memset(&result, 0, sizeof(result));
+  candidateCount = 0;
+  
+  uint16_t count = pageCount;
+  if (count == 0) {
+    R503_SystemParams params;
+    if (!finger->getSystemParams(params)) return false;
+    if (startPage >= params.librarySize) return false;
+    count = params.librarySize - startPage;
+  }
+  
+  uint8_t misses = 0;
+  for (uint8_t attempt = 0; attempt < maxAttempts; attempt++) {
+    result.attempts = attempt + 1;
+    
+    // No LED or delay between attempts: the finger is usually still down
+    if (!capture()) {
+      if (finger->getLastConfirmationCode() == R503_NOFINGER) break;
+      continue;
+    }
+    
+    uint16_t pageID;
+    uint16_t score;
+    if (finger->searchLibrary(R503_CHARBUFFER1, startPage, count, pageID, score)) {
+      addHit(identityMap ? identityMap(pageID) : pageID, score);
+      misses = 0;
+    } else if (finger->getLastConfirmationCode() == R503_NOTFOUND) {
+      misses++;
+    } else {
+      continue;
+    }
+    
+    if (decide(result)) return true;
+    if (misses >= missLimit) break;
+  }
+  
+  decide(result);
+  return result.accepted;
+}
+
+bool R503_Fusion::capture() {
+  uint32_t start = millis();
+  while (!finger->getImage()) {
+    if (finger->getLastConfirmationCode() != R503_NOFINGER) return false;
+    if (millis() - start > R503_FUSION_CAPTURE_TIMEOUT) return false;
+    delay(R503_FUSION_POLL_DELAY);
+  }
+  return finger->image2Tz(R503_CHARBUFFER1);
+}
+
+void R503_Fusion::addHit(uint16_t identity, uint16_t score) {
+  Candidate *c = NULL;
+  for (uint8_t i = 0; i < candidateCount; i++) {
+    if (candidates[i].identity == identity) {
+      c = &candidates[i];
+      break;
+    }
+  }
+  
+  if (c == NULL) {
+    if (candidateCount >= R503_FUSION_MAX_CANDIDATES) return;
+    c = &candidates[candidateCount++];
+    memset(c, 0, sizeof(Candidate));
+    c->identity = identity;
+  }
+  
+  c->scoreSum += score;
+  if (score > c->bestScore) c->bestScore = score;
+  if (score >= voteScore) c->votes++;
+}
+
+uint32_t R503_Fusion::fused(const Candidate &c) {
+  switch (rule) {
+    case R503_FUSION_MAX:
+      return c.bestScore;
+    case R503_FUSION_VOTE:
+      return c.votes;
+    default:
+      return c.scoreSum;
+  }
+}
+
+bool R503_Fusion::decide(R503_FusionResult &result) {
+  int8_t best = -1;
+  int8_t runnerUp = -1;
+  for (uint8_t i = 0; i < candidateCount; i++) {
+    if (best < 0 || fused(candidates[i]) > fused(candidates[best])) {
+      runnerUp = best;
+      best = i;
+    } else if (runnerUp < 0 || fused(candidates[i]) > fused(candidates[runnerUp])) {
+      runnerUp = i;
+    }
+  }
+  
+  if (best < 0) return false;
+  
+  Candidate &c = candidates[best];
+  uint32_t score = fused(c);
+  result.identity = c.identity;
+  result.fusedScore = min(score, (uint32_t)0xFFFF);
+  result.bestScore = c.bestScore;
+  result.votes = c.votes;
+  
+  // A tie between two identities is not a decision
+  bool tied = runnerUp >= 0 && fused(candidates[runnerUp]) == score;
+  result.accepted = score >= acceptScore && !tied;
+  return result.accepted;
+}
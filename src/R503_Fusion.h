@@ -0,0 +1,74 @@
+// R503_Fusion.h
+#ifndef R503_FUSION_H
+#define R503_FUSION_H
+
+#include "R503_Fingerprint.h"
+
+#define R503_FUSION_MAX_CANDIDATES 8
+#define R503_FUSION_CAPTURE_TIMEOUT 3000
+#define R503_FUSION_POLL_DELAY 100
+
+// Score fusion rules
+#define R503_FUSION_MAX 0    // best single score
+#define R503_FUSION_SUM 1    // sum of scores over all attempts
+#define R503_FUSION_VOTE 2   // number of attempts that hit the candidate
+
+struct R503_FusionResult {
+  bool accepted;
+  uint16_t identity;
+  uint16_t fusedScore;
+  uint16_t bestScore;
+  uint8_t votes;
+  uint8_t attempts;
+};
+
+// Runs several capture-and-search attempts back to back and fuses the
+// scores per identity, stopping as soon as the decision is confident.
+// Several enrolled fingers can count toward the same person through an
+// identity map (library page -> identity).
+class R503_Fusion {
+public:
+  R503_Fusion(R503_Fingerprint *finger);
+  
+  // acceptScore applies to the fused score (votes for R503_FUSION_VOTE);
+  // voteScore is the per-attempt score needed to count as a vote
+  void setRule(uint8_t rule, uint16_t acceptScore, uint16_t voteScore = 0);
+  void setMaxAttempts(uint8_t attempts);
+  
+  // Give up after this many attempts in a row without any library hit
+  void setMissLimit(uint8_t misses);
+  
+  // count = 0 searches from startPage to the end of the library
+  void setSearchRange(uint16_t startPage, uint16_t count);
+  void setIdentityMap(uint16_t (*map)(uint16_t pageID));
+  
+  bool identify(R503_FusionResult &result);
+  
+private:
+  struct Candidate {
+    uint16_t identity;
+    uint32_t scoreSum;
+    uint16_t bestScore;
+    uint8_t votes;
+  };
+  
+  R503_Fingerprint *finger;
+  uint8_t rule;
+  uint16_t acceptScore;
+  uint16_t voteScore;
+  uint8_t maxAttempts;
+  uint8_t missLimit;
+  uint16_t startPage;
+  uint16_t pageCount;
+  uint16_t (*identityMap)(uint16_t pageID);
+  
+  Candidate candidates[R503_FUSION_MAX_CANDIDATES];
+  uint8_t candidateCount;
+  
+  bool capture();
+  void addHit(uint16_t identity, uint16_t score);
+  uint32_t fused(const Candidate &c);
+  bool decide(R503_FusionResult &result);
+};
+
+#endif // R503_FUSION_H
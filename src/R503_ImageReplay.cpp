@@ -0,0 +1,140 @@
+// R503_ImageReplay.cpp
+#include "R503_ImageReplay.h"
+
+#if R503_ENABLE_IMAGE
+
+#if defined(ESP32)
+R503_FsImageCorpus::R503_FsImageCorpus(fs::FS &fs, const char *dir) : fs(fs) {
+  this->dir = dir;
+  this->count = -1;
+}
+
+uint16_t R503_FsImageCorpus::size() {
+  if (count >= 0) return count;
+  
+  count = 0;
+  File root = fs.open(dir);
+  if (!root) return 0;
+  
+  File file = root.openNextFile();
+  while (file) {
+    if (!file.isDirectory()) count++;
+    file = root.openNextFile();
+  }
+  return count;
+}
+
+bool R503_FsImageCorpus::load(uint16_t index, uint8_t *buffer, uint32_t maxLength,
+                              uint32_t &length, int32_t &expectedID) {
+  File root = fs.open(dir);
+  if (!root) return false;
+  
+  // Directory order is stable between runs on SPIFFS/LittleFS/FAT
+  uint16_t position = 0;
+  File file = root.openNextFile();
+  while (file) {
+    if (!file.isDirectory()) {
+      if (position == index) break;
+      position++;
+    }
+    file = root.openNextFile();
+  }
+  if (!file) return false;
+  
+  const char *name = strrchr(file.name(), '/');
+  name = name ? name + 1 : file.name();
+  expectedID = (name[0] == 'x') ? R503_REPLAY_IMPOSTOR : atol(name);
+  
+  length = file.read(buffer, maxLength);
+  return length > 0;
+}
+#endif
+
+R503_ImageReplay::R503_ImageReplay(R503_Fingerprint *finger, R503_ImageCorpus *corpus,
+                                   uint8_t *imageBuffer, uint32_t bufferSize) {
+  this->finger = finger;
+  this->corpus = corpus;
+  this->imageBuffer = imageBuffer;
+  this->bufferSize = bufferSize;
+  this->startPage = 0;
+  this->searchCount = 0;
+}
+
+void R503_ImageReplay::setSearchRange(uint16_t startPage, uint16_t count) {
+  this->startPage = startPage;
+  this->searchCount = count;
+}
+
+bool R503_ImageReplay::run(uint8_t securityLevel, R503_ReplayReport &report) {
+  memset(&report, 0, sizeof(report));
+  report.securityLevel = securityLevel;
+  
+  if (!finger->setSystemParameter(R503_PARAM_SECURITY, securityLevel)) return false;
+  
+  uint16_t count = searchCount;
+  if (count == 0) {
+    R503_SystemParams params;
+    if (!finger->getSystemParams(params)) return false;
+    count = params.librarySize - startPage;
+  }
+  
+  for (uint16_t i = 0; i < corpus->size(); i++) {
+    uint32_t length;
+    int32_t expectedID;
+    if (!corpus->load(i, imageBuffer, bufferSize, length, expectedID)) {
+      report.errors++;
+      continue;
+    }
+    
+    uint32_t start = millis();
+    if (!finger->downloadImage(imageBuffer, length)) {
+      report.errors++;
+      continue;
+    }
+    
+    // A failed extraction is a rejection, as it would be for a live finger
+    uint16_t foundID;
+    uint16_t score;
+    bool found = finger->image2Tz(R503_CHARBUFFER1) &&
+                 finger->searchLibrary(R503_CHARBUFFER1, startPage, count, foundID, score);
+    uint32_t elapsed = millis() - start;
+    
+    if (!found && finger->getLastConfirmationCode() == 0xFF) {
+      report.errors++;
+      continue;
+    }
+    
+    report.totalMs += elapsed;
+    report.maxMs = max(report.maxMs, elapsed);
+    report.imageBytes += length;
+    
+    if (expectedID == R503_REPLAY_IMPOSTOR) {
+      report.impostor++;
+      if (found) report.falseAccepts++;
+    } else {
+      report.genuine++;
+      if (!found) {
+        report.falseRejects++;
+      } else if (foundID != expectedID) {
+        report.falseAccepts++;
+      }
+    }
+  }
+  
+  return true;
+}
+
+bool R503_ImageReplay::sweep(R503_ReplayReport *reports) {
+  R503_SystemParams params;
+  if (!finger->getSystemParams(params)) return false;
+  uint8_t original = params.securityLevel;
+  
+  bool ok = true;
+  for (uint8_t level = 1; level <= R503_REPLAY_LEVELS && ok; level++) {
+    ok = run(level, reports[level - 1]);
+  }
+  
+  return finger->setSystemParameter(R503_PARAM_SECURITY, original) && ok;
+}
+
+#endif
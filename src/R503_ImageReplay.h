@@ -0,0 +1,85 @@
+// R503_ImageReplay.h
+#ifndef R503_IMAGEREPLAY_H
+#define R503_IMAGEREPLAY_H
+
+#include "R503_Fingerprint.h"
+
+#if defined(ESP32)
+#include <FS.h>
+#endif
+
+#if R503_ENABLE_IMAGE
+
+#define R503_REPLAY_IMPOSTOR -1
+#define R503_REPLAY_LEVELS 5
+
+// A recorded set of images, each labelled with the library ID it belongs
+// to or R503_REPLAY_IMPOSTOR for fingers that are not enrolled
+class R503_ImageCorpus {
+public:
+  virtual ~R503_ImageCorpus() {}
+  
+  virtual uint16_t size() = 0;
+  virtual bool load(uint16_t index, uint8_t *buffer, uint32_t maxLength,
+                    uint32_t &length, int32_t &expectedID) = 0;
+};
+
+#if defined(ESP32)
+// Raw images saved from uploadImage as <dir>/<id>_<n>.img, with x_<n>.img
+// for impostors
+class R503_FsImageCorpus : public R503_ImageCorpus {
+public:
+  R503_FsImageCorpus(fs::FS &fs, const char *dir = "/r503img");
+  
+  uint16_t size();
+  bool load(uint16_t index, uint8_t *buffer, uint32_t maxLength,
+            uint32_t &length, int32_t &expectedID);
+  
+private:
+  fs::FS &fs;
+  const char *dir;
+  int32_t count;
+};
+#endif
+
+// Outcome of one pass over the corpus at one security level
+struct R503_ReplayReport {
+  uint8_t securityLevel;
+  uint16_t genuine;
+  uint16_t impostor;
+  uint16_t falseAccepts;   // impostor accepted, or genuine matched to another ID
+  uint16_t falseRejects;   // genuine finger not found
+  uint16_t errors;         // transfer or link failures, not counted above
+  uint32_t totalMs;
+  uint32_t maxMs;
+  uint32_t imageBytes;
+};
+
+// Pushes each corpus image into the module's image buffer with
+// downloadImage, then runs image2Tz and searchLibrary on it, so matching
+// can be benchmarked and tuned without live fingers.
+class R503_ImageReplay {
+public:
+  R503_ImageReplay(R503_Fingerprint *finger, R503_ImageCorpus *corpus,
+                   uint8_t *imageBuffer, uint32_t bufferSize);
+  
+  // Defaults to the whole library
+  void setSearchRange(uint16_t startPage, uint16_t count);
+  
+  bool run(uint8_t securityLevel, R503_ReplayReport &report);
+  
+  // Runs levels 1..5 into reports[0..4] and restores the original level
+  bool sweep(R503_ReplayReport *reports);
+  
+private:
+  R503_Fingerprint *finger;
+  R503_ImageCorpus *corpus;
+  uint8_t *imageBuffer;
+  uint32_t bufferSize;
+  uint16_t startPage;
+  uint16_t searchCount;
+};
+
+#endif
+
+#endif // R503_IMAGEREPLAY_H
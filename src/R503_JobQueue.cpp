@@ -0,0 +1,146 @@
+// R503_JobQueue.cpp
+#include "R503_JobQueue.h"
+
+R503_JobQueue::R503_JobQueue(R503_Fingerprint *finger) {
+  this->finger = finger;
+  this->count = 0;
+  this->nextID = 1;
+  this->running = false;
+  this->runningIndex = 0;
+  this->runningPriority = 0;
+  this->preemptPending = false;
+  this->preempted = false;
+  this->cancelRunning = false;
+  this->preemptRequestedAt = 0;
+  this->preemptionCount = 0;
+  this->maxPreemptWait = 0;
+  this->measureWait = false;
+  this->requestSource = NULL;
+  this->completionHandler = NULL;
+  memset(jobs, 0, sizeof(jobs));
+}
+
+uint8_t R503_JobQueue::submit(uint8_t priority, R503_JobFunction run, void *context) {
+  if (count >= R503_JOB_QUEUE_SIZE || !run) return 0;
+  
+  for (uint8_t i = 0; i < R503_JOB_QUEUE_SIZE; i++) {
+    if (jobs[i].id != 0) continue;
+    
+    R503_Job &job = jobs[i];
+    job.id = nextID;
+    job.priority = priority;
+    job.run = run;
+    job.context = context;
+    job.progress = 0;
+    job.preemptions = 0;
+    job.submittedAt = millis();
+    count++;
+    
+    // Id 0 marks a free slot
+    nextID++;
+    if (nextID == 0) nextID = 1;
+    
+    if (running && priority > runningPriority && !preemptPending) {
+      preemptPending = true;
+      preemptRequestedAt = job.submittedAt;
+    }
+    return job.id;
+  }
+  return 0;
+}
+
+bool R503_JobQueue::cancel(uint8_t id) {
+  for (uint8_t i = 0; i < R503_JOB_QUEUE_SIZE; i++) {
+    if (id == 0 || jobs[i].id != id) continue;
+    
+    // The running job is stopped at its next wait and dropped afterwards
+    if (running && i == runningIndex) {
+      cancelRunning = true;
+    } else {
+      remove(i);
+    }
+    return true;
+  }
+  return false;
+}
+
+bool R503_JobQueue::poll() {
+  if (running) return false;
+  
+  int8_t index = findNext();
+  if (index < 0) return false;
+  
+  R503_Job &job = jobs[index];
+  running = true;
+  runningIndex = index;
+  runningPriority = job.priority;
+  preemptPending = false;
+  preempted = false;
+  cancelRunning = false;
+  
+  if (measureWait) {
+    uint32_t wait = millis() - preemptRequestedAt;
+    if (wait > maxPreemptWait) maxPreemptWait = wait;
+    measureWait = false;
+  }
+  
+  finger->setPreemptHook(preemptCheck, this);
+  bool success = job.run(finger, job);
+  finger->setPreemptHook(NULL);
+  running = false;
+  measureWait = preemptPending;
+  
+  // A preempted job keeps its slot and progress and runs again once the
+  // higher priority work is done. The queue's own record is used, since
+  // the driver's last error outlives the exchange that set it
+  if (!success && preempted && !cancelRunning) {
+    if (job.preemptions < 0xFF) job.preemptions++;
+    preemptionCount++;
+    return true;
+  }
+  
+  if (completionHandler && !cancelRunning) {
+    completionHandler(job, success);
+  }
+  remove(index);
+  return true;
+}
+
+void R503_JobQueue::setRequestSource(void (*source)(R503_JobQueue *queue)) {
+  requestSource = source;
+}
+
+void R503_JobQueue::setCompletionHandler(void (*handler)(const R503_Job &job, bool success)) {
+  completionHandler = handler;
+}
+
+int8_t R503_JobQueue::findNext() {
+  // Highest priority first; the oldest submission wins a tie, so a
+  // preempted job resumes before newer work of its own priority
+  int8_t best = -1;
+  for (uint8_t i = 0; i < R503_JOB_QUEUE_SIZE; i++) {
+    if (jobs[i].id == 0) continue;
+    if (best < 0 || jobs[i].priority > jobs[best].priority ||
+        (jobs[i].priority == jobs[best].priority &&
+         (int32_t)(jobs[i].submittedAt - jobs[best].submittedAt) < 0)) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+void R503_JobQueue::remove(uint8_t index) {
+  if (jobs[index].id == 0) return;
+  jobs[index].id = 0;
+  count--;
+}
+
+bool R503_JobQueue::preemptCheck(void *context) {
+  R503_JobQueue *queue = (R503_JobQueue *)context;
+  if (queue->requestSource) {
+    queue->requestSource(queue);
+  }
+  if (!queue->preemptPending && !queue->cancelRunning) return false;
+  queue->preempted = true;
+  return true;
+}
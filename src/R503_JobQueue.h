@@ -0,0 +1,82 @@
+// R503_JobQueue.h
+#ifndef R503_JOBQUEUE_H
+#define R503_JOBQUEUE_H
+
+#include "R503_Fingerprint.h"
+
+#define R503_JOB_QUEUE_SIZE 8
+
+struct R503_Job;
+
+// Job body: returns true on success. Long jobs should store how far they
+// got in job.progress as they go; a preempted job runs again later with the
+// same progress, so it can resume instead of starting over.
+typedef bool (*R503_JobFunction)(R503_Fingerprint *finger, R503_Job &job);
+
+struct R503_Job {
+  uint8_t id;
+  uint8_t priority;
+  R503_JobFunction run;
+  void *context;
+  uint32_t progress;
+  uint8_t preemptions;
+  uint32_t submittedAt;
+};
+
+// Priority queue of sensor jobs that share one module. While a job waits on
+// the module the queue polls the request source; if that submits a job of
+// higher priority, the running one is preempted through the driver's preempt
+// hook (CANCEL and drain), requeued, and the new job runs next. Identify at
+// the door therefore waits at most for the command in hand plus the cancel,
+// not for a whole background sync. Data transfers are the exception: an
+// upload always runs to the end, so an image job holds the module for the
+// whole transfer (about 7 s at 57600 baud). Only start one when no urgent
+// request is expected.
+class R503_JobQueue {
+public:
+  R503_JobQueue(R503_Fingerprint *finger);
+  
+  // Returns the job id, or 0 if the queue is full
+  uint8_t submit(uint8_t priority, R503_JobFunction run, void *context = NULL);
+  bool cancel(uint8_t id);
+  
+  // Runs the highest priority job until it finishes or is preempted.
+  // Returns false if there was nothing to run
+  bool poll();
+  
+  // Polled while a job waits on the module, so urgent requests (a touch on
+  // the sensor, a door button) can be submitted mid-job
+  void setRequestSource(void (*source)(R503_JobQueue *queue));
+  void setCompletionHandler(void (*handler)(const R503_Job &job, bool success));
+  
+  uint8_t getPendingCount() { return count; }
+  bool isRunning() { return running; }
+  uint32_t getPreemptionCount() { return preemptionCount; }
+  
+  // Longest time a preempting job waited between submission and start
+  uint32_t getMaxPreemptWait() { return maxPreemptWait; }
+
+private:
+  R503_Fingerprint *finger;
+  R503_Job jobs[R503_JOB_QUEUE_SIZE];
+  uint8_t count;
+  uint8_t nextID;
+  bool running;
+  uint8_t runningIndex;
+  uint8_t runningPriority;
+  bool preemptPending;
+  bool preempted;
+  bool cancelRunning;
+  bool measureWait;
+  uint32_t preemptRequestedAt;
+  uint32_t preemptionCount;
+  uint32_t maxPreemptWait;
+  void (*requestSource)(R503_JobQueue *queue);
+  void (*completionHandler)(const R503_Job &job, bool success);
+  
+  int8_t findNext();
+  void remove(uint8_t index);
+  static bool preemptCheck(void *context);
+};
+
+#endif // R503_JOBQUEUE_H
@@ -0,0 +1,266 @@
+// R503_Journal.cpp
+#include "R503_Journal.h"
+#include "R503_Frame.h"
+
+#define R503_JOURNAL_MASK (R503_JOURNAL_CAPACITY - 1)
+
+static void putU16(uint8_t *out, uint16_t value) {
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+}
+
+static void putU32(uint8_t *out, uint32_t value) {
+  putU16(out, value & 0xFFFF);
+  putU16(out + 2, value >> 16);
+}
+
+static uint16_t getU16(const uint8_t *in) {
+  return in[0] | (in[1] << 8);
+}
+
+static uint32_t getU32(const uint8_t *in) {
+  return getU16(in) | ((uint32_t)getU16(in + 2) << 16);
+}
+
+#if defined(ESP32)
+R503_FsJournalSink::R503_FsJournalSink(fs::FS &fs, const char *path, uint32_t maxBytes) : fs(fs) {
+  this->path = path;
+  this->maxBytes = maxBytes;
+}
+
+bool R503_FsJournalSink::write(const uint8_t *data, uint16_t length) {
+  File file = fs.open(path, FILE_APPEND);
+  if (!file) return false;
+  
+  if (file.size() + length > maxBytes && file.size() > 0) {
+    file.close();
+    
+    char oldPath[64];
+    snprintf(oldPath, sizeof(oldPath), "%s.old", path);
+    fs.remove(oldPath);
+    fs.rename(path, oldPath);
+    
+    file = fs.open(path, FILE_APPEND);
+    if (!file) return false;
+  }
+  
+  bool ok = file.write(data, length) == length;
+  file.close();
+  return ok;
+}
+#endif
+
+// R503_Journal --------------------------------------------------------------
+
+R503_Journal::R503_Journal(R503_JournalSink *sink) {
+  this->sink = sink;
+  this->head = 0;
+  this->tail = 0;
+  this->sequence = 0;
+  this->clock = NULL;
+  this->flushDelay = R503_JOURNAL_FLUSH_DELAY;
+  this->waiting = false;
+  this->waitingSince = 0;
+  this->logged = 0;
+  this->dropped = 0;
+  this->writeFailures = 0;
+  this->batchesWritten = 0;
+}
+
+void R503_Journal::setClock(uint32_t (*clock)()) {
+  this->clock = clock;
+}
+
+bool R503_Journal::log(uint8_t type, uint8_t confirmCode, uint16_t fingerID, uint16_t score,
+                       uint32_t latency) {
+  uint16_t seq = sequence++;
+  uint8_t h = head;
+  
+  if ((uint8_t)(h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) >= R503_JOURNAL_CAPACITY) {
+    dropped++;
+    return false;
+  }
+  
+  uint8_t *record = ring[h & R503_JOURNAL_MASK];
+  putU32(record, clock ? clock() : millis());
+  putU16(record + 4, seq);
+  record[6] = type;
+  record[7] = confirmCode;
+  putU16(record + 8, fingerID);
+  putU16(record + 10, score);
+  putU16(record + 12, latency > 0xFFFF ? 0xFFFF : latency);
+  
+  // Publish the record only once it is complete
+  __atomic_store_n(&head, (uint8_t)(h + 1), __ATOMIC_RELEASE);
+  logged++;
+  return true;
+}
+
+uint8_t R503_Journal::getPending() {
+  return (uint8_t)(__atomic_load_n(&head, __ATOMIC_ACQUIRE) - tail);
+}
+
+bool R503_Journal::flush(uint8_t maxBatches) {
+  for (uint8_t b = 0; b < maxBatches; b++) {
+    uint8_t t = tail;
+    uint8_t pending = (uint8_t)(__atomic_load_n(&head, __ATOMIC_ACQUIRE) - t);
+    if (pending == 0) return true;
+    
+    uint8_t count = min(pending, (uint8_t)R503_JOURNAL_BATCH);
+    uint8_t *records = batch + R503_JOURNAL_BATCH_HEADER;
+    for (uint8_t i = 0; i < count; i++) {
+      memcpy(records + i * R503_JOURNAL_RECORD_SIZE,
+             ring[(uint8_t)(t + i) & R503_JOURNAL_MASK], R503_JOURNAL_RECORD_SIZE);
+    }
+    
+    uint16_t length = count * R503_JOURNAL_RECORD_SIZE;
+    batch[0] = R503_JOURNAL_MAGIC0;
+    batch[1] = R503_JOURNAL_MAGIC1;
+    batch[2] = count;
+    batch[3] = R503_JOURNAL_VERSION;
+    putU16(batch + 4, R503_Frame::checksum(records, length));
+    
+    // Slots are released only after the sink has taken the batch
+    if (!sink->write(batch, R503_JOURNAL_BATCH_HEADER + length)) {
+      writeFailures++;
+      return false;
+    }
+    __atomic_store_n(&tail, (uint8_t)(t + count), __ATOMIC_RELEASE);
+    batchesWritten++;
+  }
+  return true;
+}
+
+bool R503_Journal::update() {
+  uint8_t pending = getPending();
+  if (pending == 0) {
+    waiting = false;
+    return true;
+  }
+  
+  // Full batches go out at once; a partial one once records have been
+  // waiting for the flush delay
+  if (pending < R503_JOURNAL_BATCH) {
+    if (!waiting) {
+      waiting = true;
+      waitingSince = millis();
+    }
+    if (millis() - waitingSince < flushDelay) return true;
+  }
+  
+  waiting = false;
+  return flush(pending / R503_JOURNAL_BATCH + 1);
+}
+
+// R503_JournalReader --------------------------------------------------------
+
+R503_JournalReader::R503_JournalReader(Stream *source) {
+  this->source = source;
+  this->count = 0;
+  this->index = 0;
+  this->haveSequence = false;
+  this->lastSequence = 0;
+  this->corruptBatches = 0;
+  this->missingEvents = 0;
+}
+
+bool R503_JournalReader::readBytes(uint8_t *buffer, uint16_t length) {
+  for (uint16_t i = 0; i < length; i++) {
+    if (source->available() <= 0) return false;
+    int byte = source->read();
+    if (byte < 0) return false;
+    buffer[i] = byte;
+  }
+  return true;
+}
+
+bool R503_JournalReader::readBatch() {
+  while (true) {
+    // Re-sync on the magic after a corrupt or truncated batch
+    uint8_t byte;
+    if (!readBytes(&byte, 1)) return false;
+    if (byte != R503_JOURNAL_MAGIC0) continue;
+    if (!readBytes(&byte, 1)) return false;
+    if (byte != R503_JOURNAL_MAGIC1) continue;
+    
+    batch[0] = R503_JOURNAL_MAGIC0;
+    batch[1] = R503_JOURNAL_MAGIC1;
+    if (!readBytes(batch + 2, R503_JOURNAL_BATCH_HEADER - 2)) return false;
+    
+    uint8_t records = batch[2];
+    if (records == 0 || records > R503_JOURNAL_BATCH || batch[3] != R503_JOURNAL_VERSION) {
+      corruptBatches++;
+      continue;
+    }
+    
+    uint16_t length = records * R503_JOURNAL_RECORD_SIZE;
+    if (!readBytes(batch + R503_JOURNAL_BATCH_HEADER, length)) {
+      corruptBatches++;
+      return false;
+    }
+    if (R503_Frame::checksum(batch + R503_JOURNAL_BATCH_HEADER, length) != getU16(batch + 4)) {
+      corruptBatches++;
+      continue;
+    }
+    
+    count = records;
+    index = 0;
+    return true;
+  }
+}
+
+bool R503_JournalReader::next(R503_JournalEvent &event) {
+  if (index >= count && !readBatch()) return false;
+  
+  const uint8_t *record = batch + R503_JOURNAL_BATCH_HEADER + index * R503_JOURNAL_RECORD_SIZE;
+  index++;
+  
+  event.timestamp = getU32(record);
+  event.sequence = getU16(record + 4);
+  event.type = record[6];
+  event.confirmCode = record[7];
+  event.fingerID = getU16(record + 8);
+  event.score = getU16(record + 10);
+  event.latency = getU16(record + 12);
+  
+  if (haveSequence) {
+    missingEvents += (uint16_t)(event.sequence - lastSequence - 1);
+  }
+  haveSequence = true;
+  lastSequence = event.sequence;
+  return true;
+}
+
+uint32_t R503_JournalReader::exportCsv(Print &out) {
+  out.println("timestamp,sequence,type,code,finger_id,score,latency_ms");
+  
+  uint32_t exported = 0;
+  R503_JournalEvent event;
+  while (next(event)) {
+    out.print(event.timestamp);
+    out.print(',');
+    out.print(event.sequence);
+    out.print(',');
+    out.print(typeName(event.type));
+    out.print(',');
+    out.print(event.confirmCode);
+    out.print(',');
+    if (event.fingerID != R503_JOURNAL_NO_ID) out.print(event.fingerID);
+    out.print(',');
+    out.print(event.score);
+    out.print(',');
+    out.println(event.latency);
+    exported++;
+  }
+  return exported;
+}
+
+const char *R503_JournalReader::typeName(uint8_t type) {
+  switch (type) {
+    case R503_EVENT_IDENTIFY: return "identify";
+    case R503_EVENT_VERIFY: return "verify";
+    case R503_EVENT_ENROLL: return "enroll";
+    case R503_EVENT_DELETE: return "delete";
+    default: return type >= R503_EVENT_USER ? "user" : "unknown";
+  }
+}
@@ -0,0 +1,163 @@
+// R503_Journal.h
+#ifndef R503_JOURNAL_H
+#define R503_JOURNAL_H
+
+#include "R503_Fingerprint.h"
+
+#if defined(ESP32)
+#include <FS.h>
+#endif
+
+// Ring capacity in records; a power of two up to 128
+#ifndef R503_JOURNAL_CAPACITY
+#define R503_JOURNAL_CAPACITY 64
+#endif
+
+#define R503_JOURNAL_BATCH 16
+#define R503_JOURNAL_FLUSH_DELAY 1000
+#define R503_JOURNAL_RECORD_SIZE 14
+#define R503_JOURNAL_BATCH_HEADER 6
+#define R503_JOURNAL_MAGIC0 'R'
+#define R503_JOURNAL_MAGIC1 'J'
+#define R503_JOURNAL_VERSION 1
+
+// Event types
+#define R503_EVENT_IDENTIFY 1
+#define R503_EVENT_VERIFY 2
+#define R503_EVENT_ENROLL 3
+#define R503_EVENT_DELETE 4
+#define R503_EVENT_USER 0x80
+
+#define R503_JOURNAL_NO_ID 0xFFFF
+
+struct R503_JournalEvent {
+  uint32_t timestamp;
+  uint16_t sequence;
+  uint8_t type;
+  uint8_t confirmCode;
+  uint16_t fingerID;
+  uint16_t score;
+  uint16_t latency;
+};
+
+// Destination of flushed batches: a file, flash, a serial link
+class R503_JournalSink {
+public:
+  virtual ~R503_JournalSink() {}
+  
+  // Write one batch; false leaves its records in the ring for the next flush
+  virtual bool write(const uint8_t *data, uint16_t length) = 0;
+};
+
+// Raw batches to any Print (an SD File, a host serial link)
+class R503_PrintJournalSink : public R503_JournalSink {
+public:
+  R503_PrintJournalSink(Print *out) { this->out = out; }
+  bool write(const uint8_t *data, uint16_t length) { return out->write(data, length) == length; }
+
+private:
+  Print *out;
+};
+
+#if defined(ESP32)
+// Appends batches to a file; once it exceeds maxBytes it is renamed to
+// <path>.old (replacing the previous one) and a new file is started
+class R503_FsJournalSink : public R503_JournalSink {
+public:
+  R503_FsJournalSink(fs::FS &fs, const char *path = "/journal.bin", uint32_t maxBytes = 65536);
+  bool write(const uint8_t *data, uint16_t length);
+
+private:
+  fs::FS &fs;
+  const char *path;
+  uint32_t maxBytes;
+};
+#endif
+
+// Access-event journal. log() only copies a record into a RAM ring and
+// never waits, so it is safe on the identify path; it may run in another
+// task or an ISR as long as only one context logs. update()/flush() are
+// the single consumer: they pack pending records into batches and hand
+// them to the sink, typically from loop() or a low-priority task.
+//
+// When the ring is full new events are dropped and counted; the sequence
+// number still advances so readers see the gap.
+//
+// Batch format (little endian): 'R' 'J' count version checksum(2), then
+// count records of timestamp(4) sequence(2) type(1) code(1) fingerID(2)
+// score(2) latency(2). The checksum is the 16-bit sum of the records.
+class R503_Journal {
+public:
+  R503_Journal(R503_JournalSink *sink);
+  
+  // Producer side
+  bool log(uint8_t type, uint8_t confirmCode, uint16_t fingerID, uint16_t score, uint32_t latency);
+  
+  // Timestamp source, millis() by default (e.g. an RTC in epoch seconds)
+  void setClock(uint32_t (*clock)());
+  
+  // Consumer side: flush writes up to maxBatches batches. update() flushes
+  // full batches at once and partial ones after the flush delay
+  bool flush(uint8_t maxBatches = 0xFF);
+  bool update();
+  void setFlushDelay(uint32_t ms) { flushDelay = ms; }
+  
+  uint8_t getPending();
+  uint32_t getLogged() { return logged; }
+  uint32_t getDropped() { return dropped; }
+  uint32_t getWriteFailures() { return writeFailures; }
+  uint32_t getBatchesWritten() { return batchesWritten; }
+
+private:
+  R503_JournalSink *sink;
+  uint8_t ring[R503_JOURNAL_CAPACITY][R503_JOURNAL_RECORD_SIZE];
+  
+  // Free-running single byte indices: loads and stores are atomic on every
+  // target, head is written only by the producer and tail by the consumer
+  volatile uint8_t head;
+  volatile uint8_t tail;
+  uint16_t sequence;
+  uint32_t (*clock)();
+  
+  uint32_t flushDelay;
+  bool waiting;
+  uint32_t waitingSince;
+  uint32_t logged;
+  uint32_t dropped;
+  uint32_t writeFailures;
+  uint32_t batchesWritten;
+  uint8_t batch[R503_JOURNAL_BATCH_HEADER + R503_JOURNAL_BATCH * R503_JOURNAL_RECORD_SIZE];
+};
+
+// Streams events back out of a journal written by R503_Journal. Batches
+// with a bad checksum are skipped and counted, and the reader re-syncs on
+// the next batch header; gaps in the sequence numbers count as missing.
+class R503_JournalReader {
+public:
+  R503_JournalReader(Stream *source);
+  
+  bool next(R503_JournalEvent &event);
+  
+  // CSV with a header line; returns the number of events written
+  uint32_t exportCsv(Print &out);
+  
+  static const char *typeName(uint8_t type);
+  
+  uint32_t getCorruptBatches() { return corruptBatches; }
+  uint32_t getMissingEvents() { return missingEvents; }
+
+private:
+  Stream *source;
+  uint8_t batch[R503_JOURNAL_BATCH_HEADER + R503_JOURNAL_BATCH * R503_JOURNAL_RECORD_SIZE];
+  uint8_t count;
+  uint8_t index;
+  bool haveSequence;
+  uint16_t lastSequence;
+  uint32_t corruptBatches;
+  uint32_t missingEvents;
+  
+  bool readBatch();
+  bool readBytes(uint8_t *buffer, uint16_t length);
+};
+
+#endif // R503_JOURNAL_H
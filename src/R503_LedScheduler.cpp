@@ -0,0 +1,85 @@
+// R503_LedScheduler.cpp
+#include "R503_LedScheduler.h"
+
+#if R503_ENABLE_LED
+
+R503_LedScheduler::R503_LedScheduler(R503_Fingerprint *finger) {
+  this->finger = finger;
+  this->hasApplied = false;
+  this->hasPending = false;
+  this->sentCount = 0;
+  this->skippedCount = 0;
+}
+
+void R503_LedScheduler::set(uint8_t control, uint8_t speed, uint8_t color, uint8_t times) {
+  pending.control = control;
+  pending.speed = speed;
+  pending.color = color;
+  pending.times = times;
+  hasPending = true;
+}
+
+void R503_LedScheduler::on(uint8_t color) {
+  set(R503_LED_ON, 0, color, 0);
+}
+
+void R503_LedScheduler::off() {
+  set(R503_LED_OFF, 0, 0, 0);
+}
+
+void R503_LedScheduler::breathe(uint8_t color, uint8_t speed, uint8_t times) {
+  set(R503_LED_BREATHING, speed, color, times);
+}
+
+void R503_LedScheduler::flash(uint8_t color, uint8_t speed, uint8_t times) {
+  set(R503_LED_FLASHING, speed, color, times);
+}
+
+bool R503_LedScheduler::flush() {
+  if (!hasPending) return true;
+  hasPending = false;
+  
+  // Re-sending a steady state is a no-op for the user; a finite effect
+  // (e.g. flash 3 times) has to be restarted every time it is requested
+  if (hasApplied && isSteady(pending) && sameState(pending, applied)) {
+    skippedCount++;
+    return true;
+  }
+  
+  if (!finger->setLEDAsync(pending.control, pending.speed, pending.color, pending.times)) {
+    hasApplied = false;
+    return false;
+  }
+  
+  applied = pending;
+  hasApplied = true;
+  sentCount++;
+  return true;
+}
+
+void R503_LedScheduler::invalidate() {
+  hasApplied = false;
+}
+
+bool R503_LedScheduler::isSteady(const LedState &state) {
+  switch (state.control) {
+    case R503_LED_ON:
+    case R503_LED_OFF:
+    case R503_LED_GRADUAL_ON:
+    case R503_LED_GRADUAL_OFF:
+      return true;
+    case R503_LED_BREATHING:
+    case R503_LED_FLASHING:
+      return state.times == 0;
+    default:
+      return false;
+  }
+}
+
+bool R503_LedScheduler::sameState(const LedState &a, const LedState &b) {
+  if (a.control != b.control || a.color != b.color) return false;
+  if (a.control == R503_LED_OFF) return true;
+  return a.speed == b.speed && a.times == b.times;
+}
+
+#endif
@@ -0,0 +1,55 @@
+// R503_LedScheduler.h
+#ifndef R503_LEDSCHEDULER_H
+#define R503_LEDSCHEDULER_H
+
+#include "R503_Fingerprint.h"
+
+#if R503_ENABLE_LED
+
+// Collects LED requests from application code and pushes only the last one
+// to the module on flush(). Commands are sent without waiting for the ACK,
+// so user feedback never sits in front of the next sensor command.
+class R503_LedScheduler {
+public:
+  R503_LedScheduler(R503_Fingerprint *finger);
+  
+  // Queue a new LED state (replaces any state not yet flushed)
+  void set(uint8_t control, uint8_t speed, uint8_t color, uint8_t times);
+  void on(uint8_t color = R503_LED_BLUE);
+  void off();
+  void breathe(uint8_t color = R503_LED_BLUE, uint8_t speed = 0x80, uint8_t times = 0);
+  void flash(uint8_t color = R503_LED_BLUE, uint8_t speed = 0x80, uint8_t times = 5);
+  
+  // Send the queued state if it differs from what the module shows
+  bool flush();
+  
+  // Forget the last known state, e.g. after softReset()
+  void invalidate();
+  
+  bool isPending() { return hasPending; }
+  uint32_t getSentCount() { return sentCount; }
+  uint32_t getSkippedCount() { return skippedCount; }
+  
+private:
+  struct LedState {
+    uint8_t control;
+    uint8_t speed;
+    uint8_t color;
+    uint8_t times;
+  };
+  
+  R503_Fingerprint *finger;
+  LedState applied;
+  LedState pending;
+  bool hasApplied;
+  bool hasPending;
+  uint32_t sentCount;
+  uint32_t skippedCount;
+  
+  bool isSteady(const LedState &state);
+  bool sameState(const LedState &a, const LedState &b);
+};
+
+#endif
+
+#endif // R503_LEDSCHEDULER_H
@@ -0,0 +1,170 @@
+// R503_Library.cpp
+#include "R503_Library.h"
+
+R503_Library::R503_Library(R503_Fingerprint *finger) {
+  this->finger = finger;
+  this->size = 0;
+  this->compacting = false;
+  this->removing = false;
+  this->cursorLoaded = false;
+  this->cursor = 0;
+  this->searchFrom = 0;
+  this->mergeScore = R503_LIBRARY_MERGE_SCORE;
+  this->duplicatesFound = 0;
+  this->duplicatesRemoved = 0;
+  this->duplicateHandler = NULL;
+  memset(occupancy, 0, sizeof(occupancy));
+  memset(reported, 0, sizeof(reported));
+}
+
+bool R503_Library::refresh() {
+  R503_SystemParams params;
+  if (!finger->getSystemParams(params)) return false;
+  
+  size = min(params.librarySize, (uint16_t)R503_LIBRARY_MAX_SIZE);
+  
+  // Each index table page covers 256 slots, MSB first
+  for (uint16_t page = 0; page * 256 < size; page++) {
+    if (!finger->readIndexTable(page, occupancy + page * 32)) return false;
+  }
+  return true;
+}
+
+bool R503_Library::isOccupied(uint16_t pageID) {
+  if (pageID >= size) return false;
+  return occupancy[pageID / 8] & (1 << (7 - (pageID % 8)));
+}
+
+void R503_Library::setOccupied(uint16_t pageID, bool occupied) {
+  if (pageID >= size) return;
+  
+  if (occupied) {
+    occupancy[pageID / 8] |= 1 << (7 - (pageID % 8));
+  } else {
+    occupancy[pageID / 8] &= ~(1 << (7 - (pageID % 8)));
+  }
+}
+
+uint16_t R503_Library::getCount() {
+  uint16_t count = 0;
+  for (uint16_t i = 0; i < size; i++) {
+    if (isOccupied(i)) count++;
+  }
+  return count;
+}
+
+int16_t R503_Library::findFree(uint16_t from) {
+  for (uint16_t i = from; i < size; i++) {
+    if (!isOccupied(i)) return i;
+  }
+  return -1;
+}
+
+uint16_t R503_Library::getUsedEnd() {
+  for (uint16_t i = size; i > 0; i--) {
+    if (isOccupied(i - 1)) return i;
+  }
+  return 0;
+}
+
+void R503_Library::startCompaction(uint16_t mergeScore, bool remove) {
+  this->mergeScore = mergeScore;
+  removing = remove;
+  compacting = true;
+  cursorLoaded = false;
+  cursor = 0;
+  duplicatesFound = 0;
+  duplicatesRemoved = 0;
+  memset(reported, 0, sizeof(reported));
+}
+
+bool R503_Library::compactStep() {
+  if (!compacting) return false;
+  
+  uint16_t end = getUsedEnd();
+  
+  if (!cursorLoaded) {
+    // A reported duplicate is covered by the slot it duplicates
+    while (cursor < end && (!isOccupied(cursor) || isReported(cursor))) {
+      cursor++;
+    }
+    if (cursor + 1 >= end) {
+      compacting = false;
+      return false;
+    }
+    
+    if (!finger->loadModel(R503_CHARBUFFER1, cursor)) {
+      // Slot emptied behind our back; anything else is a link problem
+      if (finger->getLastConfirmationCode() == 0xFF) {
+        compacting = false;
+        return false;
+      }
+      setOccupied(cursor, false);
+      nextCursor();
+      return true;
+    }
+    cursorLoaded = true;
+    searchFrom = cursor + 1;
+    return true;
+  }
+  
+  // Reported duplicates stay in the library and would keep winning the
+  // search, so the range stops short of the next one
+  uint16_t searchEnd = searchFrom;
+  while (searchEnd < end && !isReported(searchEnd)) {
+    searchEnd++;
+  }
+  
+  // The search reports the best match in the range. If even that one is
+  // not a duplicate, none of the others are either
+  uint16_t candidate;
+  uint16_t score;
+  bool found = searchEnd > searchFrom &&
+               finger->searchLibrary(R503_CHARBUFFER1, searchFrom, searchEnd - searchFrom, candidate, score);
+  if (!found && searchEnd > searchFrom && finger->getLastConfirmationCode() != R503_NOTFOUND) {
+    compacting = false;
+    return false;
+  }
+  
+  // Confirm with a 1:1 match before counting anything
+  uint16_t matchScore = 0;
+  if (!found || !finger->loadModel(R503_CHARBUFFER2, candidate) ||
+      !finger->matchTemplates(matchScore) || matchScore < mergeScore) {
+    searchFrom = searchEnd + 1;
+    if (searchFrom >= end) nextCursor();
+    return true;
+  }
+  
+  if (removing) {
+    if (!finger->deleteModel(candidate)) {
+      compacting = false;
+      return false;
+    }
+    setOccupied(candidate, false);
+    duplicatesRemoved++;
+  } else {
+    reported[candidate / 8] |= 1 << (7 - (candidate % 8));
+  }
+  duplicatesFound++;
+  
+  if (duplicateHandler) {
+    duplicateHandler(cursor, candidate);
+  }
+  
+  // Stay on this range: the next search finds any further copies
+  return true;
+}
+
+void R503_Library::setDuplicateHandler(void (*handler)(uint16_t keptID, uint16_t duplicateID)) {
+  duplicateHandler = handler;
+}
+
+bool R503_Library::isReported(uint16_t pageID) {
+  if (pageID >= size) return false;
+  return reported[pageID / 8] & (1 << (7 - (pageID % 8)));
+}
+
+void R503_Library::nextCursor() {
+  cursorLoaded = false;
+  cursor++;
+}
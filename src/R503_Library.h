@@ -0,0 +1,73 @@
+// R503_Library.h
+#ifndef R503_LIBRARY_H
+#define R503_LIBRARY_H
+
+#include "R503_Fingerprint.h"
+
+#define R503_LIBRARY_MAX_SIZE 1024
+#define R503_LIBRARY_MERGE_SCORE 100
+
+// Host copy of the library occupancy (the module's index table) plus a
+// background job that finds duplicate templates.
+//
+// Compaction walks the occupied slots in order. For each one it loads the
+// template into CHARBUFFER1 and searches the slots above it; a hit is
+// confirmed with matchTemplates and the higher slot is a duplicate when the
+// score reaches the merge score. Duplicates are only reported unless the
+// pass was started with remove set, in which case they are deleted; there
+// is no undo, so run a report pass first. Call compactStep() from loop():
+// every call costs at most four module commands, so the sensor stays
+// responsive.
+class R503_Library {
+public:
+  R503_Library(R503_Fingerprint *finger);
+  
+  // Read the library size and the index table from the module
+  bool refresh();
+  
+  bool isOccupied(uint16_t pageID);
+  void setOccupied(uint16_t pageID, bool occupied);
+  uint16_t getSize() { return size; }
+  uint16_t getCount();
+  
+  // First free slot at or above from, or -1 if the library is full
+  int16_t findFree(uint16_t from = 0);
+  
+  // One past the highest occupied slot; search ranges can stop here
+  uint16_t getUsedEnd();
+  
+  // Duplicate compaction; remove = false only reports
+  void startCompaction(uint16_t mergeScore = R503_LIBRARY_MERGE_SCORE, bool remove = false);
+  bool compactStep();
+  void stopCompaction() { compacting = false; }
+  bool isCompacting() { return compacting; }
+  uint16_t getDuplicatesFound() { return duplicatesFound; }
+  uint16_t getDuplicatesRemoved() { return duplicatesRemoved; }
+  
+  // Called for every duplicate found (after it was deleted when removing)
+  // so user mappings can be checked or updated
+  void setDuplicateHandler(void (*handler)(uint16_t keptID, uint16_t duplicateID));
+  
+private:
+  R503_Fingerprint *finger;
+  uint16_t size;
+  uint8_t occupancy[R503_LIBRARY_MAX_SIZE / 8];
+  
+  bool compacting;
+  bool removing;
+  bool cursorLoaded;
+  uint16_t cursor;
+  uint16_t searchFrom;
+  uint16_t mergeScore;
+  uint16_t duplicatesFound;
+  uint16_t duplicatesRemoved;
+  void (*duplicateHandler)(uint16_t keptID, uint16_t duplicateID);
+  
+  // Duplicates reported but left in place by a report-only pass
+  uint8_t reported[R503_LIBRARY_MAX_SIZE / 8];
+  
+  bool isReported(uint16_t pageID);
+  void nextCursor();
+};
+
+#endif // R503_LIBRARY_H
@@ -0,0 +1,156 @@
+// R503_LinuxSerial.cpp
+#include "R503_LinuxSerial.h"
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+static speed_t baudConstant(unsigned long baud) {
+  switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    default: return 0;
+  }
+}
+
+R503_LinuxSerial::R503_LinuxSerial(const char *device) {
+  strncpy(this->device, device, sizeof(this->device) - 1);
+  this->device[sizeof(this->device) - 1] = '\0';
+  this->fd = -1;
+  this->lost = false;
+  this->rxHead = 0;
+  this->rxCount = 0;
+}
+
+R503_LinuxSerial::~R503_LinuxSerial() {
+  end();
+}
+
+void R503_LinuxSerial::begin(unsigned long baud) {
+  open(baud);
+}
+
+bool R503_LinuxSerial::open(unsigned long baud) {
+  end();
+  
+  speed_t speed = baudConstant(baud);
+  if (speed == 0) return false;
+  
+  fd = ::open(device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) return false;
+  
+  struct termios tty;
+  if (tcgetattr(fd, &tty) != 0) {
+    end();
+    return false;
+  }
+  
+  cfmakeraw(&tty);
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+  tty.c_cc[VMIN] = 0;
+  tty.c_cc[VTIME] = 0;
+  
+  if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+    end();
+    return false;
+  }
+  
+  tcflush(fd, TCIOFLUSH);
+  lost = false;
+  rxHead = 0;
+  rxCount = 0;
+  return true;
+}
+
+void R503_LinuxSerial::end() {
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+int R503_LinuxSerial::available() {
+  fill();
+  return rxCount;
+}
+
+int R503_LinuxSerial::read() {
+  if (rxCount == 0) fill();
+  if (rxCount == 0) return -1;
+  
+  uint8_t byte = rx[rxHead];
+  rxHead = (rxHead + 1) % R503_LINUX_RX_BUFFER;
+  rxCount--;
+  return byte;
+}
+
+int R503_LinuxSerial::peek() {
+  if (rxCount == 0) fill();
+  if (rxCount == 0) return -1;
+  return rx[rxHead];
+}
+
+size_t R503_LinuxSerial::write(uint8_t byte) {
+  return write(&byte, 1);
+}
+
+size_t R503_LinuxSerial::write(const uint8_t *buffer, size_t size) {
+  if (fd < 0 || lost) return 0;
+  
+  size_t written = 0;
+  while (written < size) {
+    ssize_t n = ::write(fd, buffer + written, size - written);
+    if (n > 0) {
+      written += n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && errno != EAGAIN) {
+      lost = true;
+      break;
+    }
+    
+    // Output queue full: frames are small, so wait briefly for room
+    struct pollfd pfd = { fd, POLLOUT, 0 };
+    if (poll(&pfd, 1, R503_LINUX_WRITE_WAIT) <= 0) break;
+  }
+  return written;
+}
+
+void R503_LinuxSerial::flush() {
+  if (fd >= 0) tcdrain(fd);
+}
+
+void R503_LinuxSerial::fill() {
+  if (fd < 0 || lost || rxCount == R503_LINUX_RX_BUFFER) return;
+  
+  // Read into the free part of the ring without blocking
+  uint16_t tail = (rxHead + rxCount) % R503_LINUX_RX_BUFFER;
+  uint16_t room = (tail >= rxHead) ? R503_LINUX_RX_BUFFER - tail : rxHead - tail;
+  if (rxCount == 0) {
+    rxHead = 0;
+    tail = 0;
+    room = R503_LINUX_RX_BUFFER;
+  }
+  
+  ssize_t n = ::read(fd, rx + tail, room);
+  if (n > 0) {
+    rxCount += n;
+  } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+    // A vanished device keeps failing (EIO) and stays readable for poll,
+    // so stop reading rather than spin
+    lost = true;
+  }
+}
+
+#endif
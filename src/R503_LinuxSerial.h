@@ -0,0 +1,53 @@
+// R503_LinuxSerial.h
+#ifndef R503_LINUXSERIAL_H
+#define R503_LINUXSERIAL_H
+
+// Host builds only; build with extras/linux on the include path
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include <Arduino.h>
+
+#define R503_LINUX_RX_BUFFER 1024
+#define R503_LINUX_WRITE_WAIT 100
+
+// USB-UART adapter as a HardwareSerial: raw 8N1 termios on a non-blocking
+// fd. Pass it to R503_Fingerprint (blocking API) or R503_Bus (event driven);
+// getFd() can be registered with epoll/poll to wake when bytes arrive.
+class R503_LinuxSerial : public HardwareSerial {
+public:
+  R503_LinuxSerial(const char *device);
+  ~R503_LinuxSerial();
+  
+  // Opens and configures the port; false if the device or baud is invalid
+  void begin(unsigned long baud);
+  bool open(unsigned long baud);
+  void end();
+  bool isOpen() { return fd >= 0; }
+  
+  // True once a read or write failed for good (adapter unplugged, EIO);
+  // the port reads nothing until it is opened again
+  bool isLost() { return lost; }
+  int getFd() { return fd; }
+  const char *getDevice() { return device; }
+  
+  int available();
+  int read();
+  int peek();
+  size_t write(uint8_t byte);
+  size_t write(const uint8_t *buffer, size_t size);
+  void flush();
+  
+private:
+  char device[64];
+  int fd;
+  bool lost;
+  uint8_t rx[R503_LINUX_RX_BUFFER];
+  uint16_t rxHead;
+  uint16_t rxCount;
+  
+  void fill();
+};
+
+#endif
+
+#endif // R503_LINUXSERIAL_H
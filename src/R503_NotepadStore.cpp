@@ -0,0 +1,224 @@
+// R503_NotepadStore.cpp
+#include "R503_NotepadStore.h"
+
+#if R503_ENABLE_NOTEPAD
+
+#define NOTEPAD_END(key) ((key) == 0x00 || (key) == 0xFF)
+
+R503_NotepadStore::R503_NotepadStore(R503_Fingerprint *finger, uint8_t firstPage, uint8_t pageCount) {
+  this->finger = finger;
+  this->firstPage = firstPage;
+  this->pageCount = min(pageCount, (uint8_t)(R503_NOTEPAD_PAGES - firstPage));
+  this->dirtyMask = 0;
+  this->dirtySince = 0;
+  this->flushDelay = 1000;
+}
+
+bool R503_NotepadStore::begin() {
+  dirtyMask = 0;
+  
+  for (uint8_t i = 0; i < pageCount; i++) {
+    if (!finger->readNotepad(firstPage + i, pages[i])) return false;
+    
+    // Pages never written by the store (or torn) start out empty
+    if (pageChecksum(pages[i]) != pages[i][2]) {
+      memset(pages[i], 0, R503_NOTEPAD_PAGE_SIZE);
+    }
+  }
+  return true;
+}
+
+bool R503_NotepadStore::get(uint8_t key, uint8_t *value, uint8_t &length) {
+  uint8_t index;
+  uint8_t offset;
+  if (!find(key, index, offset)) return false;
+  
+  length = pages[index][offset + 1];
+  memcpy(value, pages[index] + offset + 2, length);
+  return true;
+}
+
+bool R503_NotepadStore::put(uint8_t key, const uint8_t *value, uint8_t length) {
+  if (NOTEPAD_END(key) || length > R503_NOTEPAD_MAX_VALUE) return false;
+  
+  uint8_t index;
+  uint8_t offset;
+  int16_t preferred = -1;
+  uint8_t oldSize = 0;
+  if (find(key, index, offset)) {
+    // Unchanged values cost nothing
+    if (pages[index][offset + 1] == length &&
+        memcmp(pages[index] + offset + 2, value, length) == 0) {
+      return true;
+    }
+    preferred = index;
+    oldSize = 2 + pages[index][offset + 1];
+  }
+  
+  // Stay on the same page if possible so only one page gets dirty,
+  // otherwise take the least-worn page with room. The old record counts
+  // as free space but is only removed once the new one is known to fit.
+  uint8_t needed = length + 2;
+  int16_t target = -1;
+  if (preferred >= 0 && R503_NOTEPAD_PAGE_SIZE - usedBytes(preferred) + oldSize >= needed) {
+    target = preferred;
+  } else {
+    for (uint8_t i = 0; i < pageCount; i++) {
+      if (R503_NOTEPAD_PAGE_SIZE - usedBytes(i) < needed) continue;
+      if (target < 0 || writeCount(i) < writeCount(target)) {
+        target = i;
+      }
+    }
+  }
+  if (target < 0) return false;
+  
+  if (preferred >= 0) {
+    removeAt(index, offset);
+  }
+  
+  uint8_t end = usedBytes(target);
+  pages[target][end] = key;
+  pages[target][end + 1] = length;
+  memcpy(pages[target] + end + 2, value, length);
+  markDirty(target);
+  return true;
+}
+
+bool R503_NotepadStore::remove(uint8_t key) {
+  uint8_t index;
+  uint8_t offset;
+  if (!find(key, index, offset)) return false;
+  
+  removeAt(index, offset);
+  return true;
+}
+
+bool R503_NotepadStore::contains(uint8_t key) {
+  uint8_t index;
+  uint8_t offset;
+  return find(key, index, offset);
+}
+
+bool R503_NotepadStore::getU32(uint8_t key, uint32_t &value) {
+  uint8_t data[R503_NOTEPAD_MAX_VALUE];
+  uint8_t length;
+  if (!get(key, data, length) || length != 4) return false;
+  
+  value = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+          ((uint32_t)data[2] << 8) | data[3];
+  return true;
+}
+
+bool R503_NotepadStore::putU32(uint8_t key, uint32_t value) {
+  uint8_t data[4];
+  data[0] = (value >> 24) & 0xFF;
+  data[1] = (value >> 16) & 0xFF;
+  data[2] = (value >> 8) & 0xFF;
+  data[3] = value & 0xFF;
+  return put(key, data, 4);
+}
+
+bool R503_NotepadStore::flush(uint8_t maxPages) {
+  uint8_t written = 0;
+  
+  while (dirtyMask != 0 && written < maxPages) {
+    int16_t next = -1;
+    for (uint8_t i = 0; i < pageCount; i++) {
+      if (!(dirtyMask & (1 << i))) continue;
+      if (next < 0 || writeCount(i) < writeCount(next)) {
+        next = i;
+      }
+    }
+    
+    uint8_t *page = pages[next];
+    uint16_t count = writeCount(next) + 1;
+    page[0] = (count >> 8) & 0xFF;
+    page[1] = count & 0xFF;
+    page[2] = pageChecksum(page);
+    
+    if (!finger->writeNotepad(firstPage + next, page)) return false;
+    
+    dirtyMask &= ~(1 << next);
+    written++;
+  }
+  
+  return true;
+}
+
+bool R503_NotepadStore::update() {
+  if (dirtyMask == 0 || millis() - dirtySince < flushDelay) return true;
+  return flush();
+}
+
+void R503_NotepadStore::setFlushDelay(uint32_t ms) {
+  flushDelay = ms;
+}
+
+uint16_t R503_NotepadStore::getFreeBytes() {
+  uint16_t free = 0;
+  for (uint8_t i = 0; i < pageCount; i++) {
+    free += R503_NOTEPAD_PAGE_SIZE - usedBytes(i);
+  }
+  return free;
+}
+
+uint16_t R503_NotepadStore::getPageWrites(uint8_t index) {
+  if (index >= pageCount) return 0;
+  return writeCount(index);
+}
+
+bool R503_NotepadStore::find(uint8_t key, uint8_t &index, uint8_t &offset) {
+  for (uint8_t i = 0; i < pageCount; i++) {
+    uint8_t pos = R503_NOTEPAD_HEADER_SIZE;
+    while (pos + 2 <= R503_NOTEPAD_PAGE_SIZE && !NOTEPAD_END(pages[i][pos])) {
+      if (pages[i][pos] == key) {
+        index = i;
+        offset = pos;
+        return true;
+      }
+      pos += 2 + pages[i][pos + 1];
+    }
+  }
+  return false;
+}
+
+uint8_t R503_NotepadStore::usedBytes(uint8_t index) {
+  uint8_t pos = R503_NOTEPAD_HEADER_SIZE;
+  while (pos + 2 <= R503_NOTEPAD_PAGE_SIZE && !NOTEPAD_END(pages[index][pos])) {
+    pos += 2 + pages[index][pos + 1];
+  }
+  return min(pos, (uint8_t)R503_NOTEPAD_PAGE_SIZE);
+}
+
+void R503_NotepadStore::removeAt(uint8_t index, uint8_t offset) {
+  uint8_t *page = pages[index];
+  uint8_t size = 2 + page[offset + 1];
+  uint8_t end = usedBytes(index);
+  
+  memmove(page + offset, page + offset + size, end - offset - size);
+  memset(page + end - size, 0, size);
+  markDirty(index);
+}
+
+void R503_NotepadStore::markDirty(uint8_t index) {
+  if (dirtyMask == 0) {
+    dirtySince = millis();
+  }
+  dirtyMask |= 1 << index;
+}
+
+uint16_t R503_NotepadStore::writeCount(uint8_t index) {
+  return (pages[index][0] << 8) | pages[index][1];
+}
+
+uint8_t R503_NotepadStore::pageChecksum(const uint8_t *page) {
+  // Seeded so an all-zero page does not pass as valid
+  uint8_t sum = 0xA5;
+  for (uint8_t i = 0; i < R503_NOTEPAD_PAGE_SIZE; i++) {
+    if (i == 2) continue;
+    sum += page[i];
+  }
+  return sum;
+}
+
+#endif
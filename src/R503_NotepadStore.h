@@ -0,0 +1,72 @@
+// R503_NotepadStore.h
+#ifndef R503_NOTEPADSTORE_H
+#define R503_NOTEPADSTORE_H
+
+#include "R503_Fingerprint.h"
+
+#if R503_ENABLE_NOTEPAD
+
+#define R503_NOTEPAD_PAGES 16
+
+// Pages used by default; the last one is left to R503_Defragmenter's
+// move journal (R503_DEFRAG_JOURNAL_PAGE)
+#define R503_NOTEPAD_STORE_PAGES (R503_NOTEPAD_PAGES - 1)
+#define R503_NOTEPAD_HEADER_SIZE 3
+#define R503_NOTEPAD_MAX_VALUE (R503_NOTEPAD_PAGE_SIZE - R503_NOTEPAD_HEADER_SIZE - 2)
+
+// Small key/value store on the module's notepad pages.
+//
+// Page layout: write counter (2), checksum (1), then records of
+// [key][length][value...] up to the first key of 0x00 or 0xFF. Keys are
+// 1..254 and a record never spans pages.
+//
+// All reads are served from a RAM copy loaded in begin(). Changes only mark
+// pages dirty; flush() (or update() once the flush delay has passed) writes
+// the dirty pages, least-worn first. New records go to the least-worn page
+// with room, so hot keys do not keep hammering the same page.
+class R503_NotepadStore {
+public:
+  R503_NotepadStore(R503_Fingerprint *finger, uint8_t firstPage = 0,
+                    uint8_t pageCount = R503_NOTEPAD_STORE_PAGES);
+  
+  bool begin();
+  
+  bool get(uint8_t key, uint8_t *value, uint8_t &length);
+  bool put(uint8_t key, const uint8_t *value, uint8_t length);
+  bool remove(uint8_t key);
+  bool contains(uint8_t key);
+  
+  bool getU32(uint8_t key, uint32_t &value);
+  bool putU32(uint8_t key, uint32_t value);
+  
+  // Write at most maxPages dirty pages
+  bool flush(uint8_t maxPages = R503_NOTEPAD_PAGES);
+  
+  // Flush once changes have been pending for the flush delay
+  bool update();
+  void setFlushDelay(uint32_t ms);
+  
+  bool isDirty() { return dirtyMask != 0; }
+  uint16_t getFreeBytes();
+  uint16_t getPageWrites(uint8_t index);
+  
+private:
+  R503_Fingerprint *finger;
+  uint8_t firstPage;
+  uint8_t pageCount;
+  uint8_t pages[R503_NOTEPAD_PAGES][R503_NOTEPAD_PAGE_SIZE];
+  uint16_t dirtyMask;
+  uint32_t dirtySince;
+  uint32_t flushDelay;
+  
+  bool find(uint8_t key, uint8_t &index, uint8_t &offset);
+  uint8_t usedBytes(uint8_t index);
+  void removeAt(uint8_t index, uint8_t offset);
+  void markDirty(uint8_t index);
+  uint16_t writeCount(uint8_t index);
+  uint8_t pageChecksum(const uint8_t *page);
+};
+
+#endif
+
+#endif // R503_NOTEPADSTORE_H
@@ -0,0 +1,320 @@
+// R503_TemplateCache.cpp
+#include "R503_TemplateCache.h"
+
+#if defined(ESP32)
+R503_FsTemplateStore::R503_FsTemplateStore(fs::FS &fs, const char *dir) : fs(fs) {
+  this->dir = dir;
+}
+
+bool R503_FsTemplateStore::read(uint32_t userID, uint8_t *buffer, uint16_t maxLength, uint16_t &length) {
+  char path[48];
+  templatePath(userID, path);
+  
+  File f = fs.open(path, FILE_READ);
+  if (!f) return false;
+  
+  size_t size = f.size();
+  if (size > maxLength) {
+    f.close();
+    return false;
+  }
+  
+  length = f.read(buffer, size);
+  f.close();
+  return length == size;
+}
+
+bool R503_FsTemplateStore::write(uint32_t userID, const uint8_t *buffer, uint16_t length) {
+  char path[48];
+  templatePath(userID, path);
+  
+  if (!fs.exists(dir)) {
+    fs.mkdir(dir);
+  }
+  
+  File f = fs.open(path, FILE_WRITE);
+  if (!f) return false;
+  
+  size_t written = f.write(buffer, length);
+  f.close();
+  return written == length;
+}
+
+bool R503_FsTemplateStore::remove(uint32_t userID) {
+  char path[48];
+  templatePath(userID, path);
+  return fs.remove(path);
+}
+
+bool R503_FsTemplateStore::first(uint32_t &userID) {
+  iterator = fs.open(dir);
+  if (!iterator || !iterator.isDirectory()) return false;
+  return next(userID);
+}
+
+bool R503_FsTemplateStore::next(uint32_t &userID) {
+  while (true) {
+    File entry = iterator.openNextFile();
+    if (!entry) return false;
+    
+    // Older cores report the full path, newer ones only the file name
+    const char *name = entry.name();
+    const char *base = strrchr(name, '/');
+    base = base ? base + 1 : name;
+    entry.close();
+    
+    char *end;
+    unsigned long value = strtoul(base, &end, 10);
+    if (end != base && strcmp(end, ".tpl") == 0) {
+      userID = value;
+      return true;
+    }
+  }
+}
+
+bool R503_FsTemplateStore::loadSlotMap(uint32_t *userIDs, uint16_t count) {
+  char path[48];
+  snprintf(path, sizeof(path), "%s/slots.map", dir);
+  
+  File f = fs.open(path, FILE_READ);
+  if (!f) return false;
+  
+  size_t size = count * sizeof(uint32_t);
+  bool ok = f.size() == size && f.read((uint8_t *)userIDs, size) == size;
+  f.close();
+  return ok;
+}
+
+bool R503_FsTemplateStore::saveSlotMap(const uint32_t *userIDs, uint16_t count) {
+  char path[48];
+  snprintf(path, sizeof(path), "%s/slots.map", dir);
+  
+  if (!fs.exists(dir)) {
+    fs.mkdir(dir);
+  }
+  
+  File f = fs.open(path, FILE_WRITE);
+  if (!f) return false;
+  
+  size_t size = count * sizeof(uint32_t);
+  bool ok = f.write((const uint8_t *)userIDs, size) == size;
+  f.close();
+  return ok;
+}
+
+void R503_FsTemplateStore::templatePath(uint32_t userID, char *path) {
+  snprintf(path, 48, "%s/%lu.tpl", dir, (unsigned long)userID);
+}
+#endif
+
+R503_TemplateCache::R503_TemplateCache(R503_Fingerprint *finger, R503_TemplateStore *store) {
+  this->finger = finger;
+  this->store = store;
+  this->firstSlot = 0;
+  this->slotCount = 0;
+  this->clock = 0;
+  this->missScanLimit = R503_CACHE_MISS_SCAN_LIMIT;
+  this->scanStart = 0;
+  this->hits = 0;
+  this->misses = 0;
+  this->promotions = 0;
+}
+
+bool R503_TemplateCache::begin(uint16_t firstSlot, uint16_t slotCount) {
+  this->firstSlot = firstSlot;
+  this->slotCount = min(slotCount, (uint16_t)R503_CACHE_MAX_SLOTS);
+  
+  uint32_t userIDs[R503_CACHE_MAX_SLOTS];
+  bool haveMap = store->loadSlotMap(userIDs, this->slotCount);
+  
+  for (uint16_t i = 0; i < this->slotCount; i++) {
+    slots[i].userID = haveMap ? userIDs[i] : R503_CACHE_EMPTY;
+    slots[i].frequency = 0;
+    slots[i].lastUsed = 0;
+  }
+  
+  // Drop mappings whose library page was emptied behind our back
+  uint8_t indexTable[32];
+  int16_t loadedPage = -1;
+  for (uint16_t i = 0; i < this->slotCount; i++) {
+    if (slots[i].userID == R503_CACHE_EMPTY) continue;
+    
+    uint16_t pageID = firstSlot + i;
+    if (loadedPage != pageID / 256) {
+      if (!finger->readIndexTable(pageID / 256, indexTable)) return false;
+      loadedPage = pageID / 256;
+    }
+    
+    uint8_t bit = pageID % 256;
+    if (!(indexTable[bit / 8] & (1 << (7 - (bit % 8))))) {
+      slots[i].userID = R503_CACHE_EMPTY;
+    }
+  }
+  
+  return true;
+}
+
+bool R503_TemplateCache::enroll(uint32_t userID) {
+  uint16_t length;
+  if (!finger->uploadCharacteristics(R503_CHARBUFFER1, buffer, length)) return false;
+  if (!store->write(userID, buffer, length)) return false;
+  
+  int16_t slot = findSlot(userID);
+  if (slot >= 0) {
+    // Re-enrollment replaces the resident copy in place
+    if (!finger->storeModel(R503_CHARBUFFER1, firstSlot + slot)) return false;
+    touch(slot);
+    return true;
+  }
+  
+  return install(userID, R503_CHARBUFFER1);
+}
+
+bool R503_TemplateCache::remove(uint32_t userID) {
+  int16_t slot = findSlot(userID);
+  if (slot >= 0) {
+    if (!finger->deleteModel(firstSlot + slot, 1)) return false;
+    slots[slot].userID = R503_CACHE_EMPTY;
+    slots[slot].frequency = 0;
+    saveMap();
+  }
+  
+  return store->remove(userID);
+}
+
+bool R503_TemplateCache::identify(uint32_t &userID, uint16_t &score) {
+  // Fast path: the resident set, searched on the module
+  if (slotCount > 0) {
+    uint16_t pageID;
+    if (finger->searchLibrary(R503_CHARBUFFER1, firstSlot, slotCount, pageID, score)) {
+      int16_t slot = pageID - firstSlot;
+      if (slot >= 0 && slot < slotCount && slots[slot].userID != R503_CACHE_EMPTY) {
+        touch(slot);
+        hits++;
+        userID = slots[slot].userID;
+        return true;
+      }
+    } else if (finger->getLastConfirmationCode() != R503_NOTFOUND) {
+      return false;
+    }
+  }
+  
+  // Slow path: match the remaining templates one by one. Downloading into
+  // CHARBUFFER2 leaves the probe in CHARBUFFER1 and costs no flash writes.
+  // The scan starts at scanStart (in store order) and wraps around once.
+  misses++;
+  uint16_t budget = missScanLimit;
+  uint16_t position = 0;
+  bool wrapped = false;
+  uint32_t candidate;
+  bool more = store->first(candidate);
+  while (budget > 0) {
+    if (!more) {
+      if (wrapped || scanStart == 0) return false;
+      wrapped = true;
+      position = 0;
+      more = store->first(candidate);
+      continue;
+    }
+    if (wrapped && position >= scanStart) return false;
+    
+    if (position >= scanStart || wrapped) {
+      uint16_t length;
+      if (findSlot(candidate) < 0 && store->read(candidate, buffer, sizeof(buffer), length)) {
+        budget--;
+        if (finger->downloadCharacteristics(R503_CHARBUFFER2, buffer, length) &&
+            finger->matchTemplates(score)) {
+          userID = candidate;
+          install(candidate, R503_CHARBUFFER2);
+          return true;
+        }
+      }
+    }
+    more = store->next(candidate);
+    position++;
+  }
+  
+  scanStart = position;
+  return false;
+}
+
+bool R503_TemplateCache::prefetch(uint32_t userID) {
+  if (findSlot(userID) >= 0) return true;
+  
+  uint16_t length;
+  if (!store->read(userID, buffer, sizeof(buffer), length)) return false;
+  if (!finger->downloadCharacteristics(R503_CHARBUFFER2, buffer, length)) return false;
+  
+  return install(userID, R503_CHARBUFFER2);
+}
+
+void R503_TemplateCache::setMissScanLimit(uint16_t count) {
+  missScanLimit = (count == 0) ? 1 : count;
+}
+
+bool R503_TemplateCache::isResident(uint32_t userID) {
+  return findSlot(userID) >= 0;
+}
+
+uint16_t R503_TemplateCache::getResidentCount() {
+  uint16_t count = 0;
+  for (uint16_t i = 0; i < slotCount; i++) {
+    if (slots[i].userID != R503_CACHE_EMPTY) count++;
+  }
+  return count;
+}
+
+int16_t R503_TemplateCache::findSlot(uint32_t userID) {
+  for (uint16_t i = 0; i < slotCount; i++) {
+    if (slots[i].userID == userID) return i;
+  }
+  return -1;
+}
+
+uint16_t R503_TemplateCache::chooseVictim() {
+  uint16_t victim = 0;
+  for (uint16_t i = 0; i < slotCount; i++) {
+    if (slots[i].userID == R503_CACHE_EMPTY) return i;
+    
+    if (slots[i].frequency < slots[victim].frequency ||
+        (slots[i].frequency == slots[victim].frequency &&
+         slots[i].lastUsed < slots[victim].lastUsed)) {
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+bool R503_TemplateCache::install(uint32_t userID, uint8_t charBuffer) {
+  if (slotCount == 0) return false;
+  
+  uint16_t slot = chooseVictim();
+  if (!finger->storeModel(charBuffer, firstSlot + slot)) return false;
+  
+  // Inherit the victim's count (0 for a free slot)
+  if (slots[slot].userID == R503_CACHE_EMPTY) slots[slot].frequency = 0;
+  slots[slot].userID = userID;
+  touch(slot);
+  promotions++;
+  return saveMap();
+}
+
+void R503_TemplateCache::touch(uint16_t slot) {
+  if (slots[slot].frequency < 0xFFFF) slots[slot].frequency++;
+  slots[slot].lastUsed = ++clock;
+  
+  // Halve all counts now and then so yesterday's regulars can be evicted
+  if (clock % R503_CACHE_AGING_PERIOD == 0) {
+    for (uint16_t i = 0; i < slotCount; i++) {
+      slots[i].frequency >>= 1;
+    }
+  }
+}
+
+bool R503_TemplateCache::saveMap() {
+  uint32_t userIDs[R503_CACHE_MAX_SLOTS];
+  for (uint16_t i = 0; i < slotCount; i++) {
+    userIDs[i] = slots[i].userID;
+  }
+  return store->saveSlotMap(userIDs, slotCount);
+}
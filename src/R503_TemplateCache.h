@@ -0,0 +1,123 @@
+// R503_TemplateCache.h
+#ifndef R503_TEMPLATECACHE_H
+#define R503_TEMPLATECACHE_H
+
+#include "R503_Fingerprint.h"
+
+#if defined(ESP32)
+#include <FS.h>
+#endif
+
+#define R503_CACHE_MAX_SLOTS 200
+#define R503_CACHE_TEMPLATE_SIZE 1024
+#define R503_CACHE_EMPTY 0xFFFFFFFF
+#define R503_CACHE_AGING_PERIOD 256
+#define R503_CACHE_MISS_SCAN_LIMIT 16
+
+// Host-side storage holding every enrolled template, keyed by user ID
+class R503_TemplateStore {
+public:
+  virtual ~R503_TemplateStore() {}
+  
+  virtual bool read(uint32_t userID, uint8_t *buffer, uint16_t maxLength, uint16_t &length) = 0;
+  virtual bool write(uint32_t userID, const uint8_t *buffer, uint16_t length) = 0;
+  virtual bool remove(uint32_t userID) = 0;
+  
+  // Iterate over all stored user IDs
+  virtual bool first(uint32_t &userID) = 0;
+  virtual bool next(uint32_t &userID) = 0;
+  
+  // Which user occupies each cache slot, kept across restarts
+  virtual bool loadSlotMap(uint32_t *userIDs, uint16_t count) = 0;
+  virtual bool saveSlotMap(const uint32_t *userIDs, uint16_t count) = 0;
+};
+
+#if defined(ESP32)
+// Templates as files on SPIFFS/LittleFS/SD: <dir>/<userID>.tpl
+class R503_FsTemplateStore : public R503_TemplateStore {
+public:
+  R503_FsTemplateStore(fs::FS &fs, const char *dir = "/r503");
+  
+  bool read(uint32_t userID, uint8_t *buffer, uint16_t maxLength, uint16_t &length);
+  bool write(uint32_t userID, const uint8_t *buffer, uint16_t length);
+  bool remove(uint32_t userID);
+  bool first(uint32_t &userID);
+  bool next(uint32_t &userID);
+  bool loadSlotMap(uint32_t *userIDs, uint16_t count);
+  bool saveSlotMap(const uint32_t *userIDs, uint16_t count);
+  
+private:
+  fs::FS &fs;
+  const char *dir;
+  File iterator;
+  
+  void templatePath(uint32_t userID, char *path);
+};
+#endif
+
+// Treats a range of the module library as a cache in front of the host
+// store. Identification searches the resident set on the module first; on
+// a miss the remaining templates are matched 1:1 by downloading them into
+// CHARBUFFER2, and the matching template is paged into the library. One
+// miss downloads at most the scan limit; the next one carries on where it
+// stopped, so a large store is covered over a few attempts instead of
+// stalling a single one.
+//
+// Slots are reclaimed from the least frequently used users (hit counts are
+// halved every R503_CACHE_AGING_PERIOD identifications), oldest first on
+// ties. A paged-in user starts from the count of the user it replaced, so
+// it is not the next victim ahead of residents that have gone quiet.
+class R503_TemplateCache {
+public:
+  R503_TemplateCache(R503_Fingerprint *finger, R503_TemplateStore *store);
+  
+  // Use library pages [firstSlot, firstSlot + slotCount) as the cache
+  bool begin(uint16_t firstSlot, uint16_t slotCount);
+  
+  // Save the model in CHARBUFFER1 to the host store and make it resident
+  bool enroll(uint32_t userID);
+  bool remove(uint32_t userID);
+  
+  // Identify the features in CHARBUFFER1 (after getImage/image2Tz)
+  bool identify(uint32_t &userID, uint16_t &score);
+  
+  // Page a user's template in ahead of time
+  bool prefetch(uint32_t userID);
+  
+  // Templates downloaded per identification miss
+  void setMissScanLimit(uint16_t count);
+  
+  bool isResident(uint32_t userID);
+  uint16_t getResidentCount();
+  uint32_t getHits() { return hits; }
+  uint32_t getMisses() { return misses; }
+  uint32_t getPromotions() { return promotions; }
+  
+private:
+  struct CacheSlot {
+    uint32_t userID;
+    uint16_t frequency;
+    uint32_t lastUsed;
+  };
+  
+  R503_Fingerprint *finger;
+  R503_TemplateStore *store;
+  uint16_t firstSlot;
+  uint16_t slotCount;
+  CacheSlot slots[R503_CACHE_MAX_SLOTS];
+  uint32_t clock;
+  uint16_t missScanLimit;
+  uint16_t scanStart;
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t promotions;
+  uint8_t buffer[R503_CACHE_TEMPLATE_SIZE];
+  
+  int16_t findSlot(uint32_t userID);
+  uint16_t chooseVictim();
+  bool install(uint32_t userID, uint8_t charBuffer);
+  void touch(uint16_t slot);
+  bool saveMap();
+};
+
+#endif // R503_TEMPLATECACHE_H
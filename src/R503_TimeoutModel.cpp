@@ -0,0 +1,238 @@
+// R503_TimeoutModel.cpp
+#include "R503_TimeoutModel.h"
+#include "R503_Fingerprint.h"
+
+// Weight kept by older SEARCH samples each time a new one is added
+#define R503_SEARCH_FIT_DECAY 0.95f
+
+R503_TimeoutModel::R503_TimeoutModel() {
+  this->floor = R503_TIMEOUT_FLOOR;
+  this->ceiling = R503_DEFAULT_TIMEOUT;
+  reset();
+}
+
+void R503_TimeoutModel::setLimits(uint32_t floor, uint32_t ceiling) {
+  this->floor = floor;
+  this->ceiling = (ceiling < floor) ? floor : ceiling;
+}
+
+void R503_TimeoutModel::reset() {
+  memset(stats, 0, sizeof(stats));
+  searchWeight = 0;
+  searchSumX = 0;
+  searchSumY = 0;
+  searchSumXX = 0;
+  searchSumXY = 0;
+  searchIntercept = 0;
+  searchSlope = 0;
+  searchSlopeKnown = false;
+}
+
+uint32_t R503_TimeoutModel::deadline(uint8_t opcode, uint16_t count) {
+  int8_t index = slot(opcode);
+  if (index < 0) return ceiling;
+  
+  OpcodeStats &s = stats[index];
+  uint32_t value;
+  if (s.samples == 0) {
+    value = prior(opcode, count);
+  } else if (s.samples < R503_TIMEOUT_MIN_SAMPLES) {
+    value = max(prior(opcode, count), learned(s, opcode, count));
+  } else {
+    value = learned(s, opcode, count);
+  }
+  
+  value <<= s.backoff;
+  if (value < floor) value = floor;
+  if (value > ceiling) value = ceiling;
+  if (isFlashWrite(opcode) && value < R503_TIMEOUT_WRITE_FLOOR) {
+    value = R503_TIMEOUT_WRITE_FLOOR;
+  }
+  return value;
+}
+
+void R503_TimeoutModel::record(uint8_t opcode, uint16_t count, uint32_t latency, uint8_t confirmCode) {
+  int8_t index = slot(opcode);
+  if (index < 0 || !isSlowPath(opcode, confirmCode)) return;
+  
+  OpcodeStats &s = stats[index];
+  int32_t error;
+  
+  if (opcode == R503_SEARCH) {
+    // Deviation is measured against the count-aware prediction
+    if (searchWeight > 0) {
+      float predicted = searchIntercept + searchSlope * count;
+      error = (int32_t)latency - (int32_t)(predicted + 0.5f);
+    } else {
+      error = latency / 2;
+    }
+    fitSearch(count, latency);
+  } else if (s.samples == 0) {
+    error = latency / 2;
+  } else {
+    error = (int32_t)latency - (int32_t)(s.smoothed >> 3);
+  }
+  
+  if (s.samples == 0) {
+    s.smoothed = latency << 3;
+    s.deviation = (uint32_t)(error < 0 ? -error : error) << 2;
+  } else {
+    int32_t delta = (int32_t)(latency << 3) - (int32_t)s.smoothed;
+    s.smoothed += delta / 8;
+    int32_t magnitude = error < 0 ? -error : error;
+    s.deviation += ((magnitude << 2) - (int32_t)s.deviation) / 4;
+  }
+  
+  if (s.samples < 0xFFFF) s.samples++;
+  s.backoff = 0;
+}
+
+void R503_TimeoutModel::recordTimeout(uint8_t opcode) {
+  int8_t index = slot(opcode);
+  if (index < 0) return;
+  if (stats[index].backoff < R503_TIMEOUT_MAX_BACKOFF) {
+    stats[index].backoff++;
+  }
+}
+
+uint16_t R503_TimeoutModel::getSampleCount(uint8_t opcode) {
+  int8_t index = slot(opcode);
+  return index < 0 ? 0 : stats[index].samples;
+}
+
+uint32_t R503_TimeoutModel::getMeanLatency(uint8_t opcode) {
+  int8_t index = slot(opcode);
+  return index < 0 ? 0 : stats[index].smoothed >> 3;
+}
+
+int8_t R503_TimeoutModel::slot(uint8_t opcode) {
+  if (opcode < R503_TIMEOUT_LOW_OPCODES) return opcode;
+  
+  switch (opcode) {
+    case R503_GETIMAGEEX: return R503_TIMEOUT_LOW_OPCODES;
+    case R503_CANCEL: return R503_TIMEOUT_LOW_OPCODES + 1;
+    case R503_AURALEDCONFIG: return R503_TIMEOUT_LOW_OPCODES + 2;
+    case R503_CHECKSENSOR: return R503_TIMEOUT_LOW_OPCODES + 3;
+    case R503_GETALGVER: return R503_TIMEOUT_LOW_OPCODES + 4;
+    case R503_GETFWVER: return R503_TIMEOUT_LOW_OPCODES + 5;
+    case R503_READPRODINFO: return R503_TIMEOUT_LOW_OPCODES + 6;
+    case R503_SOFTRST: return R503_TIMEOUT_LOW_OPCODES + 7;
+    case R503_HANDSHAKE: return R503_TIMEOUT_LOW_OPCODES + 8;
+    default: return -1;
+  }
+}
+
+bool R503_TimeoutModel::isSlowPath(uint8_t opcode, uint8_t confirmCode) {
+  switch (opcode) {
+    case R503_GENIMG:
+    case R503_GETIMAGEEX:
+      return confirmCode == R503_OK;
+    case R503_SEARCH:
+      return confirmCode == R503_NOTFOUND;
+    default:
+      return true;
+  }
+}
+
+bool R503_TimeoutModel::isFlashWrite(uint8_t opcode) {
+  switch (opcode) {
+    case R503_STORE:
+    case R503_DELETCHAR:
+    case R503_EMPTY:
+    case R503_SETPWD:
+    case R503_SETADDER:
+    case R503_SETSYSPARA:
+    case R503_WRITENOTEPAD:
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint32_t R503_TimeoutModel::prior(uint8_t opcode, uint16_t count) {
+  // Conservative starting points until enough replies have been timed
+  switch (opcode) {
+    case R503_HANDSHAKE:
+    case R503_CHECKSENSOR:
+    case R503_CONTROL:
+    case R503_CANCEL:
+    case R503_VFYPWD:
+    case R503_READSYSPARA:
+    case R503_TEMPLATENUM:
+    case R503_READINDEXTABLE:
+    case R503_READNOTEPAD:
+    case R503_GETRANDOMCODE:
+    case R503_GETALGVER:
+    case R503_GETFWVER:
+    case R503_READPRODINFO:
+    case R503_READINFPAGE:
+    case R503_AURALEDCONFIG:
+    case R503_LOADCHAR:
+    case R503_UPCHAR:
+    case R503_DOWNCHAR:
+    case R503_UPIMAGE:
+    case R503_DOWNIMAGE:
+      return 100;
+    case R503_GENIMG:
+    case R503_GETIMAGEEX:
+    case R503_IMG2TZ:
+    case R503_REGMODEL:
+    case R503_MATCH:
+    case R503_SOFTRST:
+      return 500;
+    case R503_STORE:
+    case R503_DELETCHAR:
+    case R503_EMPTY:
+    case R503_SETPWD:
+    case R503_SETADDER:
+    case R503_SETSYSPARA:
+    case R503_WRITENOTEPAD:
+      return R503_TIMEOUT_WRITE_FLOOR;
+    case R503_SEARCH:
+      return 200 + 5 * (uint32_t)count;
+    default:
+      return ceiling;
+  }
+}
+
+uint32_t R503_TimeoutModel::learned(const OpcodeStats &s, uint8_t opcode, uint16_t count) {
+  uint32_t mean = s.smoothed >> 3;
+  
+  if (opcode == R503_SEARCH && searchWeight > 0) {
+    float predicted = searchIntercept + searchSlope * count;
+    
+    // Without a slope yet, assume cost grows with the range for searches
+    // wider than the ones measured so far
+    float meanCount = searchSumX / searchWeight;
+    if (!searchSlopeKnown && count > meanCount && meanCount > 0) {
+      predicted = predicted * count / meanCount;
+    }
+    mean = (predicted > 0) ? (uint32_t)(predicted + 0.5f) : 0;
+  }
+  
+  // 2 ms covers the host's polling granularity
+  return mean + (s.deviation >> 2) * 4 + 2;
+}
+
+void R503_TimeoutModel::fitSearch(uint16_t count, uint32_t latency) {
+  float x = count;
+  float y = latency;
+  
+  searchWeight = searchWeight * R503_SEARCH_FIT_DECAY + 1;
+  searchSumX = searchSumX * R503_SEARCH_FIT_DECAY + x;
+  searchSumY = searchSumY * R503_SEARCH_FIT_DECAY + y;
+  searchSumXX = searchSumXX * R503_SEARCH_FIT_DECAY + x * x;
+  searchSumXY = searchSumXY * R503_SEARCH_FIT_DECAY + x * y;
+  
+  // Until searches with different ranges have been seen the slope cannot be
+  // separated from the fixed cost, so keep the previous estimate
+  float denom = searchWeight * searchSumXX - searchSumX * searchSumX;
+  if (denom > searchWeight * searchWeight) {
+    float slope = (searchWeight * searchSumXY - searchSumX * searchSumY) / denom;
+    searchSlope = (slope > 0) ? slope : 0;
+    searchSlopeKnown = true;
+  }
+  
+  searchIntercept = (searchSumY - searchSlope * searchSumX) / searchWeight;
+  if (searchIntercept < 0) searchIntercept = 0;
+}
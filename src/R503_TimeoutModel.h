@@ -0,0 +1,86 @@
+// R503_TimeoutModel.h
+#ifndef R503_TIMEOUTMODEL_H
+#define R503_TIMEOUTMODEL_H
+
+#include <Arduino.h>
+
+// Statistics slots: opcodes below 0x20 map directly, the nine defined above
+// it are packed behind them
+#define R503_TIMEOUT_LOW_OPCODES 0x20
+#define R503_TIMEOUT_SLOTS (R503_TIMEOUT_LOW_OPCODES + 9)
+#define R503_TIMEOUT_MIN_SAMPLES 4
+#define R503_TIMEOUT_FLOOR 15
+#define R503_TIMEOUT_MAX_BACKOFF 3
+
+// Flash writes are never retried, so their deadline is not learned below
+// the fixed timeout they had before the model
+#define R503_TIMEOUT_WRITE_FLOOR 2000
+
+// Learns how long the module takes to answer each opcode and turns that into
+// per-command deadlines. Deadlines follow the smoothed latency plus four mean
+// deviations (as TCP does for its retransmit timer) and double after every
+// timeout until the next reply arrives. SEARCH latency is modelled as a
+// fixed cost plus a cost per page, so narrow searches get tight deadlines
+// and full-library searches get generous ones.
+//
+// Only replies that took the slow path are timed: captures for GENIMG and
+// GETIMAGEEX (an empty sensor answers at once) and misses for SEARCH (a hit
+// may stop before the end of the range). Deadlines therefore cover the
+// worst case rather than the most frequent one.
+//
+// Commands that write flash (STORE, DELETCHAR, EMPTY, SETPWD, SETADDER,
+// SETSYSPARA, WRITENOTEPAD) are not idempotent and get one attempt: a write
+// that outlives its deadline still happens but is reported as failed. Their
+// deadline never drops below R503_TIMEOUT_WRITE_FLOOR, even with a lower
+// ceiling; the learned latency can only raise it.
+class R503_TimeoutModel {
+public:
+  R503_TimeoutModel();
+  
+  // Deadlines never go below floor or above ceiling (ms), except that
+  // flash writes keep R503_TIMEOUT_WRITE_FLOOR
+  void setLimits(uint32_t floor, uint32_t ceiling);
+  
+  // count is the page range for SEARCH and ignored otherwise
+  uint32_t deadline(uint8_t opcode, uint16_t count = 0);
+  void record(uint8_t opcode, uint16_t count, uint32_t latency, uint8_t confirmCode);
+  void recordTimeout(uint8_t opcode);
+  void reset();
+  
+  uint16_t getSampleCount(uint8_t opcode);
+  uint32_t getMeanLatency(uint8_t opcode);
+  float getSearchCostPerPage() { return searchSlope; }
+  float getSearchFixedCost() { return searchIntercept; }
+  bool isSearchCostKnown() { return searchSlopeKnown; }
+  
+private:
+  struct OpcodeStats {
+    uint32_t smoothed;   // ms << 3
+    uint32_t deviation;  // ms << 2
+    uint16_t samples;
+    uint8_t backoff;
+  };
+  
+  OpcodeStats stats[R503_TIMEOUT_SLOTS];
+  uint32_t floor;
+  uint32_t ceiling;
+  
+  // Exponentially weighted least squares fit of SEARCH latency vs. count
+  float searchWeight;
+  float searchSumX;
+  float searchSumY;
+  float searchSumXX;
+  float searchSumXY;
+  float searchIntercept;
+  float searchSlope;
+  bool searchSlopeKnown;
+  
+  int8_t slot(uint8_t opcode);
+  bool isSlowPath(uint8_t opcode, uint8_t confirmCode);
+  bool isFlashWrite(uint8_t opcode);
+  uint32_t prior(uint8_t opcode, uint16_t count);
+  uint32_t learned(const OpcodeStats &s, uint8_t opcode, uint16_t count);
+  void fitSearch(uint16_t count, uint32_t latency);
+};
+
+#endif // R503_TIMEOUTMODEL_H
@@ -0,0 +1,196 @@
+// R503_Tuner.cpp
+#include "R503_Tuner.h"
+
+static const uint16_t defaultLevelThresholds[R503_TUNER_LEVELS] = { 45, 60, 75, 90, 105 };
+
+R503_Tuner::R503_Tuner(R503_Fingerprint *finger, R503_Library *library) {
+  this->finger = finger;
+  this->library = library;
+  this->threshold = 0;
+  this->tierSize = 0;
+  memcpy(levelThresholds, defaultLevelThresholds, sizeof(levelThresholds));
+  reset();
+}
+
+void R503_Tuner::recordGenuine(uint16_t score) {
+  uint8_t bin = binOf(score);
+  if (genuine[bin] < 0xFFFF) genuine[bin]++;
+}
+
+void R503_Tuner::recordImpostor(uint16_t score) {
+  uint8_t bin = binOf(score);
+  if (impostor[bin] < 0xFFFF) impostor[bin]++;
+}
+
+void R503_Tuner::recordIdentification(uint16_t pageID) {
+  if (pageID >= R503_LIBRARY_MAX_SIZE) return;
+  
+  // Halve everything instead of saturating so recent use keeps counting
+  if (uses[pageID] == 0xFFFF) {
+    identifications = 0;
+    for (uint16_t i = 0; i < R503_LIBRARY_MAX_SIZE; i++) {
+      uses[i] >>= 1;
+      identifications += uses[i];
+    }
+  }
+  uses[pageID]++;
+  identifications++;
+}
+
+uint16_t R503_Tuner::getUses(uint16_t pageID) {
+  if (pageID >= R503_LIBRARY_MAX_SIZE) return 0;
+  return uses[pageID];
+}
+
+void R503_Tuner::reset() {
+  memset(genuine, 0, sizeof(genuine));
+  memset(impostor, 0, sizeof(impostor));
+  memset(uses, 0, sizeof(uses));
+  identifications = 0;
+}
+
+void R503_Tuner::setLevelThresholds(const uint16_t *thresholds) {
+  memcpy(levelThresholds, thresholds, sizeof(levelThresholds));
+}
+
+bool R503_Tuner::evaluate(uint8_t securityLevel, R503_TunerReport &report) {
+  if (securityLevel < 1 || securityLevel > R503_TUNER_LEVELS) return false;
+  
+  report.securityLevel = securityLevel;
+  report.threshold = levelThresholds[securityLevel - 1];
+  rates(report.threshold, report.falseAcceptRate, report.falseRejectRate);
+  chooseTier(report);
+  return true;
+}
+
+bool R503_Tuner::evaluateAll(R503_TunerReport *reports) {
+  for (uint8_t level = 1; level <= R503_TUNER_LEVELS; level++) {
+    if (!evaluate(level, reports[level - 1])) return false;
+  }
+  return true;
+}
+
+bool R503_Tuner::recommend(float maxFalseAcceptRate, R503_TunerReport &report) {
+  uint32_t impostors = 0;
+  for (uint8_t i = 0; i < R503_TUNER_BINS; i++) {
+    impostors += impostor[i];
+  }
+  if (impostors == 0) return false;
+  
+  // Walk thresholds up one bin at a time until FAR is low enough
+  uint16_t candidate = 0;
+  float far = 1;
+  float frr = 0;
+  for (uint8_t bin = 0; bin <= R503_TUNER_BINS; bin++) {
+    candidate = bin * R503_TUNER_BIN_WIDTH;
+    rates(candidate, far, frr);
+    if (far <= maxFalseAcceptRate) break;
+  }
+  
+  // The module must not reject what the host would accept
+  report.securityLevel = 1;
+  for (uint8_t level = R503_TUNER_LEVELS; level >= 1; level--) {
+    if (levelThresholds[level - 1] <= candidate) {
+      report.securityLevel = level;
+      break;
+    }
+  }
+  
+  report.threshold = max(candidate, levelThresholds[report.securityLevel - 1]);
+  rates(report.threshold, report.falseAcceptRate, report.falseRejectRate);
+  chooseTier(report);
+  return true;
+}
+
+bool R503_Tuner::apply(const R503_TunerReport &report) {
+  if (!finger->setSystemParameter(R503_PARAM_SECURITY, report.securityLevel)) return false;
+  
+  threshold = report.threshold;
+  tierSize = report.tierSize;
+  return true;
+}
+
+bool R503_Tuner::search(uint8_t slot, uint16_t &fingerID, uint16_t &score) {
+  uint16_t end = searchEnd();
+  if (end == 0) return false;
+  
+  uint16_t tier = min(tierSize, end);
+  bool found = false;
+  if (tier > 0) {
+    found = finger->searchLibrary(slot, 0, tier, fingerID, score) && score >= threshold;
+  }
+  if (!found && tier < end) {
+    found = finger->searchLibrary(slot, tier, end - tier, fingerID, score) && score >= threshold;
+  }
+  
+  if (found) {
+    recordIdentification(fingerID);
+  }
+  return found;
+}
+
+uint8_t R503_Tuner::binOf(uint16_t score) {
+  return min(score / R503_TUNER_BIN_WIDTH, R503_TUNER_BINS - 1);
+}
+
+void R503_Tuner::rates(uint16_t threshold, float &far, float &frr) {
+  uint32_t genuineTotal = 0;
+  uint32_t impostorTotal = 0;
+  uint32_t rejected = 0;
+  uint32_t accepted = 0;
+  uint16_t cut = (threshold + R503_TUNER_BIN_WIDTH - 1) / R503_TUNER_BIN_WIDTH;
+  
+  for (uint8_t i = 0; i < R503_TUNER_BINS; i++) {
+    genuineTotal += genuine[i];
+    impostorTotal += impostor[i];
+    if (i < cut) {
+      rejected += genuine[i];
+    } else {
+      accepted += impostor[i];
+    }
+  }
+  
+  far = impostorTotal > 0 ? (float)accepted / impostorTotal : 0;
+  frr = genuineTotal > 0 ? (float)rejected / genuineTotal : 0;
+}
+
+float R503_Tuner::searchCost(uint16_t pages) {
+  R503_TimeoutModel &model = finger->getTimeoutModel();
+  if (model.isSearchCostKnown()) {
+    return model.getSearchFixedCost() + model.getSearchCostPerPage() * pages;
+  }
+  return R503_TUNER_SEARCH_FIXED_MS + R503_TUNER_SEARCH_PER_PAGE_MS * pages;
+}
+
+uint16_t R503_Tuner::searchEnd() {
+  if (library->getSize() > 0) return library->getUsedEnd();
+  
+  // Without a refreshed index nothing is known about occupancy
+  R503_SystemParams params;
+  if (!finger->getSystemParams(params)) return 0;
+  return min(params.librarySize, (uint16_t)R503_LIBRARY_MAX_SIZE);
+}
+
+void R503_Tuner::chooseTier(R503_TunerReport &report) {
+  uint16_t end = searchEnd();
+  
+  report.fullSearchLatencyMs = searchCost(end);
+  report.expectedLatencyMs = report.fullSearchLatencyMs;
+  report.tierSize = 0;
+  report.tierHitRate = 0;
+  if (identifications == 0) return;
+  
+  // A miss in the tier costs a second search over the rest, and genuine
+  // rejects always take both
+  uint32_t covered = 0;
+  for (uint16_t n = 1; n < end; n++) {
+    covered += uses[n - 1];
+    float hitRate = (float)covered / identifications * (1 - report.falseRejectRate);
+    float latency = searchCost(n) + (1 - hitRate) * searchCost(end - n);
+    if (latency < report.expectedLatencyMs) {
+      report.expectedLatencyMs = latency;
+      report.tierSize = n;
+      report.tierHitRate = hitRate;
+    }
+  }
+}
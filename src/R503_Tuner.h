@@ -0,0 +1,92 @@
+// R503_Tuner.h
+#ifndef R503_TUNER_H
+#define R503_TUNER_H
+
+#include "R503_Fingerprint.h"
+#include "R503_Library.h"
+
+#define R503_TUNER_BIN_WIDTH 10
+#define R503_TUNER_BINS 32
+#define R503_TUNER_LEVELS 5
+
+// Used until the driver's timeout model has fitted SEARCH latency
+#define R503_TUNER_SEARCH_FIXED_MS 20
+#define R503_TUNER_SEARCH_PER_PAGE_MS 1.0f
+
+// Expected behaviour of one configuration
+struct R503_TunerReport {
+  uint8_t securityLevel;
+  uint16_t threshold;          // scores below this are rejected
+  float falseAcceptRate;
+  float falseRejectRate;
+  uint16_t tierSize;           // pages [0, tierSize) are searched first
+  float tierHitRate;           // identifications found in the first tier
+  float expectedLatencyMs;     // search time with the tier
+  float fullSearchLatencyMs;   // search time over the whole used range
+};
+
+// Picks the security level, an acceptance threshold and a search tier from
+// what the deployment has actually seen.
+//
+// Feed it scores labelled by the application: recordGenuine() for matches
+// confirmed another way (card, PIN, claimed identity), recordImpostor() for
+// scores known to come from someone else. recordIdentification() counts
+// which pages get identified; search() does it automatically. FAR and FRR
+// are read off the score histograms, latency comes from the SEARCH cost
+// fitted by the driver's timeout model.
+//
+// Search ranges end at library->getUsedEnd(), so call refresh() on the
+// library at startup and keep it current (setOccupied) when enrolling or
+// deleting. A library that was never refreshed has size 0; the whole
+// module library is searched then.
+//
+// The first tier is the prefix of the library that minimises expected
+// search time, so it pays off once frequent users sit at low pages
+// (R503_Defragmenter with getUses() as the frequency source). Searching the
+// tier first returns its best match even if a better one lives above it,
+// which can only add false accepts when the threshold is below the
+// impostor range.
+class R503_Tuner {
+public:
+  R503_Tuner(R503_Fingerprint *finger, R503_Library *library);
+  
+  void recordGenuine(uint16_t score);
+  void recordImpostor(uint16_t score);
+  void recordIdentification(uint16_t pageID);
+  uint16_t getUses(uint16_t pageID);
+  void reset();
+  
+  // Module acceptance score for levels 1..5. The defaults follow the
+  // emulator; calibrate real modules with an ImageReplay sweep.
+  void setLevelThresholds(const uint16_t *thresholds);
+  
+  bool evaluate(uint8_t securityLevel, R503_TunerReport &report);
+  bool evaluateAll(R503_TunerReport *reports);
+  
+  // Lowest threshold whose FAR stays within maxFalseAcceptRate, with the
+  // strictest security level that does not reject above it
+  bool recommend(float maxFalseAcceptRate, R503_TunerReport &report);
+  bool apply(const R503_TunerReport &report);
+  
+  // Tiered search of CHARBUFFER slot; applies the threshold and counts the hit
+  bool search(uint8_t slot, uint16_t &fingerID, uint16_t &score);
+  
+private:
+  R503_Fingerprint *finger;
+  R503_Library *library;
+  uint16_t genuine[R503_TUNER_BINS];
+  uint16_t impostor[R503_TUNER_BINS];
+  uint16_t uses[R503_LIBRARY_MAX_SIZE];
+  uint32_t identifications;
+  uint16_t levelThresholds[R503_TUNER_LEVELS];
+  uint16_t threshold;
+  uint16_t tierSize;
+  
+  uint8_t binOf(uint16_t score);
+  void rates(uint16_t threshold, float &far, float &frr);
+  float searchCost(uint16_t pages);
+  uint16_t searchEnd();
+  void chooseTier(R503_TunerReport &report);
+};
+
+#endif // R503_TUNER_H